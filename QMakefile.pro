@@ -94,6 +94,8 @@ HEADERS += include/PRadEventViewer.h \
            include/PRadHyCalCluster.h \
            include/PRadSquareCluster.h \
            include/PRadIslandCluster.h \
+           include/PRadClusterCompare.h \
+           include/PRadEventCache.h \
            include/PRadGEMSystem.h \
            include/PRadGEMDetector.h \
            include/PRadGEMPlane.h \
@@ -139,6 +141,8 @@ SOURCES += src/main.cpp \
            src/PRadHyCalCluster.cpp \
            src/PRadSquareCluster.cpp \
            src/PRadIslandCluster.cpp \
+           src/PRadClusterCompare.cpp \
+           src/PRadEventCache.cpp \
            src/PRadGEMSystem.cpp \
            src/PRadGEMDetector.cpp \
            src/PRadGEMPlane.cpp \
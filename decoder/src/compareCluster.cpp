@@ -0,0 +1,95 @@
+//============================================================================//
+// Compare all the HyCal clustering methods in one pass over DST files        //
+//                                                                            //
+// 10/18/2026                                                                 //
+//============================================================================//
+
+#include "PRadHyCalSystem.h"
+#include "PRadDSTParser.h"
+#include "PRadClusterCompare.h"
+#include "PRadBenchMark.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+#define PROGRESS_COUNT 10000
+
+using namespace std;
+
+void print_instruction()
+{
+    cout << "usage: compareCluster <options> <file1> <file2> ..." << endl
+         << setw(10) << "-o : " << "output root file for the histograms" << endl
+         << setw(10) << "-h : " << "show options" << endl
+         << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    string output = "compare_cluster.root";
+    vector<string> files;
+
+    char *ptr;
+    for(int i = 1; i < argc; ++i)
+    {
+        ptr = argv[i];
+        if(*(ptr++) == '-') {
+            switch(*(ptr++))
+            {
+            case 'o':
+                output = argv[++i];
+                break;
+            case 'h':
+            default:
+                print_instruction();
+                return 0;
+            }
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if(files.empty()) {
+        print_instruction();
+        return 0;
+    }
+
+    PRadHyCalSystem *hycal_sys = new PRadHyCalSystem("config/hycal.conf");
+    PRadClusterCompare compare(hycal_sys);
+    PRadDSTParser dst_parser;
+
+    PRadBenchMark timer;
+    int count = 0;
+    for(auto &file : files)
+    {
+        hycal_sys->ChooseRun(file);
+        dst_parser.OpenInput(file);
+
+        while(dst_parser.Read())
+        {
+            if(dst_parser.EventType() != PRadDSTParser::Type::event)
+                continue;
+
+            auto &event = dst_parser.GetEvent();
+            if(!event.is_physics_event())
+                continue;
+
+            compare.Process(event);
+
+            if(++count%PROGRESS_COUNT == 0) {
+                cout <<"------[ ev " << count << " ]---"
+                     << "---[ " << timer.GetElapsedTimeStr() << " ]------"
+                     << "\r" << flush;
+            }
+        }
+
+        dst_parser.CloseInput();
+    }
+
+    cout << endl;
+    compare.PrintSummary(cout);
+    compare.SaveHists(output);
+
+    return 0;
+}
@@ -1,21 +1,20 @@
 //============================================================================//
 // Calculate the mean value of gain factor for each channel, for a given      //
-// period based on the LMS root file produced during zero-suppression replay, //
-// these files can be found on ifarm /work/hallb/prad/replay_LMS              //
+// period based on the replayed DST files, these files can be found on ifarm  //
+// /work/hallb/prad/replay, only the ADC data of LMS and alpha events are     //
+// read from the files                                                        //
 //                                                                            //
 // Weizhi Xiong                                                               //
 // 10/23/2016                                                                 //
 //============================================================================//
 
-#include "PRadDataHandler.h"
-#include "TFile.h"
+#include "PRadHyCalSystem.h"
+#include "PRadDSTParser.h"
+#include "ConfigParser.h"
 #include "TH1.h"
 #include "TMath.h"
 #include "TAxis.h"
 #include "TSystem.h"
-#include "TROOT.h"
-#include "TKey.h"
-#include "TClass.h"
 #include "TF1.h"
 #include <math.h>
 #include <iostream>
@@ -23,6 +22,7 @@
 #include <vector>
 #include <cassert>
 #include <iomanip>
+#include <algorithm>
 
 #define BLOCKS 1728
 #define NREFERENCE 3
@@ -30,10 +30,10 @@
 
 using namespace std;
 //global variables
-string inputDir = "./calibration/LMS"; //define input root file here
+string inputDir = "/work/hallb/prad/replay"; //define input dst file here
 string outDir   = "./calibration/LMS"; //define output dat file here
 vector<string> inputFiles;
-TFile* rootFile;
+PRadHyCalSystem *hycal;
 bool doAverage;
 int startRun;
 int endRun;
@@ -55,8 +55,9 @@ int   GetRunNumber(string run);
 bool  SortFile(string name1, string name2);
 void  FindInputFiles();
 void  FitHistograms();
-void  FitHyCalHist(TKey* k, int & i);
-void  FitReferenceHist(TKey* k);
+void  FillHistograms(const string &file);
+void  FitHyCalHist(PRadADCChannel *ch, int & i);
+void  FitReferenceHist(PRadADCChannel *ch);
 double GetMaxBinCenterInRange(TH1* h, double xmin, double xmax);
 void  WriteOutput(double nTotal, int rNumber = -1);
 
@@ -97,7 +98,9 @@ int main(int argc, char * argv [])
 
     InitArray();
 
-    FindInputFiles();//search for root files that within the directory
+    hycal = new PRadHyCalSystem("config/hycal.conf");
+
+    FindInputFiles();//search for dst files that within the directory
 
     FitHistograms();
 
@@ -127,41 +130,56 @@ void InitArray()
 void FitHistograms()
 {
     for (unsigned int i=0; i<inputFiles.size(); i++){
-        rootFile = new TFile(inputFiles.at(i).c_str(), "READ");
         cout<<"analyzing file "<<inputFiles[i]<<endl;
-        TIter next(rootFile->GetListOfKeys());
-        TKey *thisKey;
+        FillHistograms(inputFiles[i]);
         int ich = 0;
-        while ( (thisKey = (TKey*)next()) ){
-            TClass *thisClass = gROOT->GetClass(thisKey->GetClassName());
-            if (!thisClass->InheritsFrom("TList")) continue;
-            if ( (thisKey->GetName())[0] == 'W' || (thisKey->GetName())[0] == 'G' ){
-                if (i==0) channelName[ich] = string(thisKey->GetName());
+        for (auto ch : hycal->GetADCList()){
+            const string &name = ch->GetName();
+            if ( (name[0] == 'W' || name[0] == 'G') && ich < BLOCKS ){
+                if (i==0) channelName[ich] = name;
 
-                FitHyCalHist(thisKey, ich);
+                FitHyCalHist(ch, ich);
                 ich++;
             }
-            if ( !strncmp("LMS", thisKey->GetName(), 3))
-            FitReferenceHist(thisKey);
+            if ( !strncmp("LMS", name.c_str(), 3))
+            FitReferenceHist(ch);
         }
         if (!doAverage) WriteOutput(1., GetRunNumber(inputFiles[i]) );
-        delete rootFile; rootFile = 0;
     }
     if (doAverage) WriteOutput((double)inputFiles.size());
 }
 //_________________________________________________________________________________
-void FitHyCalHist(TKey* k, int & i)
+void FillHistograms(const string &file)
+{
+    for (auto ch : hycal->GetADCList())
+        ch->ResetHists();
+
+    PRadDSTParser dst_parser;
+    dst_parser.OpenInput(file);
+
+    // only LMS and alpha events are needed, the other events are skipped
+    // without being parsed, and only the ADC data are read
+    uint32_t trigger_mask = 0;
+    SET_BIT(trigger_mask, LMS_Led);
+    SET_BIT(trigger_mask, LMS_Alpha);
+    dst_parser.SetTriggerMask(trigger_mask);
+    dst_parser.SetADCOnly(true);
+
+    while (dst_parser.Read()){
+        if (dst_parser.EventType() == PRadDSTParser::Type::event)
+            hycal->FillHists(dst_parser.GetEvent());
+    }
+
+    dst_parser.CloseInput();
+}
+//_________________________________________________________________________________
+void FitHyCalHist(PRadADCChannel *ch, int & i)
 {
     if (!doAverage){
         pedMean[i]  = 0.; pedSigma[i] = 0.; LMSMean[i]  = 0.; LMSSigma[i] = 0.;
     }
-    TList *thisList = (TList*)k->ReadObj();
-    string LMSHistName(k->GetName());
-    LMSHistName+="_LMS";
-    string PedHistName(k->GetName());
-    PedHistName+="_PED";
-    TH1 *theLMSHist = (TH1*)thisList->FindObject(LMSHistName.c_str());
-    TH1 *thePedHist = (TH1*)thisList->FindObject(PedHistName.c_str());
+    TH1 *theLMSHist = ch->GetHist("LMS");
+    TH1 *thePedHist = ch->GetHist("Pedestal");
     //fit HyCal Module LMS
     TAxis *LMSAxis  = theLMSHist->GetXaxis();
     double integral  = theLMSHist->Integral(LMSAxis->FindBin(1),
@@ -193,10 +211,9 @@ void FitHyCalHist(TKey* k, int & i)
 
 }
 //_________________________________________________________________________________
-void FitReferenceHist(TKey* k)
+void FitReferenceHist(PRadADCChannel *ch)
 {
-    TList *thisList = (TList*)k->ReadObj();
-    int iref = ( (k->GetName())[3] - '0' ) - 1;
+    int iref = ( (ch->GetName())[3] - '0' ) - 1;
     assert(iref >=0 && iref < NREFERENCE);
 
     //if not averaging things over many runs, clean arrays before filling
@@ -204,13 +221,10 @@ void FitReferenceHist(TKey* k)
         refLMSMean[iref] = 0.; refPedMean[iref] = 0.; refAlphaMean[iref] = 0.; refGain[iref] = 0.;
         refLMSSigma[iref] = 0.; refPedSigma[iref] = 0.;
     }
-    string LMSHistName(k->GetName());
-    LMSHistName+="_LMS";
-    string PhysHistName(k->GetName());
-    PhysHistName+="_PHYS";
-
-    TH1 *theLMSHist = (TH1*)thisList->FindObject(LMSHistName.c_str());
-    TH1 *thePhysHist = (TH1*)thisList->FindObject(PhysHistName.c_str());
+    // the physics histogram of LMS PMTs has both the pedestal and the alpha
+    // source signals, it is filled by the alpha events
+    TH1 *theLMSHist = ch->GetHist("LMS");
+    TH1 *thePhysHist = ch->GetHist("Physics");
 
     TAxis *physAxis = thePhysHist->GetXaxis();
     double integral1 = thePhysHist->Integral(physAxis->FindBin(1), physAxis->FindBin(1000));
@@ -308,12 +322,7 @@ void WriteOutput(double nTotal, int rNumber)
 //_________________________________________________________________________________
 int GetRunNumber(string run)
 {
-    string sub = run.substr(strlen(run.c_str())-13 , 4);
-    if (sub.at(0) == '0'){
-        return stoi(sub.substr(1,4));
-    }else{
-        return stoi(sub);
-    }
+    return ConfigParser::find_integer(ConfigParser::decompose_path(run).name);
 }
 //__________________________________________________________________________________
 bool SortFile(string name1, string name2)
@@ -332,7 +341,7 @@ void FindInputFiles()
     cout<<"Scanning for input files in "<< inputDir <<" "<<flush;
     const char* dir_item;
     while( (dir_item = gSystem->GetDirEntry(dirp)) ){
-        if (!strncmp("prad_", dir_item, 5) && !strncmp("LMS.root", dir_item+strlen(dir_item)-8, 8)){
+        if (!strncmp("prad_", dir_item, 5) && !strncmp(".dst", dir_item+strlen(dir_item)-4, 4)){
         string thisName = inputDir;
         thisName.append("/");
         thisName.append(dir_item);
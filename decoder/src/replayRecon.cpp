@@ -0,0 +1,158 @@
+//============================================================================//
+// An application of replaying the 1st-level DST file and save the            //
+// reconstructed events into the 2nd-level DST file                           //
+// HyCal and GEM hits are reconstructed, transformed and matched, the hits    //
+// and the configuration hash are saved for each physics event, so the later  //
+// analysis can read the hits by PRadDSTParser without clustering again       //
+//                                                                            //
+// 10/18/2026                                                                 //
+//============================================================================//
+
+#include "PRadDSTParser.h"
+#include "PRadInfoCenter.h"
+#include "PRadBenchMark.h"
+#include "PRadEPICSystem.h"
+#include "PRadHyCalSystem.h"
+#include "PRadGEMSystem.h"
+#include "PRadCoordSystem.h"
+#include "PRadDetMatch.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+
+#define PROGRESS_COUNT 10000
+
+using namespace std;
+
+void print_instruction()
+{
+    cout << "usage: " << endl
+         << setw(10) << "-i : " << "input file path (1st-level DST)" << endl
+         << setw(10) << "-o : " << "output file path" << endl
+         << setw(10) << "-h : " << "show options" << endl
+         << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc < 2) {
+        print_instruction();
+        return 0;
+    }
+
+    char *ptr;
+    string output, input;
+
+    // -i input_file -o output_file
+    for(int i = 1; i < argc; ++i)
+    {
+        ptr = argv[i];
+        if(*(ptr++) == '-') {
+            switch(*(ptr++))
+            {
+            case 'o':
+                output = argv[++i];
+                break;
+            case 'i':
+                input = argv[++i];
+                break;
+            case 'h':
+                print_instruction();
+                break;
+            default:
+                cout << "Unkown option! check with -h" << endl;
+                exit(1);
+            }
+        }
+    }
+
+    if(output.empty())
+        output = ConfigParser::decompose_path(input).name + "_recon.dst";
+
+    // initialize objects
+    PRadEPICSystem *epics = new PRadEPICSystem("config/epics_channels.conf");
+    PRadHyCalSystem *hycal = new PRadHyCalSystem("config/hycal.conf");
+    PRadGEMSystem *gem = new PRadGEMSystem("config/gem.conf");
+    PRadCoordSystem *coord_sys = new PRadCoordSystem("database/coordinates.dat");
+    PRadDetMatch *det_match = new PRadDetMatch("config/det_match.conf");
+
+    hycal->ChooseRun(input);
+    coord_sys->ChooseCoord(PRadInfoCenter::GetRunNumber());
+
+    PRadHyCalDetector *hycal_det = hycal->GetDetector();
+    PRadGEMDetector *gem_det1 = gem->GetDetector("PRadGEM1");
+    PRadGEMDetector *gem_det2 = gem->GetDetector("PRadGEM2");
+
+    uint32_t config_hash = PRadDSTParser::GetReconConfigHash(hycal, gem, det_match);
+
+    PRadDSTParser dst_parser;
+    dst_parser.OpenInput(input);
+    dst_parser.OpenOutput(output);
+
+    // calibration and epics information
+    dst_parser.WriteHyCalInfo(hycal);
+    dst_parser.WriteGEMInfo(gem);
+    dst_parser.WriteEPICSMap(epics);
+
+    PRadBenchMark timer;
+    int count = 0;
+
+    while(dst_parser.Read())
+    {
+        if(dst_parser.EventType() == PRadDSTParser::Type::event) {
+            auto &event = dst_parser.GetEvent();
+
+            // update run information
+            PRadInfoCenter::Instance().UpdateInfo(event);
+
+            // only physics events are reconstructed
+            if(!event.is_physics_event())
+                continue;
+
+            if((++count)%PROGRESS_COUNT == 0) {
+                cout <<"------[ ev " << count << " ]---"
+                     << "---[ " << timer.GetElapsedTimeStr() << " ]---"
+                     << "---[ " << timer.GetElapsedTime()/(double)count << " ms/ev ]------"
+                     << "\r" << flush;
+            }
+
+            // reconstruct
+            hycal->Reconstruct(event);
+            gem->Reconstruct(event);
+
+            ReconEventData recon(event, config_hash);
+            recon.hycal_hits = hycal_det->GetHits();
+            recon.gem1_hits = gem_det1->GetHits();
+            recon.gem2_hits = gem_det2->GetHits();
+
+            // coordinates transform
+            coord_sys->Transform(PRadDetector::HyCal, recon.hycal_hits.begin(), recon.hycal_hits.end());
+            coord_sys->Transform(PRadDetector::PRadGEM1, recon.gem1_hits.begin(), recon.gem1_hits.end());
+            coord_sys->Transform(PRadDetector::PRadGEM2, recon.gem2_hits.begin(), recon.gem2_hits.end());
+
+            // hits matching, the matching changes the flags of HyCal hits
+            recon.matched = det_match->Match(recon.hycal_hits, recon.gem1_hits, recon.gem2_hits);
+
+            dst_parser.WriteReconEvent(recon);
+
+        } else if(dst_parser.EventType() == PRadDSTParser::Type::epics) {
+            // save epics into system, and keep it in the output
+            epics->AddEvent(dst_parser.GetEPICSEvent());
+            dst_parser.WriteEPICS();
+        }
+    }
+
+    dst_parser.WriteRunInfo();
+
+    dst_parser.CloseInput();
+    dst_parser.CloseOutput();
+
+    cout <<"------[ ev " << count << " ]---"
+         << "---[ " << timer.GetElapsedTimeStr() << " ]---"
+         << "---[ " << timer.GetElapsedTime()/(double)count << " ms/ev ]------"
+         << endl;
+    cout << "TIMER: Finished, took " << timer.GetElapsedTime() << " ms" << endl;
+    cout << "Configuration hash: " << hex << config_hash << dec << endl;
+
+    return 0;
+}
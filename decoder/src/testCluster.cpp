@@ -0,0 +1,396 @@
+//============================================================================//
+// A benchmark for HyCal clustering methods with synthetic shower events      //
+// Events are generated from the cluster profile and the module list, so the  //
+// speed and the physics performance of each method can be compared without   //
+// real data files                                                            //
+//                                                                            //
+// 10/18/2026                                                                 //
+//============================================================================//
+
+#include "PRadHyCalSystem.h"
+#include "PRadClusterProfile.h"
+#include "PRadBenchMark.h"
+#include "ConfigParser.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <cmath>
+#include <new>
+
+// 14-bit ADC (Fastbus 1881M)
+#define ADC_MAX_VALUE 16383.
+
+using namespace std;
+
+//============================================================================//
+// allocation counter                                                         //
+//============================================================================//
+
+static atomic<size_t> __alloc_count(0);
+
+void *operator new(size_t size)
+{
+    ++__alloc_count;
+    void *ptr = malloc(size ? size : 1);
+    if(!ptr)
+        throw bad_alloc();
+    return ptr;
+}
+
+void operator delete(void *ptr) noexcept
+{
+    free(ptr);
+}
+
+void operator delete(void *ptr, size_t) noexcept
+{
+    free(ptr);
+}
+
+//============================================================================//
+// shower generator                                                           //
+//============================================================================//
+
+struct GenSettings
+{
+    unsigned int events = 10000;
+    unsigned int showers = 1;
+    float min_energy = 500.;        // MeV
+    float max_energy = 2000.;       // MeV
+    float min_sep = 100.;           // mm, separation between showers
+    float max_sep = 400.;           // mm
+    float noise = 0.;               // MeV, gaussian noise on every module
+    float dead_frac = 0.;           // fraction of extra dead modules
+    unsigned int seed = 1;
+};
+
+struct GenEvent
+{
+    EventData data;
+    vector<BaseHit> truth;
+};
+
+class ShowerGenerator
+{
+public:
+    ShowerGenerator(PRadHyCalSystem *s, const GenSettings &g)
+    : sys(s), set(g), rng(g.seed)
+    {
+        for(auto module : sys->GetModuleList())
+        {
+            PRadADCChannel *adc = module->GetChannel();
+            if(!adc || TEST_BIT(module->GetLayoutFlag(), kDeadModule) ||
+               module->GetCalibrationFactor() <= 0.)
+                continue;
+            live.push_back(module);
+        }
+    }
+
+    // generate an event, the random sequence only depends on the seed
+    void Generate(GenEvent &event)
+    {
+        event.truth.clear();
+        event.data.clear();
+        event.data.update_trigger(PHYS_TotalSum);
+
+        uniform_real_distribution<float> edist(set.min_energy, set.max_energy);
+
+        for(unsigned int i = 0; i < set.showers; ++i)
+        {
+            float x, y;
+            if(!position(event.truth, x, y))
+                break;
+            event.truth.emplace_back(x, y, 0., edist(rng));
+        }
+
+        deposit(event);
+    }
+
+    const vector<PRadHyCalModule*> &GetLiveModules() const {return live;};
+
+private:
+    // first shower is uniformly distributed on a random module, the following
+    // ones are placed around a previous shower within the separation range
+    bool position(const vector<BaseHit> &prev, float &x, float &y)
+    {
+        uniform_real_distribution<float> unit(0., 1.);
+
+        for(int trial = 0; trial < 1000; ++trial)
+        {
+            if(prev.empty()) {
+                auto module = live[rng()%live.size()];
+                x = module->GetX() + (unit(rng) - 0.5)*module->GetSizeX();
+                y = module->GetY() + (unit(rng) - 0.5)*module->GetSizeY();
+                return true;
+            }
+
+            const auto &ref = prev[rng()%prev.size()];
+            float dist = set.min_sep + unit(rng)*(set.max_sep - set.min_sep);
+            float angle = unit(rng)*2.*M_PI;
+            x = ref.x + dist*cos(angle);
+            y = ref.y + dist*sin(angle);
+
+            // should be on a live module
+            auto module = sys->GetDetector()->GetModule(x, y);
+            if(!module || find(live.begin(), live.end(), module) == live.end())
+                continue;
+
+            bool separated = true;
+            for(auto &hit : prev)
+            {
+                if(hypot(hit.x - x, hit.y - y) < set.min_sep) {
+                    separated = false;
+                    break;
+                }
+            }
+
+            if(separated)
+                return true;
+        }
+
+        return false;
+    }
+
+    // share the shower energy to modules according to the profile, and convert
+    // it to adc values with the channel's pedestal and gain
+    void deposit(GenEvent &event)
+    {
+        auto &profile = PRadClusterProfile::Instance();
+        normal_distribution<float> noise(0., set.noise);
+        float threshold = 3.*set.noise;
+
+        for(auto module : live)
+        {
+            ModuleHit mhit(module, 0.);
+            float energy = 0.;
+            for(auto &shower : event.truth)
+            {
+                energy += shower.E*profile.GetProfile(shower.x, shower.y, mhit).frac;
+            }
+
+            if(set.noise > 0.)
+                energy += noise(rng);
+
+            // sparsified readout
+            if(energy <= threshold || energy <= 0.)
+                continue;
+
+            PRadADCChannel *adc = module->GetChannel();
+            float val = adc->GetPedestal().mean + energy/module->GetCalibrationFactor();
+            if(val > ADC_MAX_VALUE)
+                val = ADC_MAX_VALUE;
+            event.data.add_adc(ADC_Data(adc->GetID(), (unsigned short)(val + 0.5)));
+        }
+    }
+
+private:
+    PRadHyCalSystem *sys;
+    GenSettings set;
+    mt19937 rng;
+    vector<PRadHyCalModule*> live;
+};
+
+//============================================================================//
+// benchmark                                                                  //
+//============================================================================//
+
+// maximum distance between a reconstructed hit and the generated shower (mm)
+#define MATCH_DISTANCE 40.
+
+struct Residuals
+{
+    size_t showers = 0, matched = 0, clusters = 0;
+    double dx = 0., dx2 = 0., dy = 0., dy2 = 0., de = 0., de2 = 0.;
+
+    void Add(const vector<BaseHit> &truth, const vector<HyCalHit> &hits)
+    {
+        showers += truth.size();
+        clusters += hits.size();
+
+        for(auto &t : truth)
+        {
+            // match the closest hit within the distance limit
+            const HyCalHit *best = nullptr;
+            float best_dist = MATCH_DISTANCE;
+            for(auto &h : hits)
+            {
+                float dist = hypot(h.x - t.x, h.y - t.y);
+                if(dist < best_dist) {
+                    best_dist = dist;
+                    best = &h;
+                }
+            }
+
+            if(!best)
+                continue;
+
+            ++matched;
+            double rx = best->x - t.x, ry = best->y - t.y, re = (best->E - t.E)/t.E;
+            dx += rx, dx2 += rx*rx;
+            dy += ry, dy2 += ry*ry;
+            de += re, de2 += re*re;
+        }
+    }
+};
+
+inline double __mean(double sum, size_t n) {return n ? sum/n : 0.;}
+inline double __rms(double sum, double sum2, size_t n)
+{
+    if(!n)
+        return 0.;
+    double mean = sum/n;
+    return sqrt(max(0., sum2/n - mean*mean));
+}
+
+void benchmark(PRadHyCalSystem *sys, const string &method, vector<GenEvent> &events)
+{
+    sys->SetClusterMethod(method);
+    if(!ConfigParser::strcmp_case_insensitive(sys->GetClusterMethodName(), method)) {
+        cout << "Cannot find clustering method " << method << ", skipped." << endl;
+        return;
+    }
+
+    // warm up the containers
+    for(size_t i = 0; i < min<size_t>(events.size(), 100); ++i)
+        sys->Reconstruct(events[i].data);
+
+    vector<double> latency;
+    latency.reserve(events.size());
+    Residuals res;
+    size_t allocs = 0;
+
+    PRadBenchMark timer;
+    for(auto &event : events)
+    {
+        size_t alloc_begin = __alloc_count;
+        auto t0 = chrono::high_resolution_clock::now();
+        sys->Reconstruct(event.data);
+        auto t1 = chrono::high_resolution_clock::now();
+        allocs += __alloc_count - alloc_begin;
+
+        latency.push_back(chrono::duration<double, micro>(t1 - t0).count());
+        res.Add(event.truth, sys->GetDetector()->GetHits());
+    }
+    double total = timer.GetElapsedTime();
+
+    sort(latency.begin(), latency.end());
+    auto percentile = [&latency] (double p)
+                      {
+                          if(latency.empty())
+                              return 0.;
+                          return latency[size_t(p*(latency.size() - 1))];
+                      };
+
+    size_t n = events.size();
+    cout << "Method " << method << endl
+         << setw(24) << "throughput: " << (total > 0. ? n*1000./total : 0.) << " ev/s" << endl
+         << setw(24) << "latency (us): "
+         << "p50 " << percentile(0.5)
+         << ", p90 " << percentile(0.9)
+         << ", p99 " << percentile(0.99)
+         << ", max " << percentile(1.0) << endl
+         << setw(24) << "allocations: " << (n ? (double)allocs/n : 0.) << " /ev" << endl
+         << setw(24) << "efficiency: " << res.matched << "/" << res.showers
+         << ", " << res.clusters << " clusters" << endl
+         << setw(24) << "x residual (mm): " << __mean(res.dx, res.matched)
+         << " +- " << __rms(res.dx, res.dx2, res.matched) << endl
+         << setw(24) << "y residual (mm): " << __mean(res.dy, res.matched)
+         << " +- " << __rms(res.dy, res.dy2, res.matched) << endl
+         << setw(24) << "dE/E: " << __mean(res.de, res.matched)
+         << " +- " << __rms(res.de, res.de2, res.matched) << endl;
+}
+
+void print_instruction()
+{
+    cout << "usage: testCluster <options>" << endl
+         << setw(10) << "-n : " << "number of events (10000)" << endl
+         << setw(10) << "-s : " << "number of showers per event (1)" << endl
+         << setw(10) << "-e : " << "min shower energy in MeV (500)" << endl
+         << setw(10) << "-E : " << "max shower energy in MeV (2000)" << endl
+         << setw(10) << "-d : " << "min shower separation in mm (100)" << endl
+         << setw(10) << "-D : " << "max shower separation in mm (400)" << endl
+         << setw(10) << "-p : " << "noise on every module in MeV (0)" << endl
+         << setw(10) << "-k : " << "fraction of extra dead modules (0)" << endl
+         << setw(10) << "-r : " << "random seed (1)" << endl
+         << setw(10) << "-m : " << "only test this clustering method" << endl
+         << setw(10) << "-h : " << "show options" << endl
+         << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    GenSettings set;
+    vector<string> methods;
+
+    char *ptr;
+    for(int i = 1; i < argc; ++i)
+    {
+        ptr = argv[i];
+        if(*(ptr++) != '-' || (*ptr != 'h' && i + 1 >= argc)) {
+            print_instruction();
+            return 0;
+        }
+
+        switch(*(ptr++))
+        {
+        case 'n': set.events = atoi(argv[++i]); break;
+        case 's': set.showers = atoi(argv[++i]); break;
+        case 'e': set.min_energy = atof(argv[++i]); break;
+        case 'E': set.max_energy = atof(argv[++i]); break;
+        case 'd': set.min_sep = atof(argv[++i]); break;
+        case 'D': set.max_sep = atof(argv[++i]); break;
+        case 'p': set.noise = atof(argv[++i]); break;
+        case 'k': set.dead_frac = atof(argv[++i]); break;
+        case 'r': set.seed = atoi(argv[++i]); break;
+        case 'm': methods.push_back(argv[++i]); break;
+        case 'h':
+        default:
+            print_instruction();
+            return 0;
+        }
+    }
+
+    PRadHyCalSystem *sys = new PRadHyCalSystem("config/hycal.conf");
+
+    // kill some extra modules
+    if(set.dead_frac > 0.) {
+        mt19937 rng(set.seed);
+        uniform_real_distribution<float> unit(0., 1.);
+        for(auto module : sys->GetModuleList())
+        {
+            if(module->GetChannel() && unit(rng) < set.dead_frac)
+                module->GetChannel()->SetDead(true);
+        }
+        sys->GetDetector()->CreateDeadHits();
+#ifdef USE_PRIMEX_METHOD
+        auto primex = static_cast<PRadPrimexCluster*>(sys->GetClusterMethod("Primex"));
+        if(primex)
+            primex->UpdateModuleStatus(sys->GetModuleList());
+#endif
+    }
+
+    // generate all the events first
+    PRadBenchMark timer;
+    ShowerGenerator gen(sys, set);
+    vector<GenEvent> events(set.events);
+    for(auto &event : events)
+        gen.Generate(event);
+
+    cout << "Generated " << events.size() << " events with " << set.showers
+         << " shower(s) on " << gen.GetLiveModules().size() << " live modules in "
+         << timer.GetElapsedTime() << " ms." << endl;
+
+    if(methods.empty())
+        methods = sys->GetClusterMethodNames();
+
+    for(auto &method : methods)
+        benchmark(sys, method, events);
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+//============================================================================//
+// Benchmark the X/Y pairing modes of GEM clustering on DST files             //
+// GEM hits are formed from the same strip clusters with every pairing mode,  //
+// then matched with HyCal hits, the time spent in pairing and matching and   //
+// the matching efficiency relative to the full combinations are reported     //
+//                                                                            //
+// 10/18/2026                                                                 //
+//============================================================================//
+
+#include "PRadDSTParser.h"
+#include "PRadInfoCenter.h"
+#include "PRadBenchMark.h"
+#include "PRadHyCalSystem.h"
+#include "PRadGEMSystem.h"
+#include "PRadGEMCluster.h"
+#include "PRadCoordSystem.h"
+#include "PRadDetMatch.h"
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#define PROGRESS_COUNT 10000
+
+using namespace std;
+
+struct PairingTest
+{
+    PRadGEMCluster method;
+    vector<GEMHit> hits[2];
+    double pair_time, match_time;
+    long gem_hits, matched_hits, matched_gem;
+
+    PairingTest(const PRadGEMCluster &m)
+    : method(m), pair_time(0.), match_time(0.), gem_hits(0), matched_hits(0),
+      matched_gem(0)
+    {};
+};
+
+void print_instruction()
+{
+    cout << "usage: testGEMPairing <options> <file1> <file2> ..." << endl
+         << setw(10) << "-k : " << "number of pairs kept for each cluster in TopK mode" << endl
+         << setw(10) << "-h : " << "show options" << endl
+         << endl;
+}
+
+int main(int argc, char *argv[])
+{
+    int topk = 2;
+    vector<string> files;
+
+    char *ptr;
+    for(int i = 1; i < argc; ++i)
+    {
+        ptr = argv[i];
+        if(*(ptr++) == '-') {
+            switch(*(ptr++))
+            {
+            case 'k':
+                topk = stoi(argv[++i]);
+                break;
+            case 'h':
+            default:
+                print_instruction();
+                return 0;
+            }
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+
+    if(files.empty()) {
+        print_instruction();
+        return 0;
+    }
+
+    PRadHyCalSystem *hycal = new PRadHyCalSystem("config/hycal.conf");
+    PRadGEMSystem *gem = new PRadGEMSystem("config/gem.conf");
+    PRadCoordSystem *coord_sys = new PRadCoordSystem("database/coordinates.dat");
+    PRadDetMatch *det_match = new PRadDetMatch("config/det_match.conf");
+
+    PRadHyCalDetector *hycal_det = hycal->GetDetector();
+    PRadGEMDetector *gem_dets[2] = {gem->GetDetector("PRadGEM1"),
+                                    gem->GetDetector("PRadGEM2")};
+
+    // a copy of the GEM clustering method for each pairing mode
+    vector<PairingTest> tests;
+    for(int i = 0; i < PRadGEMCluster::Max_PairingModes; ++i)
+    {
+        tests.emplace_back(*gem->GetClusterMethod());
+        auto &method = tests.back().method;
+        method.SetConfigValue("XY Pairing", string(PRadGEMCluster::GetPairingModeName(i)));
+        method.SetConfigValue("XY Pairing Top K", topk);
+        method.Configure();
+    }
+
+    PRadDSTParser dst_parser;
+    PRadBenchMark timer;
+    int count = 0;
+
+    for(auto &file : files)
+    {
+        hycal->ChooseRun(file);
+        coord_sys->ChooseCoord(PRadInfoCenter::GetRunNumber());
+        dst_parser.OpenInput(file);
+
+        while(dst_parser.Read())
+        {
+            if(dst_parser.EventType() != PRadDSTParser::Type::event)
+                continue;
+
+            auto &event = dst_parser.GetEvent();
+            PRadInfoCenter::Instance().UpdateInfo(event);
+            if(!event.is_physics_event())
+                continue;
+
+            // strip clusters are formed once, only the pairing is tested
+            hycal->Reconstruct(event);
+            gem->Reconstruct(event);
+
+            for(auto &test : tests)
+            {
+                auto t0 = chrono::steady_clock::now();
+                for(int i = 0; i < 2; ++i)
+                {
+                    auto x_plane = gem_dets[i]->GetPlane(PRadGEMPlane::Plane_X);
+                    auto y_plane = gem_dets[i]->GetPlane(PRadGEMPlane::Plane_Y);
+                    test.method.CartesianReconstruct(x_plane->GetStripClusters(),
+                                                     y_plane->GetStripClusters(),
+                                                     test.hits[i],
+                                                     gem_dets[i]->GetDetID());
+                }
+                auto t1 = chrono::steady_clock::now();
+
+                for(int i = 0; i < 2; ++i)
+                {
+                    coord_sys->Transform(gem_dets[i]->GetDetID(),
+                                         test.hits[i].begin(), test.hits[i].end());
+                    test.gem_hits += test.hits[i].size();
+                }
+
+                // matching changes the flags of HyCal hits
+                auto hycal_hits = hycal_det->GetHits();
+                coord_sys->Transform(PRadDetector::HyCal, hycal_hits.begin(), hycal_hits.end());
+
+                auto t2 = chrono::steady_clock::now();
+                auto matched = det_match->Match(hycal_hits, test.hits[0], test.hits[1]);
+                auto t3 = chrono::steady_clock::now();
+
+                test.pair_time += chrono::duration<double, milli>(t1 - t0).count();
+                test.match_time += chrono::duration<double, milli>(t3 - t2).count();
+                test.matched_hits += matched.size();
+                for(auto &m : matched)
+                    test.matched_gem += m.gem1.size() + m.gem2.size();
+            }
+
+            if(++count%PROGRESS_COUNT == 0) {
+                cout <<"------[ ev " << count << " ]---"
+                     << "---[ " << timer.GetElapsedTimeStr() << " ]------"
+                     << "\r" << flush;
+            }
+        }
+
+        dst_parser.CloseInput();
+    }
+
+    cout << endl
+         << "GEM X/Y pairing benchmark: " << count << " events." << endl;
+
+    if(!count)
+        return 0;
+
+    const auto &ref = tests.front();
+    for(int i = 0; i < (int)tests.size(); ++i)
+    {
+        auto &test = tests[i];
+        cout << setw(10) << PRadGEMCluster::GetPairingModeName(i) << ": "
+             << (double)test.gem_hits/count << " GEM hits/ev, "
+             << test.pair_time/count << " ms/ev pairing, "
+             << test.match_time/count << " ms/ev matching"
+             << endl
+             << setw(12) << " " << test.matched_hits << " matched HyCal hits ("
+             << (ref.matched_hits ? (double)test.matched_hits/ref.matched_hits : 0.)
+             << " of all combinations), "
+             << test.matched_gem << " matched GEM hits, matching speedup "
+             << (test.match_time > 0. ? ref.match_time/test.match_time : 0.)
+             << endl;
+    }
+
+    return 0;
+}
@@ -28,6 +28,14 @@ int main(int /*argc*/, char * /*argv*/ [])
     // in memory
     dst_parser->OpenInput("/work/hallb/prad/replay/prad_001288.dst");
 
+    // only LMS and pedestal (alpha) events are needed, the other events are
+    // skipped without being parsed, and only the ADC data are read
+    uint32_t trigger_mask = 0;
+    SET_BIT(trigger_mask, LMS_Led);
+    SET_BIT(trigger_mask, LMS_Alpha);
+    dst_parser->SetTriggerMask(trigger_mask);
+    dst_parser->SetADCOnly(true);
+
     int count = 0;
     while(dst_parser->Read() && count < 20000)
     {
@@ -5,8 +5,12 @@
 #include <utility>
 #include <vector>
 #include <unordered_map>
+#include <cstdint>
 #include "ConfigParser.h"
 
+// FNV-1a offset basis, the start value of configuration hash
+#define CONFIG_HASH_SEED 2166136261u
+
 class ConfigObject
 {
 public:
@@ -38,6 +42,11 @@ public:
     const std::string &GetSpaceChars() const {return ignore_chars;};
     const std::pair<std::string, std::string> &GetReplacePair() const {return replace_pair;};
     std::vector<std::string> GetKeyList() const;
+    uint32_t GetConfigHash(uint32_t seed = CONFIG_HASH_SEED) const;
+
+    // FNV-1a hash helpers, they can be chained by using the previous hash as seed
+    static uint32_t HashData(const void *data, size_t size, uint32_t seed = CONFIG_HASH_SEED);
+    static uint32_t HashFile(const std::string &path, uint32_t seed = CONFIG_HASH_SEED);
 
     template<typename T>
     T GetConfig(const std::string &var_name)
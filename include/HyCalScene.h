@@ -90,7 +90,7 @@ public:
     void UpdateScalerBox(const QString &text, const int &group = 0);
     void UpdateScalerBox(const QStringList &texts);
     void ShowScalers(const bool &s = true) {showScalers = s;};
-    void ShowCluster(const ModuleCluster &cluster);
+    void ShowCluster(const ModuleClusters &clusters, int index);
     void ShowCluster(int index);
     template<typename... Args>
     void ModuleAction(void (HyCalModule::*act)(Args...), Args&&... args)
@@ -0,0 +1,98 @@
+#ifndef PRAD_CLUSTER_COMPARE_H
+#define PRAD_CLUSTER_COMPARE_H
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include "PRadEventStruct.h"
+#include "PRadHyCalDetector.h"
+
+#ifdef MULTI_THREAD
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+// default distance (mm) to match the hits from two methods
+#define COMPARE_MATCH_DIST 40.
+
+class PRadHyCalSystem;
+class PRadHyCalCluster;
+class TH1D;
+
+class PRadClusterCompare
+{
+public:
+    // results and statistics of one clustering method
+    struct Method
+    {
+        std::string name;
+        PRadHyCalCluster *method;
+        std::vector<ModuleHit> module_hits;
+        ModuleClusters module_clusters;
+        std::vector<HyCalHit> hits;
+        double time;            // accumulated reconstruction time (ms)
+        size_t total_hits;
+
+        Method(const std::string &n, PRadHyCalCluster *m)
+        : name(n), method(m), time(0.), total_hits(0)
+        {};
+    };
+
+    // statistics between two methods
+    struct Pair
+    {
+        size_t first;
+        size_t second;
+        size_t count_agree;     // number of events with the same hit count
+        size_t matched;
+        size_t unmatched;
+        TH1D *dx;
+        TH1D *dy;
+        TH1D *dE;
+    };
+
+public:
+    PRadClusterCompare(PRadHyCalSystem *sys, float match_dist = COMPARE_MATCH_DIST);
+    virtual ~PRadClusterCompare();
+
+    // threads and histograms are not copied
+    PRadClusterCompare(const PRadClusterCompare &that) = delete;
+    PRadClusterCompare &operator =(const PRadClusterCompare &rhs) = delete;
+
+    void Process(const EventData &event);
+    void Reset();
+    void PrintSummary(std::ostream &os) const;
+    void SaveHists(const std::string &path) const;
+    size_t GetNbofEvents() const {return events;};
+    const std::vector<Method> &GetMethods() const {return methods;};
+    const std::vector<Pair> &GetPairs() const {return pairs;};
+
+private:
+    void reconstruct(Method &m);
+    void compare(Pair &p);
+#ifdef MULTI_THREAD
+    void workerLoop(size_t idx);
+#endif
+
+private:
+    PRadHyCalSystem *hycal_sys;
+    float match_dist;
+    size_t events;
+    std::vector<ModuleHit> event_hits;
+    std::vector<Method> methods;
+    std::vector<Pair> pairs;
+
+#ifdef MULTI_THREAD
+    // every method has its own thread
+    std::vector<std::thread> workers;
+    std::mutex locker;
+    std::condition_variable start_cond;
+    std::condition_variable done_cond;
+    unsigned int generation;
+    unsigned int pending;
+    bool stop;
+#endif
+};
+
+#endif
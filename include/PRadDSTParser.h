@@ -12,6 +12,7 @@ class PRadDataHandler;
 class PRadEPICSystem;
 class PRadHyCalSystem;
 class PRadGEMSystem;
+class PRadDetMatch;
 
 class PRadDSTParser
 {
@@ -34,6 +35,7 @@ public:
         run_info,
         hycal_info,
         gem_info,
+        recon_event,
         undefined,
     };
 
@@ -74,10 +76,18 @@ public:
     void SetMode(uint32_t bit_word) {mode = bit_word;};
     void EnableMode(Mode m) {SET_BIT(mode, static_cast<uint32_t>(m));};
     void DisableMode(Mode m) {CLEAR_BIT(mode, static_cast<uint32_t>(m));};
+    // bit i for PRadTriggerType i, events with other triggers are skipped by
+    // Read() without parsing, 0 means no selection
+    void SetTriggerMask(uint32_t mask) {trigger_mask = mask;};
+    uint32_t GetTriggerMask() const {return trigger_mask;};
+    // only read the ADC data of events
+    void SetADCOnly(bool val) {adc_only = val;};
+    bool IsADCOnly() const {return adc_only;};
     bool Read();
     Type EventType() const {return ev_type;};
     const EventData &GetEvent() const {return event;};
     const EpicsData &GetEPICSEvent() const {return epics_event;};
+    const ReconEventData &GetReconEvent() const {return recon_event;};
 
     // write information
     void WriteRunInfo() throw(PRadException);
@@ -88,6 +98,13 @@ public:
     void WriteEPICSMap(const PRadEPICSystem *epics) throw(PRadException);
     void WriteHyCalInfo(const PRadHyCalSystem *hycal) throw(PRadException);
     void WriteGEMInfo(const PRadGEMSystem *gem) throw(PRadException);
+    void WriteReconEvent() throw(PRadException);
+    void WriteReconEvent(const ReconEventData &data) throw(PRadException);
+
+    // hash of the configurations that affect the reconstructed events
+    static uint32_t GetReconConfigHash(const PRadHyCalSystem *hycal,
+                                       const PRadGEMSystem *gem,
+                                       const PRadDetMatch *match);
 
 private:
     void readRunInfo() throw(PRadException);
@@ -96,10 +113,13 @@ private:
     void readEPICSMap(PRadEPICSystem *epics) throw(PRadException);
     void readHyCalInfo(PRadHyCalSystem *hycal) throw(PRadException);
     void readGEMInfo(PRadGEMSystem *gem) throw(PRadException);
+    void readReconEvent(ReconEventData &data) throw(PRadException);
+    template<class T> void writeHits(const std::vector<T> &hits);
+    template<class T> void readHits(std::vector<T> &hits);
     void writeBuffer(char *ptr, uint32_t size);
     void readBuffer(char *ptr, uint32_t size);
     void saveBuffer(std::ofstream &ofs, uint32_t htype, uint32_t info) throw(PRadException);
-    Type getBuffer(std::ifstream &ifs) throw (PRadException);
+    Type getBuffer(std::ifstream &ifs, bool &skipped) throw (PRadException);
 
 private:
     PRadDataHandler *handler;
@@ -108,6 +128,7 @@ private:
     int64_t input_length;
     EventData event;
     EpicsData epics_event;
+    ReconEventData recon_event;
     Type ev_type;
     char in_buf[DST_BUF_SIZE];
     char out_buf[DST_BUF_SIZE];
@@ -115,6 +136,8 @@ private:
     uint32_t out_idx;
     uint32_t in_bufl;
     uint32_t mode;
+    uint32_t trigger_mask;
+    bool adc_only;
     bool old_ver;
 };
 
@@ -71,7 +71,7 @@ public:
     void FeedData(const TDCV767Data &tdcData);
     void FeedData(const TDCV1190Data &tdcData);
     void FeedData(const GEMRawData &gemData);
-    void FeedData(const std::vector<GEMZeroSupData> &gemData);
+    void FeedData(const GEMZeroSupData &gemData);
     void FeedData(const EPICSRawData &epicsData);
 
 
@@ -0,0 +1,112 @@
+#ifndef PRAD_EVENT_CACHE_H
+#define PRAD_EVENT_CACHE_H
+
+#include <vector>
+#include <list>
+#include <deque>
+#include <unordered_map>
+#include "PRadEventStruct.h"
+#include "PRadHyCalDetector.h"
+#include "PRadHyCalSystem.h"
+
+#ifdef MULTI_THREAD
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#endif
+
+// default number of reconstructed events to keep
+#define EVENT_CACHE_SIZE 500
+// default number of events to prefetch on each side of the current one
+#define EVENT_CACHE_PREFETCH 5
+
+class PRadDataHandler;
+class PRadGEMSystem;
+
+class PRadEventCache
+{
+public:
+    // reconstruction results of an event, before coordinates transform
+    // the GEM hits are cached here, while the HyCal results are from the
+    // cache of HyCal system, which follows the pedestal and gain changes
+    struct Entry
+    {
+        int index;
+        unsigned int version;
+        ModuleClusters module_clusters;
+        std::vector<HyCalHit> hycal_hits;
+        std::vector<GEMHit> gem1_hits;
+        std::vector<GEMHit> gem2_hits;
+
+        Entry() : index(-1), version(0) {};
+    };
+
+public:
+    PRadEventCache(PRadDataHandler *h,
+                   PRadHyCalSystem *hycal,
+                   PRadGEMSystem *gem,
+                   size_t capacity = EVENT_CACHE_SIZE,
+                   unsigned int prefetch = EVENT_CACHE_PREFETCH);
+    virtual ~PRadEventCache();
+
+    // threads and systems are not copied
+    PRadEventCache(const PRadEventCache &that) = delete;
+    PRadEventCache &operator =(const PRadEventCache &rhs) = delete;
+
+    void Reconstruct(int index, Entry &entry);
+    void Prefetch(int index);
+    void Stop();
+    void Clear();
+    void UpdateVersion();
+    void SetCapacity(size_t c);
+    void SetPrefetch(unsigned int p) {prefetch = p;};
+    size_t GetCapacity() const {return capacity;};
+    unsigned int GetPrefetch() const {return prefetch;};
+    unsigned int GetVersion() const {return version;};
+
+private:
+    void reconGEM(const EventData &event, PRadGEMSystem *gem, Entry &entry) const;
+    bool fromCache(int index, Entry &entry);
+    void saveCache(const Entry &entry);
+#ifdef MULTI_THREAD
+    void addHyCalCache();
+    void workerLoop();
+#endif
+
+private:
+    PRadDataHandler *handler;
+    PRadHyCalSystem *hycal_sys;
+    PRadGEMSystem *gem_sys;
+    size_t capacity;
+    unsigned int prefetch;
+    unsigned int version;
+
+    // the most recently used entry is at the front
+    std::list<Entry> entries;
+    std::unordered_map<int, std::list<Entry>::iterator> entry_map;
+
+#ifdef MULTI_THREAD
+    struct Task
+    {
+        int index;
+        bool hycal;
+        bool gem;
+    };
+
+    // the worker reconstructs the queued events with its own copy of the GEM
+    // system, the GEM reconstruction changes the data in APVs and planes
+    // the HyCal results are added to the cache of HyCal system by the main
+    // thread, since HyCal system is not locked
+    std::thread worker;
+    std::mutex locker;
+    std::condition_variable queue_cond;
+    std::condition_variable idle_cond;
+    std::deque<Task> queue;
+    std::deque<std::pair<int, ReconCache>> hycal_results;
+    PRadGEMSystem *worker_gem;
+    bool busy;
+    bool stop;
+#endif
+};
+
+#endif
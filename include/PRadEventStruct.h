@@ -532,4 +532,54 @@ public:
 // *END* CLUSTER STRUCTURE                                                    //
 //============================================================================//
 
+//============================================================================//
+// *BEGIN* RECONSTRUCTED EVENT STRUCTURE                                      //
+//============================================================================//
+
+// reconstructed event for the level-2 DST
+// hits are in the lab frame after coordinates transform, matched hits are not
+// projected
+struct ReconEventData
+{
+    // event info
+    int event_number;
+    unsigned char type;
+    unsigned char trigger;
+    uint64_t timestamp;
+    uint32_t config_hash;   // hash of the reconstruction configurations
+
+    // reconstructed hits
+    std::vector<HyCalHit> hycal_hits;
+    std::vector<GEMHit> gem1_hits;
+    std::vector<GEMHit> gem2_hits;
+    std::vector<MatchHit> matched;
+
+    // constructors
+    ReconEventData()
+    : event_number(0), type(0), trigger(0), timestamp(0), config_hash(0)
+    {};
+
+    ReconEventData(const EventData &ev, uint32_t hash)
+    : event_number(ev.event_number), type(ev.type), trigger(ev.trigger),
+      timestamp(ev.timestamp), config_hash(hash)
+    {};
+
+    void clear()
+    {
+        event_number = 0;
+        type = 0;
+        trigger = 0;
+        timestamp = 0;
+        config_hash = 0;
+        hycal_hits.clear();
+        gem1_hits.clear();
+        gem2_hits.clear();
+        matched.clear();
+    };
+};
+
+//============================================================================//
+// *END* RECONSTRUCTED EVENT STRUCTURE                                        //
+//============================================================================//
+
 #endif
@@ -23,8 +23,10 @@ class PRadHyCalSystem;
 class PRadGEMSystem;
 class PRadCoordSystem;
 class PRadDetMatch;
+struct EventData;
 
 #ifdef RECON_DISPLAY
+#include "PRadEventCache.h"
 class ReconSettingPanel;
 #endif
 
@@ -139,6 +141,8 @@ private:
     void createStatusWindow();
     void setupInfoWindow();
     void updateEventRange();
+    void resetEventCache(bool new_data = false);
+    void stopEventCache();
     void readEventFromFile(const QString &filepath);
     void readCustomValue(const QString &filepath);
     void onlineUpdate(const size_t &max_events);
@@ -247,7 +251,7 @@ private:
 
 #ifdef RECON_DISPLAY
 private slots:
-    void showReconEvent();
+    void showReconEvent(int index);
     void setupReconMethods();
     void enableReconstruct();
 private:
@@ -255,6 +259,8 @@ private:
 
     PRadCoordSystem *coordSystem;
     PRadDetMatch *detMatch;
+    PRadEventCache *eventCache;
+    PRadEventCache::Entry reconEvent;
     ReconSettingPanel *reconSetting;
     QSpinBox *clusterSpin;
 #endif
@@ -22,11 +22,23 @@ public:
     void SetHandler(PRadDataHandler *h) {myHandler = h;};
     void SetEventNumber(const unsigned int &ev) {event_number = ev;};
     unsigned int GetEventNumber() const {return event_number;};
+    // bit i for PRadTriggerType i, physics events with other triggers are
+    // skipped without parsing, 0 means no selection
+    void SetTriggerMask(const uint32_t &mask) {trigger_mask = mask;};
+    uint32_t GetTriggerMask() const {return trigger_mask;};
+    // only parse the trigger information and the HyCal ADC data
+    void SetADCOnly(bool val) {adc_only = val;};
+    bool IsADCOnly() const {return adc_only;};
+    // bit i for PRadTriggerType i, only the trigger information and the HyCal
+    // ADC data are parsed for the events with these triggers
+    void SetADCOnlyMask(const uint32_t &mask) {adc_only_mask = mask;};
+    uint32_t GetADCOnlyMask() const {return adc_only_mask;};
 
 public:
     // static functions
     static PRadTriggerType bit_to_trigger(const unsigned int &bit);
     static unsigned int trigger_to_bit(const PRadTriggerType &trg);
+    static PRadTriggerType peek_trigger(const PRadEventHeader *evt_header);
 
 private:
     // private member functions
@@ -37,16 +49,21 @@ private:
     void parseADC1881M(const uint32_t *data);
     void parseGEMData(const uint32_t *data, const uint32_t &size, const int &fec_id);
     void parseGEMZeroSupData(const uint32_t *data, const uint32_t &size);
+    void splitGEMFrames(const uint32_t *data, const uint32_t &size);
     void parseTDCV767(const uint32_t *data, const uint32_t &size, const int &roc_id);
     void parseTDCV1190(const uint32_t *data, const uint32_t &size, const int &roc_id);
     void parseDSCData(const uint32_t *data, const uint32_t &size);
     void parseTIData(const uint32_t *data, const uint32_t &size, const int &roc_id);
     void parseEPICS(const uint32_t *data);
-    uint32_t getAPVDataSize(const uint32_t *data);
 
 private:
     PRadDataHandler *myHandler;
     unsigned int event_number;
+    uint32_t trigger_mask;
+    uint32_t adc_only_mask;
+    bool adc_only;
+    // adc only for the event being parsed
+    bool event_adc_only;
 };
 
 #endif
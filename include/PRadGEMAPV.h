@@ -4,6 +4,7 @@
 #include <vector>
 #include <fstream>
 #include <iostream>
+#include <cstdint>
 #include "PRadEventStruct.h"
 #include "datastruct.h"
 
@@ -17,6 +18,11 @@
 // this depends on the configuration in the readout list
 #define APV_EXTEND_SIZE 130
 
+// number of samples to seed the pedestal estimator
+#define PED_SEED_SIZE 32
+// samples beyond this level of sigma are rejected by the pedestal estimator
+#define PED_REJECT_LEVEL 5.
+
 
 class PRadGEMFEC;
 class PRadGEMPlane;
@@ -39,6 +45,55 @@ public:
         {};
     };
 
+    // online estimator for pedestal offset and noise level
+    // the first samples are kept to get a robust seed from median, then the
+    // mean and variance are updated by Welford's method, and the samples far
+    // away from the mean (mostly signals) are rejected
+    struct PedestalStat
+    {
+        uint32_t count;
+        uint32_t rejected;
+        double mean;
+        double m2;
+        uint32_t seed_size;
+        float seed[PED_SEED_SIZE];
+
+        PedestalStat() : count(0), rejected(0), mean(0.), m2(0.), seed_size(0)
+        {};
+
+        void Fill(const float &val)
+        {
+            if(seed_size < PED_SEED_SIZE) {
+                seed[seed_size++] = val;
+                if(seed_size == PED_SEED_SIZE)
+                    seedStat();
+                return;
+            }
+
+            double delta = val - mean;
+            double var = Variance();
+            if(var > 0. && delta*delta > PED_REJECT_LEVEL*PED_REJECT_LEVEL*var) {
+                ++rejected;
+                return;
+            }
+
+            ++count;
+            mean += delta/count;
+            m2 += delta*(val - mean);
+        };
+
+        void Clear() {count = 0; rejected = 0; mean = 0.; m2 = 0.; seed_size = 0;};
+        void Merge(const PedestalStat &that);
+        uint32_t GetEntries() const {return (seed_size < PED_SEED_SIZE) ? seed_size : count;};
+        double Variance() const {return (count > 1) ? m2/(count - 1) : 0.;};
+        double Mean() const {return mean;};
+        double Sigma() const;
+
+    private:
+        void seedStat();
+        void addStat(const uint32_t &n, const double &m, const double &s2);
+    };
+
     struct StripNb
     {
         unsigned char local;
@@ -71,8 +126,11 @@ public:
     void ClearPedestal();
     void CreatePedHist();
     void ReleasePedHist();
-    void FillPedHist();
     void ResetPedHist();
+    void CreatePedStat();
+    void ReleasePedStat();
+    void ResetPedStat();
+    void FillPedestal();
     void FitPedestal();
     void FillRawData(const uint32_t *buf, const uint32_t &siz);
     void FillZeroSupData(const uint32_t &ch, const uint32_t &ts, const unsigned short &val);
@@ -83,10 +141,10 @@ public:
     void UpdatePedestal(const float &offset, const float &noise, const uint32_t &index);
     void ZeroSuppression();
     void CommonModeCorrection(float *buf, const uint32_t &size);
-    void CommonModeCorrection_Split(float *buf, const uint32_t &size);
     void CollectZeroSupHits(std::vector<GEM_Data> &hits);
     void CollectZeroSupHits();
     void ResetHitPos();
+    void ResetRawFlag() {raw_filled = false;};
     void PrintOutPedestal(std::ofstream &out);
     StripNb MapStrip(int ch);
     bool IsCrossTalkStrip(const uint32_t &strip) const;
@@ -105,11 +163,14 @@ public:
     float GetZeroSupThresLevel() const {return zerosup_thres;};
     float GetCrossTalkThresLevel() const {return crosstalk_thres;};
     uint32_t GetBufferSize() const {return buffer_size;};
+    bool HasRawData() const {return raw_filled;};
     int GetLocalStripNb(const uint32_t &ch) const;
     int GetPlaneStripNb(const uint32_t &ch) const;
     PRadGEMFEC *GetFEC() const {return fec;};
     PRadGEMPlane *GetPlane() const {return plane;};
     std::vector<TH1I *> GetHistList() const;
+    const PedestalStat *GetOffsetStat(const uint32_t &ch) const;
+    const PedestalStat *GetNoiseStat(const uint32_t &ch) const;
     std::vector<Pedestal> GetPedestalList() const;
     float GetMaxCharge(const uint32_t &ch) const;
     float GetAveragedCharge(const uint32_t &ch) const;
@@ -123,15 +184,19 @@ public:
     void SetTimeSample(const uint32_t &t);
     void SetOrientation(const int &o) {orient = o;};
     void SetHeaderLevel(const int &h) {header_level = h;};
-    void SetCommonModeThresLevel(const float &t) {common_thres = t;};
-    void SetZeroSupThresLevel(const float &t) {zerosup_thres = t;};
+    void SetCommonModeThresLevel(const float &t);
+    void SetZeroSupThresLevel(const float &t);
     void SetCrossTalkThresLevel(const float &t) {crosstalk_thres = t;};
 
 private:
     void initialize();
     void getAverage(float &ave, const float *buf, const uint32_t &set = 0);
-    uint32_t getTimeSampleStart();
     void buildStripMap();
+    void updateThresholds();
+    void updateThreshold(const uint32_t &ch);
+    bool isHit(const uint32_t &ch) const {return hit_mask[ch >> 5] & (1u << (ch & 31));};
+    void setHit(const uint32_t &ch) {hit_mask[ch >> 5] |= (1u << (ch & 31));};
+    void setDirty(const uint32_t &ch) {dirty_mask[ch >> 5] |= (1u << (ch & 31));};
 
 private:
     PRadGEMFEC *fec;
@@ -149,10 +214,28 @@ private:
     float crosstalk_thres;
     uint32_t buffer_size;
     uint32_t ts_begin;
+    bool raw_filled;
     float *raw_data;
     Pedestal pedestal[APV_CHANNEL_SIZE];
     StripNb strip_map[APV_CHANNEL_SIZE];
-    bool hit_pos[APV_CHANNEL_SIZE];
+    uint32_t hit_mask[APV_CHANNEL_SIZE/32];
+
+    // the written parts of raw data, only these are reset by ClearData
+    // raw data words before dirty_end, and the time samples of the channels in
+    // dirty_mask that are filled by zero suppressed data
+    uint32_t dirty_end;
+    uint32_t dirty_mask[APV_CHANNEL_SIZE/32];
+
+    // pedestal and thresholds in arrays for the vectorized zero suppression,
+    // they are derived from the pedestal, strip map and threshold levels
+    alignas(16) float ped_offset[APV_CHANNEL_SIZE];
+    alignas(16) float cm_thres[APV_CHANNEL_SIZE];
+    alignas(16) float zs_thres[APV_CHANNEL_SIZE];
+    // all bits set for the first 16 strips of a split APV, they have their
+    // own common mode
+    alignas(16) uint32_t cm_split[APV_CHANNEL_SIZE];
+    PedestalStat *offset_stat;
+    PedestalStat *noise_stat;
     TH1I *offset_hist[APV_CHANNEL_SIZE];
     TH1I *noise_hist[APV_CHANNEL_SIZE];
 };
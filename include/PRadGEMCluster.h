@@ -11,6 +11,18 @@ class PRadGEMDetector;
 
 class PRadGEMCluster : public ConfigObject
 {
+public:
+    // how the X and Y clusters are paired to form GEM hits
+    enum PairingMode
+    {
+        Pairing_All = 0,    // all the combinations
+        Pairing_Best,       // one-to-one assignment by the best score
+        Pairing_TopK,       // top K pairs for each cluster
+        Max_PairingModes,
+    };
+
+    static const char *GetPairingModeName(int mode);
+
 public:
     PRadGEMCluster(const std::string &c_path = "");
     virtual ~PRadGEMCluster();
@@ -18,21 +30,46 @@ public:
     // functions that to be overloaded
     void Configure(const std::string &path = "");
 
-    void FormClusters(std::vector<StripHit> &hits,
+    void FormClusters(const std::vector<StripHit> &hits,
                       std::vector<StripCluster> &clusters) const;
     void CartesianReconstruct(const std::vector<StripCluster> &x_cluster,
                               const std::vector<StripCluster> &y_cluster,
                               std::vector<GEMHit> &container,
                               int det_id) const;
+    float PairChi2(const StripCluster &xc, const StripCluster &yc) const;
+    int GetPairingMode() const {return pairing_mode;};
 
 protected:
-    void groupHits(std::vector<StripHit> &h, std::vector<StripCluster> &c) const;
-    void splitCluster(std::vector<StripCluster> &c) const;
-    bool splitCluster_sub(StripCluster &c, StripCluster &c1) const;
-    void filterCluster(std::vector<StripCluster> &c) const;
-    bool filterCrossTalk(const StripCluster &cluster,
-                         const std::vector<StripCluster> &clusters) const;
-    void reconstructCluster(std::vector<StripCluster> &c) const;
+    // a cluster during the reconstruction, it is a range of hits in a shared
+    // buffer, the hits are only copied for the output clusters
+    struct ClusterRange
+    {
+        size_t begin;
+        size_t end;
+        float position;
+        float peak_charge;
+        float total_charge;
+
+        ClusterRange(size_t b = 0, size_t e = 0)
+        : begin(b), end(e), position(0.), peak_charge(0.), total_charge(0.)
+        {};
+
+        size_t size() const {return end - begin;};
+    };
+
+    void sortHits(const std::vector<StripHit> &h, std::vector<StripHit> &buf) const;
+    void groupHits(std::vector<StripHit> &buf, size_t begin, size_t end,
+                   std::vector<ClusterRange> &c) const;
+    void splitCluster(std::vector<StripHit> &buf, std::vector<ClusterRange> &c) const;
+    bool splitCluster_sub(std::vector<StripHit> &buf, ClusterRange &c, ClusterRange &c1) const;
+    void filterCluster(const std::vector<StripHit> &buf, std::vector<ClusterRange> &c) const;
+    bool filterCrossTalk(const std::vector<StripHit> &buf,
+                         const std::vector<ClusterRange> &clusters,
+                         const size_t &idx,
+                         const std::vector<size_t> &order,
+                         const std::vector<float> &positions,
+                         const std::vector<char> &keep) const;
+    void reconstructCluster(const std::vector<StripHit> &buf, std::vector<ClusterRange> &c) const;
 
 protected:
     // parameters
@@ -41,8 +78,18 @@ protected:
     float split_cluster_diff;
     float cross_talk_width;
 
+    // X/Y pairing
+    int pairing_mode;
+    unsigned int pairing_topk;
+    float pairing_ratio;
+    float pairing_charge_sigma;
+    float pairing_peak_sigma;
+    float pairing_max_chi2;
+
     // cross talk characteristic distances
     std::vector<double> charac_distance;
+    // merged ranges of (distance - width, distance + width)
+    std::vector<std::pair<double, double>> cross_talk_windows;
 };
 
 #endif
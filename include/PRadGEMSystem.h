@@ -12,12 +12,19 @@
 #include "PRadGEMFEC.h"
 #include "PRadGEMCluster.h"
 #include "ConfigObject.h"
-#include <mutex>
 
+#ifdef MULTI_THREAD
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#endif
 
 // fec id should be consecutive from 0
 // enlarge this value if there are more FECs
 #define MAX_FEC_ID 12
+// maximum number of threads to process the APVs in an event
+#define MAX_APV_WORKERS 8
 
 class PRadGEMSystem : public ConfigObject
 {
@@ -53,22 +60,23 @@ public:
     int GetStripCrossTalkFlag(const GEM_Data &p, const GEM_Data &c, const GEM_Data &n);
     void RebuildDetectorMap();
     void RebuildDAQMap();
-    void FillRawData(const GEMRawData &raw, EventData &event);
-    void FillZeroSupData(const std::vector<GEMZeroSupData> &data_pack, EventData &event);
-    void FillZeroSupData(const GEMZeroSupData &data);
+    void FillRawData(const GEMRawData &raw);
+    void ProcessRawData(EventData &event);
+    void FillZeroSupData(const GEMZeroSupData &data, EventData &event);
     bool Register(PRadGEMDetector *det);
     bool Register(PRadGEMFEC *fec);
 
     void SetUnivCommonModeThresLevel(const float &thres);
     void SetUnivZeroSupThresLevel(const float &thres);
     void SetUnivTimeSample(const uint32_t &thres);
-    void SetPedestalMode(const bool &m);
+    void SetPedestalMode(const bool &m, const bool &hist = false);
     void FitPedestal();
     void Reset();
     void SavePedestal(const std::string &path) const;
     void SaveHistograms(const std::string &path) const;
 
     PRadGEMCluster *GetClusterMethod() {return &gem_recon;};
+    const PRadGEMCluster *GetClusterMethod() const {return &gem_recon;};
     PRadGEMDetector *GetDetector(const int &id) const;
     PRadGEMDetector *GetDetector(const std::string &name) const;
     PRadGEMFEC *GetFEC(const int &id) const;
@@ -76,6 +84,7 @@ public:
     PRadGEMAPV *GetAPV(const int &fec, const int &adc) const;
 
     std::vector<GEM_Data> GetZeroSupData() const;
+    uint32_t GetCalibHash(uint32_t seed = CONFIG_HASH_SEED) const;
     std::vector<PRadGEMAPV*> GetAPVList() const;
     std::vector<PRadGEMFEC*> GetFECList() const;
     std::vector<PRadGEMDetector*> GetDetectorList() const;
@@ -86,6 +95,13 @@ private:
     void buildPlane(std::list<ConfigValue> &pln_args);
     void buildFEC(std::list<ConfigValue> &fec_args);
     void buildAPV(std::list<ConfigValue> &apv_args);
+    void initWorkers();
+    void processAPV(uint32_t idx);
+#ifdef MULTI_THREAD
+    void startWorkers();
+    void stopWorkers();
+    void workerLoop();
+#endif
 
 private:
     PRadGEMCluster gem_recon;
@@ -102,8 +118,27 @@ private:
     float def_zth;
     float def_ctth;
 
+    // APVs filled in current event and their zero suppressed hits, the jobs
+    // only write to their own slots, and the hits are joined in DAQ order
+    std::vector<PRadGEMAPV*> event_apvs;
+    std::vector<std::vector<GEM_Data>> apv_hits;
+    bool event_ped;
+
+#ifdef MULTI_THREAD
     // a locker for multi threading
     std::mutex __gem_locker;
+
+    // a pool of workers that take the APV jobs by the atomic counter, the
+    // locker is only used to wake up the workers and wait for them
+    std::vector<std::thread> workers;
+    std::mutex pool_locker;
+    std::condition_variable start_cond;
+    std::condition_variable done_cond;
+    std::atomic<uint32_t> next_job;
+    unsigned int generation;
+    unsigned int pending;
+    bool stop;
+#endif
 };
 
 #endif
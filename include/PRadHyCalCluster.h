@@ -4,6 +4,8 @@
 #include <vector>
 #include <string>
 #include <iostream>
+#include <unordered_map>
+#include <type_traits>
 #include "ConfigObject.h"
 #include "PRadEventStruct.h"
 #include "PRadHyCalDetector.h"
@@ -14,30 +16,82 @@
 
 class PRadHyCalCluster : public ConfigObject
 {
+public:
+    typedef std::unordered_map<int, std::vector<ModuleHit>> VModuleMap;
+    // reconstruct hits from clusters with the correction flags fixed at compile time
+    typedef void (PRadHyCalCluster::*Pipeline)(const PRadHyCalDetector *det,
+                                               ModuleClusters &clusters,
+                                               std::vector<HyCalHit> &hits,
+                                               const EventData *event) const;
+
 public:
     virtual ~PRadHyCalCluster();
     virtual PRadHyCalCluster *Clone();
     virtual void Configure(const std::string &path);
     virtual void FormCluster(std::vector<ModuleHit> &hits,
-                             std::vector<ModuleCluster> &clusters) const;
+                             ModuleClusters &clusters) const;
     virtual bool CheckCluster(const ModuleCluster &hit) const;
-    virtual void LeakCorr(ModuleCluster &cluster, const std::vector<ModuleHit> &dead) const;
+    virtual void LeakCorr(ModuleCluster &cluster,
+                          ModuleHitArray &hits,
+                          const std::vector<ModuleHit> &dead) const;
 
     void ReadVModuleList(const std::string &path);
+    void UpdateVModuleNeighbors(const std::vector<PRadHyCalModule*> &mlist);
     float GetWeight(const float &E, const float &E0) const;
     float GetShowerDepth(int module_type, const float &E) const;
-    void AddVirtHits(ModuleCluster &cluster, const std::vector<ModuleHit> &dead) const;
-    void CorrectVirtHits(ModuleCluster &cluster, float x, float y) const;
+    void AddVirtHits(ModuleCluster &cluster,
+                     ModuleHitArray &hits,
+                     const std::vector<ModuleHit> &dead) const;
+    void CorrectVirtHits(ModuleCluster &cluster, ModuleHitArray &hits, float x, float y) const;
 
-    HyCalHit Reconstruct(const ModuleCluster &cluster, const float &alpE = 1.) const;
+    HyCalHit Reconstruct(const ModuleCluster &cluster,
+                         const ModuleHitArray &hits,
+                         const float &alpE = 1.) const;
+    Pipeline GetPipeline() const {return pipeline;};
 
 protected:
     PRadHyCalCluster();
-    int fillHits(BaseHit *temp,
-                 int max_hits,
-                 const ModuleHit &center,
-                 const std::vector<ModuleHit> &hits) const;
-    void reconstructPos(BaseHit *temp, int count, BaseHit *recon) const;
+    static Pipeline getPipeline(bool leak, bool depth, bool linear);
+    // the methods call it in Configure to use the specialized pipeline, the
+    // ones overriding the stages will stay with the virtual path
+    template<class T>
+    void selectPipeline()
+    {
+        typedef bool (PRadHyCalCluster::*CheckFunc)(const ModuleCluster &) const;
+        typedef void (PRadHyCalCluster::*LeakFunc)(ModuleCluster &,
+                                                   ModuleHitArray &,
+                                                   const std::vector<ModuleHit> &) const;
+
+        if(use_pipeline &&
+           std::is_same<decltype(&T::CheckCluster), CheckFunc>::value &&
+           std::is_same<decltype(&T::LeakCorr), LeakFunc>::value)
+            pipeline = getPipeline(leak_corr, depth_corr, linear_corr);
+        else
+            pipeline = nullptr;
+    }
+
+    int fillHits(const ModuleHit &center,
+                 const ModuleCluster &cluster,
+                 const ModuleHitArray &hits) const;
+    void reconstructPos(BaseHit *recon) const;
+    const std::vector<ModuleHit> &getVModuleNeighbors(const ModuleHit &center,
+                                                      const std::vector<ModuleHit> &vlist,
+                                                      const VModuleMap &neighbors) const;
+
+private:
+    template<bool LEAK, bool DEPTH, bool LINEAR>
+    void reconstructClusters(const PRadHyCalDetector *det,
+                             ModuleClusters &clusters,
+                             std::vector<HyCalHit> &hits,
+                             const EventData *event) const;
+    template<bool DEPTH, bool LINEAR>
+    HyCalHit reconstruct(const ModuleCluster &cluster,
+                         const ModuleHitArray &hits,
+                         const float &alpE) const;
+    void leakCorr(ModuleCluster &cluster,
+                  ModuleHitArray &hits,
+                  const std::vector<ModuleHit> &dead) const;
+    float showerDepth(int module_type, const float &E) const;
 
 protected:
     bool depth_corr;
@@ -50,8 +104,13 @@ protected:
     float linear_corr_limit;
     unsigned int min_cluster_size;
     unsigned int leak_iters;
+    bool use_pipeline;
     std::vector<ModuleHit> inner_virtual;
     std::vector<ModuleHit> outer_virtual;
+    // virtual modules within profile reach for each module, key is module id
+    VModuleMap inner_neighbors;
+    VModuleMap outer_neighbors;
+    Pipeline pipeline;
 };
 
 #endif
@@ -15,12 +15,298 @@
 #define CORNER_ADJACENT 1.5
 // value to judge if two modules are sharing a side line
 #define SIDE_ADJACENT 1.3
+// value to judge if a module is within the reach of cluster profile, the profile
+// covers 5 module sizes and the reconstructed position may move 1 module away
+// from the center during leakage correction
+#define PROFILE_REACH 6.0
 
 class PRadHyCalSystem;
 class PRadHyCalCluster;
-// these two structure will be used for cluster reconstruction, defined at the end
-struct ModuleHit;
-struct ModuleCluster;
+
+// a uniform grid to find modules by position, the cell size is the smallest
+// module size, so each cell only overlaps with a few modules
+struct ModuleGrid
+{
+    float x_min, y_min;
+    float step_x, step_y;
+    int nx, ny;
+    std::vector<std::vector<PRadHyCalModule*>> cells;
+
+    ModuleGrid()
+    : x_min(0.), y_min(0.), step_x(1.), step_y(1.), nx(0), ny(0)
+    {};
+
+    bool empty() const {return cells.empty();};
+    const std::vector<PRadHyCalModule*> *get_cell(const float &x, const float &y)
+    const
+    {
+        int ix = int((x - x_min)/step_x), iy = int((y - y_min)/step_y);
+        if(x < x_min || y < y_min || ix >= nx || iy >= ny)
+            return nullptr;
+        return &cells[iy*nx + ix];
+    }
+};
+
+// a module within the profile reach of another one
+struct ModuleLink
+{
+    PRadHyCalModule *module;
+    bool adjacent;                  // connected at a side or a corner
+
+    ModuleLink(PRadHyCalModule *m, bool a) : module(m), adjacent(a) {};
+};
+
+// the geometry is not copied into the hit, it refers to the module's geometry
+// (or a virtual module's), so the hit is small to copy around in clustering
+struct ModuleHit
+{
+    int id;                                 // module id
+    unsigned int flag;                      // module flag
+    int sector;                             // hycal sector
+    const PRadHyCalModule::Geometry *geo;   // geometry, shared with the module
+    float energy;                           // participated energy, may be splitted
+    bool real;                              // false for virtual hit to correct leakage
+
+    ModuleHit(bool r = true)
+    : id(0), flag(0), sector(0), geo(nullptr), energy(0), real(r)
+    {};
+
+    ModuleHit(PRadHyCalModule *m, float e, bool r = true)
+    : energy(e), real(r)
+    {
+        id = m->GetID();
+        flag = m->GetLayoutFlag();
+        sector = m->GetSectorID();
+        geo = &m->GetGeometry();
+    };
+
+    bool operator ==(const ModuleHit &rhs) const {return id == rhs.id;};
+};
+
+// a cluster refers to its hits by an index span [begin, end) in the hit arrays
+// of the ModuleClusters it belongs to
+struct ModuleCluster
+{
+    ModuleHit center;               // center hit
+    unsigned int begin;             // index of the first hit
+    unsigned int end;               // index after the last hit
+    float energy;                   // cluster energy
+    float leakage;                  // energy leakage
+
+    ModuleCluster()
+    : begin(0), end(0), energy(0), leakage(0)
+    {};
+
+    ModuleCluster(const ModuleHit &hit, unsigned int pos = 0)
+    : center(hit), begin(pos), end(pos), energy(0), leakage(0)
+    {};
+
+    unsigned int size() const {return end - begin;};
+    bool empty() const {return end == begin;};
+};
+
+// hits stored as parallel arrays, the position and size are copied from the
+// geometry, so the distance and weight loops over a cluster's span run on
+// contiguous floats and can be vectorized by compiler
+struct ModuleHitArray
+{
+    std::vector<int> id;
+    std::vector<unsigned int> flag;
+    std::vector<int> sector;
+    std::vector<const PRadHyCalModule::Geometry*> geo;
+    std::vector<float> x, y, size_x, size_y;
+    std::vector<float> energy;
+    std::vector<char> real;
+
+    size_t size() const {return id.size();};
+    bool empty() const {return id.empty();};
+
+    void clear()
+    {
+        id.clear(); flag.clear(); sector.clear(); geo.clear();
+        x.clear(); y.clear(); size_x.clear(); size_y.clear();
+        energy.clear(); real.clear();
+    }
+
+    void reserve(size_t n)
+    {
+        id.reserve(n); flag.reserve(n); sector.reserve(n); geo.reserve(n);
+        x.reserve(n); y.reserve(n); size_x.reserve(n); size_y.reserve(n);
+        energy.reserve(n); real.reserve(n);
+    }
+
+    void resize(size_t n)
+    {
+        id.resize(n); flag.resize(n); sector.resize(n); geo.resize(n);
+        x.resize(n); y.resize(n); size_x.resize(n); size_y.resize(n);
+        energy.resize(n); real.resize(n);
+    }
+
+    void set(size_t i, const ModuleHit &hit)
+    {
+        id[i] = hit.id;
+        flag[i] = hit.flag;
+        sector[i] = hit.sector;
+        geo[i] = hit.geo;
+        x[i] = hit.geo->x;
+        y[i] = hit.geo->y;
+        size_x[i] = hit.geo->size_x;
+        size_y[i] = hit.geo->size_y;
+        energy[i] = hit.energy;
+        real[i] = hit.real;
+    }
+
+    void push_back(const ModuleHit &hit)
+    {
+        resize(size() + 1);
+        set(size() - 1, hit);
+    }
+
+    // copy hit i to position j
+    void copy(size_t j, size_t i)
+    {
+        id[j] = id[i]; flag[j] = flag[i]; sector[j] = sector[i]; geo[j] = geo[i];
+        x[j] = x[i]; y[j] = y[i]; size_x[j] = size_x[i]; size_y[j] = size_y[i];
+        energy[j] = energy[i]; real[j] = real[i];
+    }
+
+    ModuleHit get(size_t i) const
+    {
+        ModuleHit hit(real[i] != 0);
+        hit.id = id[i];
+        hit.flag = flag[i];
+        hit.sector = sector[i];
+        hit.geo = geo[i];
+        hit.energy = energy[i];
+        return hit;
+    }
+
+    // add a hit to the cluster, the span is moved to the end of arrays first
+    // if it is not the last one, the old span is left unused
+    void AddHit(ModuleCluster &cluster, const ModuleHit &hit)
+    {
+        moveToEnd(cluster, 1);
+        push_back(hit);
+        cluster.end++;
+        cluster.energy += hit.energy;
+    }
+
+    void Merge(ModuleCluster &cluster, const ModuleCluster &that)
+    {
+        moveToEnd(cluster, that.size());
+        size_t pos = size();
+        resize(pos + that.size());
+        for(unsigned int i = that.begin; i < that.end; ++i)
+            copy(pos++, i);
+        cluster.end += that.size();
+
+        cluster.energy += that.energy;
+        cluster.leakage += that.leakage;
+
+        if(cluster.center.energy < that.center.energy)
+            cluster.center = that.center;
+    }
+
+    // remove hit i from the cluster, the order of the other hits is kept
+    void RemoveHit(ModuleCluster &cluster, unsigned int i)
+    {
+        for(unsigned int j = i + 1; j < cluster.end; ++j)
+            copy(j - 1, j);
+        cluster.end--;
+    }
+
+    void FindCenter(ModuleCluster &cluster) const
+    {
+        float max_e = cluster.center.energy;
+        size_t imax = cluster.end;
+        for(unsigned int i = cluster.begin; i < cluster.end; ++i)
+        {
+            if(energy[i] > max_e) {
+                max_e = energy[i];
+                imax = i;
+            }
+        }
+
+        if(imax < cluster.end)
+            cluster.center = get(imax);
+    }
+
+private:
+    void moveToEnd(ModuleCluster &cluster, size_t extra)
+    {
+        if(cluster.end == size())
+            return;
+
+        size_t pos = size();
+        reserve(pos + cluster.size() + extra);
+        resize(pos + cluster.size());
+        for(unsigned int i = cluster.begin; i < cluster.end; ++i)
+            copy(pos + i - cluster.begin, i);
+        cluster.begin = pos;
+        cluster.end = size();
+    }
+};
+
+// clusters of an event, the hits of all clusters are kept in the same arrays
+struct ModuleClusters
+{
+    std::vector<ModuleCluster> clusters;
+    ModuleHitArray hits;
+
+    size_t size() const {return clusters.size();};
+    bool empty() const {return clusters.empty();};
+    ModuleCluster &operator [](size_t i) {return clusters[i];};
+    const ModuleCluster &operator [](size_t i) const {return clusters[i];};
+    ModuleCluster &at(size_t i) {return clusters.at(i);};
+    const ModuleCluster &at(size_t i) const {return clusters.at(i);};
+    ModuleCluster &back() {return clusters.back();};
+    std::vector<ModuleCluster>::iterator begin() {return clusters.begin();};
+    std::vector<ModuleCluster>::iterator end() {return clusters.end();};
+    std::vector<ModuleCluster>::const_iterator begin() const {return clusters.begin();};
+    std::vector<ModuleCluster>::const_iterator end() const {return clusters.end();};
+
+    void clear()
+    {
+        clusters.clear();
+        hits.clear();
+    }
+
+    // new cluster with an empty span at the end of arrays
+    ModuleCluster &AddCluster(const ModuleHit &center)
+    {
+        clusters.emplace_back(center, hits.size());
+        return clusters.back();
+    }
+
+    void AddHit(ModuleCluster &cluster, const ModuleHit &hit) {hits.AddHit(cluster, hit);};
+    ModuleHit GetHit(unsigned int i) const {return hits.get(i);};
+
+    // build the spans from the hits assigned to the clusters in any order,
+    // owner is the cluster index of each hit, the order in a cluster is kept
+    void Pack(const std::vector<unsigned int> &owner, const std::vector<ModuleHit> &assigned)
+    {
+        for(auto &cluster : clusters)
+            cluster.end = 0;
+        for(auto &i : owner)
+            clusters[i].end++;
+
+        unsigned int pos = 0;
+        for(auto &cluster : clusters)
+        {
+            cluster.begin = pos;
+            pos += cluster.end;
+            cluster.end = cluster.begin;
+        }
+
+        hits.resize(pos);
+        for(size_t k = 0; k < owner.size(); ++k)
+        {
+            auto &cluster = clusters[owner[k]];
+            hits.set(cluster.end++, assigned[k]);
+            cluster.energy += assigned[k].energy;
+        }
+    }
+};
 
 class PRadHyCalDetector : public PRadDetector
 {
@@ -77,7 +363,13 @@ public:
 
     // hits/clusters reconstruction
     void Reconstruct(PRadHyCalCluster *method);
+    void ReconstructHits(PRadHyCalCluster *method);
+    void ReconstructHits(PRadHyCalCluster *method,
+                         ModuleClusters &clusters,
+                         std::vector<HyCalHit> &hits,
+                         const EventData *event = nullptr) const;
     void CreateDeadHits();
+    void UpdateDeadModule(PRadHyCalModule *module);
     void CollectHits();
     void ClearHits();
 
@@ -86,10 +378,21 @@ public:
     PRadHyCalModule *GetModule(const int &primex_id) const;
     PRadHyCalModule *GetModule(const std::string &module_name) const;
     PRadHyCalModule *GetModule(const float &x, const float &y) const;
+    template<class T>
+    void GetModules(const std::vector<T> &hits, std::vector<PRadHyCalModule*> &modules)
+    const
+    {
+        modules.resize(hits.size());
+        for(size_t i = 0; i < hits.size(); ++i)
+            modules[i] = GetModule(hits[i].x, hits[i].y);
+    }
     double GetEnergy() const;
     const std::vector<PRadHyCalModule*> &GetModuleList() const {return module_list;};
     const std::vector<ModuleHit> &GetModuleHits() const {return module_hits;};
-    const std::vector<ModuleCluster> &GetModuleClusters() const {return module_clusters;};
+    const std::vector<ModuleHit> &GetDeadHits() const {return dead_hits;};
+    const std::vector<ModuleHit> &GetDeadNeighbors(const int &id) const;
+    const std::vector<ModuleLink> &GetModuleReach(const int &id) const;
+    const ModuleClusters &GetModuleClusters() const {return module_clusters;};
     std::vector<HyCalHit> &GetHits() {return hycal_hits;};
     const std::vector<HyCalHit> &GetHits() const {return hycal_hits;};
 
@@ -97,101 +400,31 @@ public:
     static int get_sector_id(const char *name);
     static const char *get_sector_name(int sec);
     static float hit_distance(const ModuleHit &m1, const ModuleHit &m2);
+    static bool in_profile_reach(const ModuleHit &m1, const ModuleHit &m2);
+    static void set_hit_time(HyCalHit &hit, const PRadHyCalModule *center,
+                             const EventData *event = nullptr);
 
 protected:
     virtual void setLayout(PRadHyCalModule &module) const;
+    void buildModuleGrid();
+    void clearModuleGrid();
+    void buildModuleReach();
+    void clearModuleHits();
 
 protected:
     PRadHyCalSystem *system;
     std::vector<PRadHyCalModule*> module_list;
     std::unordered_map<int, PRadHyCalModule*> id_map;
     std::unordered_map<std::string, PRadHyCalModule*> name_map;
+    ModuleGrid module_grid;
+    // modules within profile reach for each module (itself included), sorted
+    // by id, key is module id
+    std::unordered_map<int, std::vector<ModuleLink>> module_reach;
     std::vector<ModuleHit> module_hits;
     std::vector<ModuleHit> dead_hits;
-    std::vector<ModuleCluster> module_clusters;
+    std::unordered_map<int, std::vector<ModuleHit>> dead_neighbors;
+    ModuleClusters module_clusters;
     std::vector<HyCalHit> hycal_hits;
 };
 
-struct ModuleHit
-{
-    int id;                         // module id
-    unsigned int flag;              // module flag
-    int sector;                     // hycal sector
-    PRadHyCalModule::Geometry geo;  // geometry
-    float energy;                   // participated energy, may be splitted
-    bool real;                      // false for virtual hit to correct leakage
-
-    ModuleHit(bool r = true)
-    : id(0), flag(0), sector(0), energy(0), real(r)
-    {};
-
-    ModuleHit(PRadHyCalModule *m, float e, bool r = true)
-    : energy(e), real(r)
-    {
-        id = m->GetID();
-        flag = m->GetLayoutFlag();
-        sector = m->GetSectorID();
-        geo = m->GetGeometry();
-    };
-
-    bool operator ==(const ModuleHit &rhs) const {return id == rhs.id;};
-};
-
-struct ModuleCluster
-{
-    ModuleHit center;               // center hit
-    std::vector<ModuleHit> hits;    // hits group
-    float energy;                   // cluster energy
-    float leakage;                  // energy leakage
-
-    ModuleCluster()
-    : energy(0), leakage(0)
-    {
-        hits.reserve(100);
-    }
-
-    ModuleCluster(const ModuleHit &hit)
-    : center(hit), energy(0), leakage(0)
-    {
-        hits.reserve(100);
-    }
-
-    void AddHit(const ModuleHit &hit)
-    {
-        hits.emplace_back(hit);
-        energy += hit.energy;
-    }
-
-    void Merge(const ModuleCluster &that)
-    {
-        hits.reserve(hits.size() + that.hits.size());
-        hits.insert(hits.end(), that.hits.begin(), that.hits.end());
-
-        energy += that.energy;
-        leakage += that.leakage;
-
-        if(center.energy < that.center.energy)
-            center = that.center;
-    }
-
-    void FindCenter()
-    {
-        if(hits.empty())
-            return;
-
-        float max_e = center.energy;
-        ModuleHit *cptr = nullptr;
-        for(auto &hit : hits)
-        {
-            if(hit.energy > max_e) {
-                max_e = hit.energy;
-                cptr = &hit;
-            }
-        }
-
-        if(cptr)
-            center = *cptr;
-    }
-};
-
 #endif
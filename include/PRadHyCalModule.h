@@ -89,9 +89,10 @@ public:
     void SetGeometry(const Geometry &geo) {geometry = geo;};
     void SetLayout(const Layout &lay) {layout = lay;};
     void SetLayoutFlag(unsigned int &flag) {layout.flag = flag;};
-    void SetCalibConst(const PRadCalibConst &c) {cal_const = c;};
+    void SetCalibConst(const PRadCalibConst &c);
     void SetTriggerEfficiency(const double &eff) {trigger_eff = eff;};
-    void GainCorrection(const double &g, const int &ref) {cal_const.GainCorrection(g, ref);};
+    void GainCorrection(const double &g, const int &ref);
+    void UpdateEnergyTable() const;
 
     // energy related
     double Calibration(const unsigned short &adcVal) const;
@@ -63,6 +63,28 @@ struct CalPeriod
     }
 };
 
+// maximum number of events in the reconstruction cache
+#define RECON_CACHE_SIZE 20000
+// maximum number of gain versions kept for rescaling the cache
+#define RECON_GAIN_HISTORY 16
+
+// cached reconstruction of an event
+// the version stamps tell which inputs the results were made with
+struct ReconCache
+{
+    PRadHyCalCluster *method;
+    size_t adc_hash;
+    unsigned int ped_version;
+    unsigned int gain_version;
+    unsigned int recon_version;
+    std::vector<ModuleHit> module_hits;
+    // clusters from grouping, before the corrections in hits reconstruction
+    ModuleClusters module_clusters;
+    // clusters after hits reconstruction
+    ModuleClusters recon_clusters;
+    std::vector<HyCalHit> hycal_hits;
+};
+
 class TH1D;
 
 class PRadHyCalSystem : public ConfigObject
@@ -99,8 +121,18 @@ public:
     void ChooseEvent(const EventData &data);
     void Reconstruct();
     void Reconstruct(const EventData &data);
+    void CollectHits(const EventData &data, std::vector<ModuleHit> &hits) const;
     void Reset();
 
+    // reconstruction cache
+    void SetReconCache(bool enable);
+    void ClearReconCache();
+    void UpdateReconVersion() {++recon_version;};
+    bool IsReconCacheEnabled() const {return use_cache;};
+    bool IsReconCached(const EventData &event) const;
+    void ReconstructCache(const EventData &event, ReconCache &cache) const;
+    void AddReconCache(const EventData &event, ReconCache &&cache);
+
     // detector related
     void SetDetector(PRadHyCalDetector *h);
     void RemoveDetector();
@@ -116,6 +148,8 @@ public:
     bool AddTDCChannel(PRadTDCChannel *tdc);
     void ClearADCChannel();
     void ClearTDCChannel();
+    void SetDeadChannel(PRadADCChannel *adc, bool dead);
+    void SetDeadChannels(const std::vector<PRadADCChannel*> &adcs, bool dead);
     PRadADCChannel *GetADCChannel(const int &id) const;
     PRadADCChannel *GetADCChannel(const std::string &name) const;
     PRadADCChannel *GetADCChannel(const ChannelAddress &addr) const;
@@ -125,6 +159,9 @@ public:
     const std::vector<PRadADCChannel*> &GetADCList() const {return adc_list;};
     const std::vector<PRadTDCChannel*> &GetTDCList() const {return tdc_list;};
     void Sparsify(const EventData &event);
+    void UpdateEnergyTable();
+    void UpdateEnergyTable(const PRadADCChannel *adc);
+    uint32_t GetCalibHash(uint32_t seed = CONFIG_HASH_SEED) const;
 
     // clustering method related
     bool AddClusterMethod(const std::string &name, PRadHyCalCluster *c);
@@ -172,6 +209,29 @@ private:
 
     // clustering method map
     std::unordered_map<std::string, PRadHyCalCluster*> recon_map;
+
+    // fused pedestal and gain arrays indexed by adc channel id, they are
+    // rebuilt by UpdateEnergyTable() once pedestal or calibration changes, and
+    // a single channel is updated by the module or adc channel setters
+    std::vector<double> ch_ped;
+    std::vector<double> ch_gain;
+
+    // reconstruction cache with version stamps, keyed by event number
+    bool use_cache;
+    unsigned int ped_version;
+    unsigned int gain_version;
+    unsigned int recon_version;
+    std::unordered_map<int, ReconCache> recon_cache;
+    std::unordered_map<unsigned int, std::vector<double>> gain_history;
+
+private:
+    bool reconFromCache(const EventData &event);
+    bool checkCache(const ReconCache &cache, const EventData &event) const;
+    void rescaleCache(ReconCache &cache) const;
+    bool setDeadChannel(PRadADCChannel *adc, bool dead);
+    ReconCache &newCache(const EventData &event);
+    void saveGains();
+    void newGainVersion();
 };
 
 #endif
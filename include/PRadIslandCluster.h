@@ -15,7 +15,7 @@ public:
 
     void Configure(const std::string &path);
     void FormCluster(std::vector<ModuleHit> &hits,
-                     std::vector<ModuleCluster> &clusters) const;
+                     ModuleClusters &clusters) const;
 
 protected:
 // primex method, do iterations for splitting
@@ -24,21 +24,21 @@ protected:
                    std::vector<std::vector<ModuleHit*>> &groups) const;
     bool fillClusters(ModuleHit &hit, std::vector<std::vector<ModuleHit*>> &groups) const;
     bool checkAdjacent(const std::vector<ModuleHit*> &g1, const std::vector<ModuleHit*> &g2) const;
-    void splitCluster(const std::vector<ModuleHit*> &grp, std::vector<ModuleCluster> &c) const;
+    void splitCluster(const std::vector<ModuleHit*> &grp, ModuleClusters &c) const;
     std::vector<ModuleHit*> findMaximums(const std::vector<ModuleHit*> &g) const;
     void splitHits(const std::vector<ModuleHit*> &maximums,
                    const std::vector<ModuleHit*> &hits,
-                   std::vector<ModuleCluster> &clusters) const;
+                   ModuleClusters &clusters) const;
     void evalFraction(const std::vector<ModuleHit*> &maximums,
                       const std::vector<ModuleHit*> &hits,
                       size_t iters) const;
 // M. Levillain and W. Xiong method, a quick but slightly rough splitting
 #else
     void groupHits(std::vector<ModuleHit> &hits,
-                   std::vector<ModuleCluster> &clusters) const;
-    bool fillClusters(ModuleHit &hit, std::vector<ModuleCluster> &clusters) const;
+                   ModuleClusters &clusters) const;
+    bool fillClusters(ModuleHit &hit, ModuleClusters &clusters) const;
     bool splitHit(ModuleHit &hit,
-                  std::vector<ModuleCluster> &clusters,
+                  ModuleClusters &clusters,
                   std::vector<unsigned int> &indices) const;
 #endif
 
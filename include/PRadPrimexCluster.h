@@ -83,11 +83,19 @@ extern "C"
     #define FA(N) hbk_common_.fa[N-1]
 }
 
+// limits of the shared buffer between the main process and the workers
+#define PRCL_MAX_HITS 2000
+#define PRCL_MAX_CLUSTERS (MSECT*50)
+#define PRCL_MAX_CLUSTER_HITS (PRCL_MAX_CLUSTERS*MAX_CC)
+
 class PRadPrimexCluster : public PRadHyCalCluster
 {
 public:
     PRadPrimexCluster(const std::string &path = "");
+    // workers are not copied
+    PRadPrimexCluster(const PRadPrimexCluster &that);
     virtual ~PRadPrimexCluster();
+    PRadPrimexCluster &operator =(const PRadPrimexCluster &rhs) = delete;
     PRadHyCalCluster *Clone() const;
 
     void Configure(const std::string &path);
@@ -95,19 +103,44 @@ public:
     void LoadLeadGlassProfile(const std::string &path);
     void UpdateModuleStatus(const std::vector<PRadHyCalModule*> &mlist);
     void FormCluster(std::vector<ModuleHit> &hits,
-                     std::vector<ModuleCluster> &clusters) const;
-    void LeakCorr(ModuleCluster &c, const std::vector<ModuleHit> &dead) const;
+                     ModuleClusters &clusters) const;
+    void LeakCorr(ModuleCluster &c,
+                  ModuleHitArray &hits,
+                  const std::vector<ModuleHit> &dead) const;
+
+    // isolated worker processes, each of them has its own copy of the fortran
+    // common blocks, so FormCluster can be called from several threads
+    bool StartWorkers();
+    bool StartWorkers(unsigned int num);
+    void StopWorkers();
+    unsigned int GetNbofWorkers() const;
 
 private:
+    struct WorkerPool;
+    void updateWorkers(char cmd, const std::string &path = "");
+    bool remoteCluster(const std::vector<ModuleHit> &hits,
+                       ModuleClusters &clusters) const;
+    void localCluster(const std::vector<ModuleHit> &hits,
+                      ModuleClusters &clusters) const;
+    void islandCluster(const std::vector<ModuleHit> &hits,
+                       ModuleClusters &clusters) const;
     void callIsland(const std::vector<ModuleHit> &hits, int isect) const;
-    std::vector<ModuleCluster> getIslandResult(const std::map<int, ModuleHit*> &hmap) const;
-    void glueClusters(std::vector<ModuleCluster> &b, std::vector<ModuleCluster> &s) const;
-    bool checkTransAdj(const ModuleCluster &c1, const ModuleCluster &c2) const;
+    void getIslandResult(const std::map<int, const ModuleHit*> &hmap,
+                         ModuleClusters &clusters) const;
+    void glueClusters(ModuleClusters &clusters,
+                      std::vector<char> &merged,
+                      size_t base_begin, size_t base_end,
+                      size_t sect_begin, size_t sect_end) const;
+    bool checkTransAdj(const ModuleCluster &c1,
+                       const ModuleCluster &c2,
+                       const ModuleHitArray &hits) const;
 
 private:
     float adj_dist;
     std::vector<float> min_module_energy;
     int module_status[MSECT][MCOL][MROW];
+    unsigned int nworkers;
+    WorkerPool *pool;
 };
 
 #endif
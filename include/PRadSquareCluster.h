@@ -12,14 +12,14 @@ public:
 
     void Configure(const std::string &path);
     void FormCluster(std::vector<ModuleHit> &hits,
-                     std::vector<ModuleCluster> &clusters) const;
+                     ModuleClusters &clusters) const;
 
 protected:
     void groupHits(std::vector<ModuleHit> &hits,
-                   std::vector<ModuleCluster> &clusters) const;
-    bool fillClusters(ModuleHit &hit, std::vector<ModuleCluster> &clusters) const;
+                   ModuleClusters &clusters) const;
+    bool fillClusters(ModuleHit &hit, ModuleClusters &clusters) const;
     bool splitHit(ModuleHit &hit,
-                  std::vector<ModuleCluster> &clusters,
+                  ModuleClusters &clusters,
                   std::vector<unsigned int> &indices) const;
     bool checkBelongs(const ModuleHit &center, const ModuleHit &hit, float factor) const;
 
@@ -6,6 +6,7 @@
 #include <algorithm>
 #include <utility>
 #include <cmath>
+#include <cstddef>
 
 namespace cana
 {
@@ -23,6 +24,9 @@ namespace cana
     double gamma(const double &z);
     double spence(const double &z, const double &res = 1e-15);
     double spence_tr(const double &z, const double &res, const int &nmax);
+    // gaussian fit to binned data, return false if it fails
+    bool gaus_fit(const double *x, const double *y, const size_t &n,
+                  double &amp, double &mean, double &sigma);
     // simpson integration
     double simpson(double begin, double end, double (*f)(const double&), double step, int Nmin);
     template<class T>
@@ -250,12 +250,11 @@ struct GEMRawData
     uint32_t size;
 };
 
+// packed words of the zero-suppressed GEM data, header word excluded
 struct GEMZeroSupData
 {
-    APVAddress addr;
-    unsigned char channel;
-    unsigned char time_sample;
-    unsigned short adc_value;
+    const uint32_t *buf;
+    uint32_t size;
 };
 
 #endif
@@ -10,6 +10,7 @@
 
 #include <iostream>
 #include <iomanip>
+#include <fstream>
 #include <algorithm>
 #include "ConfigObject.h"
 
@@ -128,6 +129,68 @@ const
     return res;
 }
 
+// a hash (FNV-1a) of all the configuration keys and values, it does not depend
+// on the order of the keys
+// if a value is the path of a file, the file contents are also in the hash, so
+// the changes in the files used by the object are seen
+// the hash of several objects can be chained by using the previous one as seed
+uint32_t ConfigObject::GetConfigHash(uint32_t seed)
+const
+{
+    std::vector<std::string> keys = GetKeyList();
+    std::sort(keys.begin(), keys.end());
+
+    // separator
+    const unsigned char sep = 0xff;
+
+    uint32_t hash = seed;
+    for(auto &key : keys)
+    {
+        const std::string &value = config_map.at(key);
+        hash = HashData(key.data(), key.size(), hash);
+        hash = HashData(&sep, sizeof(sep), hash);
+        hash = HashData(value.data(), value.size(), hash);
+        hash = HashData(&sep, sizeof(sep), hash);
+        hash = HashFile(GetConfigValue(key).String(), hash);
+    }
+
+    return hash;
+}
+
+// FNV-1a hash of a block of data
+uint32_t ConfigObject::HashData(const void *data, size_t size, uint32_t seed)
+{
+    const unsigned char *ptr = static_cast<const unsigned char*>(data);
+
+    uint32_t hash = seed;
+    for(size_t i = 0; i < size; ++i)
+    {
+        hash ^= ptr[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// FNV-1a hash of the file contents, the seed is returned if it is not a file
+// that can be read
+uint32_t ConfigObject::HashFile(const std::string &path, uint32_t seed)
+{
+    if(path.empty())
+        return seed;
+
+    std::ifstream inf(path, std::ios::in | std::ios::binary);
+    if(!inf.is_open())
+        return seed;
+
+    uint32_t hash = seed;
+    char buf[4096];
+    while(inf.read(buf, sizeof(buf)) || inf.gcount() > 0)
+        hash = HashData(buf, inf.gcount(), hash);
+
+    return hash;
+}
+
 // save current configuration into a file
 void ConfigObject::SaveConfig(const std::string &path)
 const
@@ -313,11 +313,13 @@ void HyCalScene::ShowCluster(int index)
     if((size_t)index >= module_clusters.size())
         ModuleAction(&HyCalModule::ShowEnergy);
 
-    ShowCluster(module_clusters.at(index));
+    ShowCluster(module_clusters, index);
 }
 
-void HyCalScene::ShowCluster(const ModuleCluster &cluster)
+void HyCalScene::ShowCluster(const ModuleClusters &clusters, int index)
 {
+    const auto &cluster = clusters.at(index);
+
     // erase all the modules
     for(auto module : module_list)
     {
@@ -325,11 +327,11 @@ void HyCalScene::ShowCluster(const ModuleCluster &cluster)
     }
 
     // show only the cluster info
-    for(auto hit : cluster.hits)
+    for(unsigned int i = cluster.begin; i < cluster.end; ++i)
     {
-        HyCalModule *module = (HyCalModule*)PRadHyCalDetector::GetModule(hit.id);
+        HyCalModule *module = (HyCalModule*)PRadHyCalDetector::GetModule(clusters.hits.id[i]);
         if(module)
-            module->ShowEnergy(hit.energy);
+            module->ShowEnergy(clusters.hits.energy[i]);
     }
 }
 
@@ -243,6 +243,9 @@ void PRadADCChannel::SetPedestal(const Pedestal &p)
     pedestal = p;
 
     sparsify = (unsigned short)(pedestal.mean + 5.*pedestal.sigma + 0.5); // round
+
+    if(module)
+        module->UpdateEnergyTable();
 }
 
 // set pedestal
@@ -0,0 +1,265 @@
+//============================================================================//
+// Compare the HyCal clustering methods side by side                          //
+// Every registered method reconstructs the same module hits of an event, the //
+// methods run in their own threads if MULTI_THREAD is defined                //
+// The hits from each pair of methods are matched by distance to accumulate   //
+// the count agreement and the position/energy differences                    //
+//                                                                            //
+// 10/18/2026                                                                 //
+//============================================================================//
+
+#include "PRadClusterCompare.h"
+#include "PRadHyCalSystem.h"
+#include "PRadHyCalCluster.h"
+#include "TFile.h"
+#include "TH1D.h"
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+
+
+PRadClusterCompare::PRadClusterCompare(PRadHyCalSystem *sys, float dist)
+: hycal_sys(sys), match_dist(dist), events(0)
+{
+    if(!hycal_sys)
+        return;
+
+    auto names = hycal_sys->GetClusterMethodNames();
+    std::sort(names.begin(), names.end());
+    for(auto &name : names)
+        methods.emplace_back(name, hycal_sys->GetClusterMethod(name));
+
+    for(size_t i = 0; i < methods.size(); ++i)
+    {
+        for(size_t j = i + 1; j < methods.size(); ++j)
+        {
+            Pair p;
+            p.first = i;
+            p.second = j;
+            p.count_agree = 0;
+            p.matched = 0;
+            p.unmatched = 0;
+
+            std::string tag = methods[i].name + "_" + methods[j].name;
+            p.dx = new TH1D(("dx_" + tag).c_str(), ("#Deltax (mm) " + tag).c_str(),
+                            400, -20., 20.);
+            p.dy = new TH1D(("dy_" + tag).c_str(), ("#Deltay (mm) " + tag).c_str(),
+                            400, -20., 20.);
+            p.dE = new TH1D(("dE_" + tag).c_str(), ("#DeltaE/E " + tag).c_str(),
+                            400, -0.2, 0.2);
+            pairs.push_back(p);
+        }
+    }
+
+#ifdef MULTI_THREAD
+    generation = 0;
+    pending = 0;
+    stop = false;
+    for(size_t i = 0; i < methods.size(); ++i)
+        workers.emplace_back(&PRadClusterCompare::workerLoop, this, i);
+#endif
+}
+
+PRadClusterCompare::~PRadClusterCompare()
+{
+#ifdef MULTI_THREAD
+    {
+        std::lock_guard<std::mutex> lock(locker);
+        stop = true;
+    }
+    start_cond.notify_all();
+    for(auto &worker : workers)
+        worker.join();
+#endif
+
+    for(auto &p : pairs)
+    {
+        delete p.dx;
+        delete p.dy;
+        delete p.dE;
+    }
+}
+
+// reconstruct the event with all the methods and compare their results
+void PRadClusterCompare::Process(const EventData &event)
+{
+    if(!hycal_sys || !hycal_sys->GetDetector() || !event.is_physics_event())
+        return;
+
+    hycal_sys->CollectHits(event, event_hits);
+    ++events;
+
+#ifdef MULTI_THREAD
+    {
+        std::unique_lock<std::mutex> lock(locker);
+        pending = methods.size();
+        ++generation;
+        start_cond.notify_all();
+        done_cond.wait(lock, [this] {return pending == 0;});
+    }
+#else
+    for(auto &m : methods)
+        reconstruct(m);
+#endif
+
+    for(auto &p : pairs)
+        compare(p);
+}
+
+void PRadClusterCompare::Reset()
+{
+    events = 0;
+    for(auto &m : methods)
+    {
+        m.time = 0.;
+        m.total_hits = 0;
+    }
+
+    for(auto &p : pairs)
+    {
+        p.count_agree = 0;
+        p.matched = 0;
+        p.unmatched = 0;
+        p.dx->Reset();
+        p.dy->Reset();
+        p.dE->Reset();
+    }
+}
+
+void PRadClusterCompare::PrintSummary(std::ostream &os)
+const
+{
+    os << "PRad Cluster Compare: " << events << " events." << std::endl;
+
+    for(auto &m : methods)
+    {
+        os << std::setw(10) << m.name
+           << ": " << m.total_hits << " hits, "
+           << (events ? m.time/events : 0.) << " ms/ev"
+           << std::endl;
+    }
+
+    for(auto &p : pairs)
+    {
+        os << std::setw(10) << methods[p.first].name << " vs "
+           << std::setw(10) << std::left << methods[p.second].name << std::right
+           << ": count agreement " << (events ? (double)p.count_agree/events : 0.)
+           << ", matched " << p.matched << ", unmatched " << p.unmatched
+           << std::endl
+           << std::setw(26) << "dx: " << p.dx->GetMean() << " +- " << p.dx->GetRMS()
+           << ", dy: " << p.dy->GetMean() << " +- " << p.dy->GetRMS()
+           << ", dE/E: " << p.dE->GetMean() << " +- " << p.dE->GetRMS()
+           << std::endl;
+    }
+}
+
+void PRadClusterCompare::SaveHists(const std::string &path)
+const
+{
+    TFile f(path.c_str(), "recreate");
+
+    for(auto &p : pairs)
+    {
+        p.dx->Write();
+        p.dy->Write();
+        p.dE->Write();
+    }
+
+    f.Close();
+}
+
+//============================================================================//
+// Private Member Functions                                                   //
+//============================================================================//
+
+// reconstruct current event with the method, detector is not changed
+void PRadClusterCompare::reconstruct(Method &m)
+{
+    auto t0 = std::chrono::steady_clock::now();
+
+    // clustering methods may sort the hits, so each one has its own copy
+    m.module_hits = event_hits;
+    m.method->FormCluster(m.module_hits, m.module_clusters);
+    hycal_sys->GetDetector()->ReconstructHits(m.method, m.module_clusters, m.hits);
+
+    auto t1 = std::chrono::steady_clock::now();
+    m.time += std::chrono::duration<double, std::milli>(t1 - t0).count();
+    m.total_hits += m.hits.size();
+}
+
+// match the hits from two methods by the closest distance
+void PRadClusterCompare::compare(Pair &p)
+{
+    const auto &hits1 = methods[p.first].hits;
+    const auto &hits2 = methods[p.second].hits;
+
+    if(hits1.size() == hits2.size())
+        ++p.count_agree;
+
+    std::vector<bool> used(hits2.size(), false);
+    for(auto &h1 : hits1)
+    {
+        int best = -1;
+        float best_dist = match_dist;
+        for(size_t j = 0; j < hits2.size(); ++j)
+        {
+            if(used[j])
+                continue;
+
+            float dist = std::sqrt((h1.x - hits2[j].x)*(h1.x - hits2[j].x) +
+                                   (h1.y - hits2[j].y)*(h1.y - hits2[j].y));
+            if(dist < best_dist) {
+                best_dist = dist;
+                best = j;
+            }
+        }
+
+        if(best < 0) {
+            ++p.unmatched;
+            continue;
+        }
+
+        const auto &h2 = hits2[best];
+        used[best] = true;
+        ++p.matched;
+        p.dx->Fill(h2.x - h1.x);
+        p.dy->Fill(h2.y - h1.y);
+        if(h1.E > 0.)
+            p.dE->Fill((h2.E - h1.E)/h1.E);
+    }
+
+    for(auto u : used)
+    {
+        if(!u)
+            ++p.unmatched;
+    }
+}
+
+#ifdef MULTI_THREAD
+// wait for a new event and reconstruct it with the method
+void PRadClusterCompare::workerLoop(size_t idx)
+{
+    unsigned int done = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(locker);
+            start_cond.wait(lock, [&] {return stop || generation != done;});
+            if(stop)
+                return;
+            done = generation;
+        }
+
+        reconstruct(methods[idx]);
+
+        {
+            std::lock_guard<std::mutex> lock(locker);
+            --pending;
+        }
+        done_cond.notify_one();
+    }
+}
+#endif
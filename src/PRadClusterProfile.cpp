@@ -150,15 +150,15 @@ const
 {
     int dx, dy;
     // both belong to the same part
-    if(m1.geo.type == m2.geo.type) {
-        dx = fabs(100.*(m1.geo.x - m2.geo.x)/m1.geo.size_x) + 0.5;
-        dy = fabs(100.*(m1.geo.y - m2.geo.y)/m1.geo.size_y) + 0.5;
+    if(m1.geo->type == m2.geo->type) {
+        dx = fabs(100.*(m1.geo->x - m2.geo->x)/m1.geo->size_x) + 0.5;
+        dy = fabs(100.*(m1.geo->y - m2.geo->y)/m1.geo->size_y) + 0.5;
     // belong to different part
     } else {
         // determine the line that connects the two points
         // y = kx + b
-        float k = (m2.geo.y - m1.geo.y)/(m2.geo.x - m1.geo.x);
-        float b = m1.geo.y - k*m1.geo.x;
+        float k = (m2.geo->y - m1.geo->y)/(m2.geo->x - m1.geo->x);
+        float b = m1.geo->y - k*m1.geo->x;
 
         // determine which boundary the line is crossing
         int sect = abs(m1.sector - m2.sector);
@@ -177,15 +177,15 @@ const
 
         // the dx dy will be the sum of two parts, each part quantized to the
         // module's size (Moliere radius)
-        dx =   fabs(100.*(m1.geo.x - inter_x)/m1.geo.size_x)
-             + fabs(100.*(m2.geo.x - inter_x)/m2.geo.size_x)
+        dx =   fabs(100.*(m1.geo->x - inter_x)/m1.geo->size_x)
+             + fabs(100.*(m2.geo->x - inter_x)/m2.geo->size_x)
              + 0.5;
-        dy =   fabs(100.*(m1.geo.y - inter_y)/m1.geo.size_y)
-             + fabs(100.*(m2.geo.y - inter_y)/m2.geo.size_y)
+        dy =   fabs(100.*(m1.geo->y - inter_y)/m1.geo->size_y)
+             + fabs(100.*(m2.geo->y - inter_y)/m2.geo->size_y)
              + 0.5;
     }
 
-    return GetProfile(m1.geo.type, dx, dy);
+    return GetProfile(m1.geo->type, dx, dy);
 }
 
 static float __cp_size_x[2] = {38.15, 20.77};
@@ -218,13 +218,13 @@ const
 
     int dx, dy;
     // both belong to the same part
-    if(type == hit.geo.type) {
-        dx = fabs(100.*(x - hit.geo.x)/hit.geo.size_x) + 0.5;
-        dy = fabs(100.*(y - hit.geo.y)/hit.geo.size_y) + 0.5;
+    if(type == hit.geo->type) {
+        dx = fabs(100.*(x - hit.geo->x)/hit.geo->size_x) + 0.5;
+        dy = fabs(100.*(y - hit.geo->y)/hit.geo->size_y) + 0.5;
     // belong to different part
     } else {
         // determine the line that connects the two points
-        float k = (y - hit.geo.y)/(x - hit.geo.x);
+        float k = (y - hit.geo->y)/(x - hit.geo->x);
         float b = y - k*x;
 
         // determine which boundary the line is crossing
@@ -245,18 +245,20 @@ const
         // the dx dy will be the sum of two parts, each part quantized to the
         // module's size (Moliere radius)
         dx =   fabs(100.*(x - inter_x)/__cp_size_x[type])
-             + fabs(100.*(hit.geo.x - inter_x)/hit.geo.size_x)
+             + fabs(100.*(hit.geo->x - inter_x)/hit.geo->size_x)
              + 0.5;
         dy =   fabs(100.*(y - inter_y)/__cp_size_y[type])
-             + fabs(100.*(hit.geo.y - inter_y)/hit.geo.size_y)
+             + fabs(100.*(hit.geo->y - inter_y)/hit.geo->size_y)
              + 0.5;
     }
 
-    return GetProfile(hit.geo.type, dx, dy);
+    return GetProfile(hit.geo->type, dx, dy);
 }
 
 // evaluate how well this cluster can be described by the profile
-float PRadClusterProfile::EvalEstimator(const BaseHit &h, const ModuleCluster &cl)
+float PRadClusterProfile::EvalEstimator(const BaseHit &h,
+                                        const ModuleCluster &cl,
+                                        const ModuleHitArray &hits)
 const
 {
     float est = 0.;
@@ -270,8 +272,9 @@ const
     res /= sqrt(h.E/1000.);
 
     int count = 0;
-    for(auto hit : cl.hits)
+    for(unsigned int i = cl.begin; i < cl.end; ++i)
     {
+        ModuleHit hit = hits.get(i);
         const auto &prof = GetProfile(h.x, h.y, hit);
         if(prof.frac < 0.01)
             continue;
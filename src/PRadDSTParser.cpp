@@ -12,10 +12,13 @@
 #include "PRadEPICSystem.h"
 #include "PRadHyCalSystem.h"
 #include "PRadGEMSystem.h"
+#include "PRadHyCalCluster.h"
+#include "PRadDetMatch.h"
 #include "PRadInfoCenter.h"
 
 
-#define DST_FILE_VERSION 0x20  // current version
+#define DST_FILE_VERSION 0x21  // current version, with reconstructed events
+#define DST_FILE_VERSION_PREV 0x20 // supported version, same format without reconstructed events
 #define DST_FILE_VERSION_OLD 0x13 // supported old version
 
 // helper functions
@@ -72,7 +75,7 @@ inline uint32_t __dst_buf_to_header(char *buf, uint32_t index)
 // constructor
 PRadDSTParser::PRadDSTParser(PRadDataHandler *h)
 : handler(h), input_length(0), ev_type(Type::undefined), in_idx(0), out_idx(0),
-  in_bufl(0), mode(0), old_ver(false)
+  in_bufl(0), mode(0), trigger_mask(0), adc_only(false), old_ver(false)
 {
     // place holder
 }
@@ -124,7 +127,7 @@ void PRadDSTParser::OpenInput(const std::string &path, std::ios::openmode mode)
 
     if(ver == DST_FILE_VERSION_OLD) {
         old_ver = true;
-    } else if(ver == DST_FILE_VERSION) {
+    } else if(ver == DST_FILE_VERSION || ver == DST_FILE_VERSION_PREV) {
         old_ver = false;
     } else {
         std::cerr << "DST Parser: Version mismatch between the file and library. "
@@ -220,6 +223,10 @@ throw(PRadException)
         data.add_adc(adc);
     }
 
+    // the rest of the buffer is discarded, but the old version has no buffer
+    if(adc_only && !old_ver)
+        return;
+
     readBuffer((char*) &tdc_size, sizeof(tdc_size));
     for(uint32_t i = 0; i < tdc_size; ++i)
     {
@@ -447,6 +454,9 @@ throw(PRadException)
         if(adc->GetModule() && TEST_BIT(mode, static_cast<uint32_t>(Mode::update_hycal_cal)))
             adc->GetModule()->SetCalibConst(cal);
     }
+
+    if(hycal)
+        hycal->UpdateEnergyTable();
 }
 
 void PRadDSTParser::WriteGEMInfo(const PRadGEMSystem *gem)
@@ -508,6 +518,124 @@ throw(PRadException)
     }
 }
 
+void PRadDSTParser::WriteReconEvent()
+throw(PRadException)
+{
+    try {
+        WriteReconEvent(recon_event);
+    } catch(...) {
+        throw;
+    }
+}
+
+void PRadDSTParser::WriteReconEvent(const ReconEventData &data)
+throw(PRadException)
+{
+    // event information
+    writeBuffer((char*) &data.event_number, sizeof(data.event_number));
+    writeBuffer((char*) &data.type        , sizeof(data.type));
+    writeBuffer((char*) &data.trigger     , sizeof(data.trigger));
+    writeBuffer((char*) &data.timestamp   , sizeof(data.timestamp));
+    writeBuffer((char*) &data.config_hash , sizeof(data.config_hash));
+
+    // reconstructed hits
+    writeHits(data.hycal_hits);
+    writeHits(data.gem1_hits);
+    writeHits(data.gem2_hits);
+
+    // matched hits
+    uint32_t match_size = data.matched.size();
+    writeBuffer((char*) &match_size, sizeof(match_size));
+    for(auto &hit : data.matched)
+    {
+        writeBuffer((char*) &hit.x, sizeof(hit.x));
+        writeBuffer((char*) &hit.y, sizeof(hit.y));
+        writeBuffer((char*) &hit.z, sizeof(hit.z));
+        writeBuffer((char*) &hit.E, sizeof(hit.E));
+        writeBuffer((char*) &hit.hycal, sizeof(hit.hycal));
+        writeBuffer((char*) &hit.hycal_idx, sizeof(hit.hycal_idx));
+        writeHits(hit.gem1);
+        writeHits(hit.gem2);
+    }
+
+    // save buffer to file
+    try {
+        saveBuffer(dst_out, EventHeader, static_cast<uint32_t>(Type::recon_event));
+    } catch(...) {
+        throw;
+    }
+}
+
+void PRadDSTParser::readReconEvent(ReconEventData &data)
+throw(PRadException)
+{
+    data.clear();
+
+    // event information
+    readBuffer((char*) &data.event_number, sizeof(data.event_number));
+    readBuffer((char*) &data.type        , sizeof(data.type));
+    readBuffer((char*) &data.trigger     , sizeof(data.trigger));
+    readBuffer((char*) &data.timestamp   , sizeof(data.timestamp));
+    readBuffer((char*) &data.config_hash , sizeof(data.config_hash));
+
+    // reconstructed hits
+    readHits(data.hycal_hits);
+    readHits(data.gem1_hits);
+    readHits(data.gem2_hits);
+
+    // matched hits
+    uint32_t match_size;
+    readBuffer((char*) &match_size, sizeof(match_size));
+    for(uint32_t i = 0; i < match_size; ++i)
+    {
+        BaseHit coord;
+        HyCalHit hycal;
+        readBuffer((char*) &coord.x, sizeof(coord.x));
+        readBuffer((char*) &coord.y, sizeof(coord.y));
+        readBuffer((char*) &coord.z, sizeof(coord.z));
+        readBuffer((char*) &coord.E, sizeof(coord.E));
+        readBuffer((char*) &hycal, sizeof(hycal));
+
+        data.matched.emplace_back(hycal);
+        MatchHit &hit = data.matched.back();
+        hit.SubstituteCoord(coord);
+        hit.E = coord.E;
+        readBuffer((char*) &hit.hycal_idx, sizeof(hit.hycal_idx));
+        readHits(hit.gem1);
+        readHits(hit.gem2);
+    }
+}
+
+// the configurations of HyCal, GEM, their clustering methods and the detector
+// matching are chained in the hash, including the contents of the files in the
+// configurations, and the calibration of HyCal and GEM (pedestals, calibration
+// constants and dead modules), which may be changed after configuration
+// coordinates are not included since they are chosen by run number
+uint32_t PRadDSTParser::GetReconConfigHash(const PRadHyCalSystem *hycal,
+                                           const PRadGEMSystem *gem,
+                                           const PRadDetMatch *match)
+{
+    uint32_t hash = CONFIG_HASH_SEED;
+
+    if(hycal) {
+        hash = hycal->GetConfigHash(hash);
+        hash = hycal->GetCalibHash(hash);
+        if(hycal->GetClusterMethod())
+            hash = hycal->GetClusterMethod()->GetConfigHash(hash);
+    }
+
+    if(gem) {
+        hash = gem->GetConfigHash(hash);
+        hash = gem->GetCalibHash(hash);
+        hash = gem->GetClusterMethod()->GetConfigHash(hash);
+    }
+
+    if(match)
+        hash = match->GetConfigHash(hash);
+
+    return hash;
+}
+
 //============================================================================//
 // Return type:  false. file end or error                                     //
 //               true. successfully read                                      //
@@ -515,9 +643,14 @@ throw(PRadException)
 bool PRadDSTParser::Read()
 {
     try {
-        if(dst_in.tellg() < input_length && dst_in.tellg() != -1)
+        while(dst_in.tellg() < input_length && dst_in.tellg() != -1)
         {
-            ev_type = getBuffer(dst_in);
+            bool skipped = false;
+            ev_type = getBuffer(dst_in, skipped);
+
+            // rejected by the trigger mask, go to the next buffer
+            if(skipped)
+                continue;
 
             // reset in_buf index
             in_idx = 0;
@@ -525,6 +658,9 @@ bool PRadDSTParser::Read()
             {
             case Type::event:
                 readEvent(event);
+                // old version cannot be checked before reading
+                if(trigger_mask && !TEST_BIT(trigger_mask, event.trigger))
+                    continue;
                 break;
             case Type::epics:
                 readEPICS(epics_event);
@@ -550,6 +686,9 @@ bool PRadDSTParser::Read()
                 else
                     readGEMInfo(nullptr);
                 break;
+            case Type::recon_event:
+                readReconEvent(recon_event);
+                break;
             default:
                 std::cerr << "READ DST ERROR: Undefined buffer type, incorrect "
                           << "format or corrupted file."
@@ -558,11 +697,11 @@ bool PRadDSTParser::Read()
             }
 
             return true;
-        } else {
-            // file end
-            return false;
         }
 
+        // file end
+        return false;
+
     } catch(PRadException &e) {
         std::cerr << e.FailureType() << ": " << e.FailureDesc()
                   << std::endl
@@ -634,7 +773,35 @@ throw (PRadException)
     out_idx = 0;
 }
 
-inline PRadDSTParser::Type PRadDSTParser::getBuffer(std::ifstream &ifs)
+// hits are plain data, they are saved as a whole
+template<class T>
+inline void PRadDSTParser::writeHits(const std::vector<T> &hits)
+{
+    uint32_t hit_size = hits.size();
+    writeBuffer((char*) &hit_size, sizeof(hit_size));
+    for(auto &hit : hits)
+        writeBuffer((char*) &hit, sizeof(hit));
+}
+
+template<class T>
+inline void PRadDSTParser::readHits(std::vector<T> &hits)
+{
+    hits.clear();
+
+    uint32_t hit_size;
+    readBuffer((char*) &hit_size, sizeof(hit_size));
+
+    T hit;
+    for(uint32_t i = 0; i < hit_size; ++i)
+    {
+        readBuffer((char*) &hit, sizeof(hit));
+        hits.push_back(hit);
+    }
+}
+
+// the event buffers with unselected trigger are skipped (only for the current
+// version), the trigger type is checked before reading the whole buffer
+inline PRadDSTParser::Type PRadDSTParser::getBuffer(std::ifstream &ifs, bool &skipped)
 throw (PRadException)
 {
     if(!ifs.is_open())
@@ -654,7 +821,23 @@ throw (PRadException)
             std::cout << std::hex << in_bufl << std::endl;
             throw PRadException("READ DST", "read-in buffer exceeds size limit!");
         }
-        ifs.read(in_buf, in_bufl);
+
+        if(trigger_mask && buf_type == Type::event) {
+            // event number, event type and trigger type
+            const uint32_t info_size = sizeof(event.event_number)
+                                     + sizeof(event.type)
+                                     + sizeof(event.trigger);
+            ifs.read(in_buf, info_size);
+            unsigned char trigger = in_buf[info_size - 1];
+            if(!TEST_BIT(trigger_mask, trigger)) {
+                ifs.seekg(in_bufl - info_size, ifs.cur);
+                skipped = true;
+                return buf_type;
+            }
+            ifs.read(&in_buf[info_size], in_bufl - info_size);
+        } else {
+            ifs.read(in_buf, in_bufl);
+        }
     }
 
     // return buffer type
@@ -294,11 +294,11 @@ void PRadDataHandler::FeedData(const TDCV1190Data &tdcData)
 void PRadDataHandler::FeedData(const GEMRawData &gemData)
 {
     if(gem_sys)
-        gem_sys->FillRawData(gemData, *new_event);
+        gem_sys->FillRawData(gemData);
 }
 
 // feed GEM data which has been zero-suppressed
-void PRadDataHandler::FeedData(const std::vector<GEMZeroSupData> &gemData)
+void PRadDataHandler::FeedData(const GEMZeroSupData &gemData)
 {
     if(gem_sys)
         gem_sys->FillZeroSupData(gemData, *new_event);
@@ -325,6 +325,11 @@ void PRadDataHandler::FillHistograms(const EventData &data)
 void PRadDataHandler::EndofThisEvent(const unsigned int &ev)
 {
     new_event->event_number = ev;
+
+    // process the GEM raw data of this event
+    if(gem_sys)
+        gem_sys->ProcessRawData(*new_event);
+
     // wait for the process thread
     waitEventProcess();
 
@@ -446,7 +451,25 @@ void PRadDataHandler::InitializeByData(const std::string &path, int ref)
     if(!path.empty()) {
         PRadInfoCenter::SetRunNumber(path);
         gem_sys->SetPedestalMode(true);
+        // the LMS events are needed for the gain factors and the pedestals of
+        // HyCal modules and GEM, the GEM pedestal is only filled from these
+        // monitor events
+        // the physics events are only needed for the pedestals of LMS PMTs,
+        // so only their ADC data are parsed, other triggers are skipped
+        uint32_t trigger_mask = parser.GetTriggerMask();
+        uint32_t adc_only_mask = parser.GetADCOnlyMask();
+        uint32_t monitor_mask = 0, physics_mask = 0;
+        SET_BIT(monitor_mask, LMS_Led);
+        SET_BIT(monitor_mask, LMS_Alpha);
+        SET_BIT(physics_mask, PHYS_LeadGlassSum);
+        SET_BIT(physics_mask, PHYS_TotalSum);
+        SET_BIT(physics_mask, PHYS_TaggerE);
+        SET_BIT(physics_mask, PHYS_Scintillator);
+        parser.SetTriggerMask(monitor_mask | physics_mask);
+        parser.SetADCOnlyMask(physics_mask);
         parser.ReadEvioFile(path.c_str(), 20000);
+        parser.SetTriggerMask(trigger_mask);
+        parser.SetADCOnlyMask(adc_only_mask);
     }
 
     std::cout << "Data Handler: Fitting Pedestal for HyCal." << std::endl;
@@ -0,0 +1,331 @@
+//============================================================================//
+// A cache of the reconstructed events for browsing                           //
+// The GEM results are kept for the most recently used events, and are valid  //
+// until the reconstruction settings are changed (UpdateVersion)              //
+// The HyCal results are kept by the versioned cache of HyCal system, which   //
+// rescales them for the gain changes instead of dropping them                //
+// If MULTI_THREAD is defined, the events around the current one are          //
+// reconstructed by a worker thread in the background                         //
+//                                                                            //
+// 10/18/2026                                                                 //
+//============================================================================//
+
+#include "PRadEventCache.h"
+#include "PRadDataHandler.h"
+#include "PRadHyCalSystem.h"
+#include "PRadGEMSystem.h"
+#include <iostream>
+
+
+
+PRadEventCache::PRadEventCache(PRadDataHandler *h,
+                               PRadHyCalSystem *hycal,
+                               PRadGEMSystem *gem,
+                               size_t c,
+                               unsigned int p)
+: handler(h), hycal_sys(hycal), gem_sys(gem), capacity(c), prefetch(p), version(0)
+{
+#ifdef MULTI_THREAD
+    worker_gem = nullptr;
+    busy = false;
+    stop = false;
+    worker = std::thread(&PRadEventCache::workerLoop, this);
+#endif
+}
+
+PRadEventCache::~PRadEventCache()
+{
+#ifdef MULTI_THREAD
+    {
+        std::lock_guard<std::mutex> lock(locker);
+        stop = true;
+        queue.clear();
+    }
+    queue_cond.notify_all();
+    worker.join();
+    delete worker_gem;
+#endif
+}
+
+// get the reconstruction results of an event, GEM hits are reconstructed here
+// if they are not in the cache, and HyCal system reconstructs the event with
+// its own cache
+// HyCal and GEM systems are used for the reconstruction, so their hits and
+// clusters may also be updated
+void PRadEventCache::Reconstruct(int index, Entry &entry)
+{
+#ifdef MULTI_THREAD
+    addHyCalCache();
+#endif
+
+    const EventData &event = handler->GetEvent(index);
+
+    if(!fromCache(index, entry)) {
+        entry = Entry();
+        entry.index = index;
+        entry.version = version;
+        reconGEM(event, gem_sys, entry);
+
+#ifdef MULTI_THREAD
+        std::lock_guard<std::mutex> lock(locker);
+#endif
+        saveCache(entry);
+    }
+
+    // only the stages affected by the changes are redone
+    if(hycal_sys && hycal_sys->GetDetector()) {
+        hycal_sys->Reconstruct(event);
+        entry.module_clusters = hycal_sys->GetDetector()->GetModuleClusters();
+        entry.hycal_hits = hycal_sys->GetDetector()->GetHits();
+    }
+}
+
+// reconstruct the events around the index in the background
+// it does nothing without MULTI_THREAD
+void PRadEventCache::Prefetch(int index)
+{
+#ifdef MULTI_THREAD
+    if(!handler || !prefetch)
+        return;
+
+    int total = handler->GetEventCount();
+    bool hycal_cache = hycal_sys && hycal_sys->IsReconCacheEnabled();
+
+    // the finished ones are not queued again
+    addHyCalCache();
+
+    {
+        std::lock_guard<std::mutex> lock(locker);
+
+        // the copy is made here, when the worker is not using it and the GEM
+        // system is not changed by the other thread
+        if(!worker_gem && gem_sys)
+            worker_gem = new PRadGEMSystem(*gem_sys);
+
+        // the closer events go first
+        queue.clear();
+        for(int i = 1; i <= (int)prefetch; ++i)
+        {
+            for(int idx : {index + i, index - i})
+            {
+                if(idx < 0 || idx >= total)
+                    continue;
+
+                const EventData &event = handler->GetEvent(idx);
+                if(!event.is_physics_event())
+                    continue;
+
+                Task task;
+                task.index = idx;
+                task.hycal = hycal_cache && !hycal_sys->IsReconCached(event);
+                auto it = entry_map.find(idx);
+                task.gem = it == entry_map.end() || it->second->version != version;
+
+                if(task.hycal || task.gem)
+                    queue.push_back(task);
+            }
+        }
+    }
+
+    queue_cond.notify_one();
+#else
+    (void) index;
+#endif
+}
+
+// stop the background reconstruction, it should be called before changing the
+// data handler or the systems
+// pedestal or gain changes only need this, HyCal system updates its own cache
+void PRadEventCache::Stop()
+{
+#ifdef MULTI_THREAD
+    {
+        std::unique_lock<std::mutex> lock(locker);
+        queue.clear();
+        idle_cond.wait(lock, [this] {return !busy;});
+    }
+
+    // the results are added before the changes, so HyCal system keeps the
+    // gains they were made with
+    addHyCalCache();
+#endif
+}
+
+// remove all the entries, the events in data handler are changed
+void PRadEventCache::Clear()
+{
+    Stop();
+
+#ifdef MULTI_THREAD
+    std::lock_guard<std::mutex> lock(locker);
+#endif
+    entries.clear();
+    entry_map.clear();
+}
+
+// the GEM reconstruction settings are changed, all the entries are outdated
+// HyCal results are checked by HyCal system with its own version stamps
+void PRadEventCache::UpdateVersion()
+{
+    Stop();
+
+#ifdef MULTI_THREAD
+    std::lock_guard<std::mutex> lock(locker);
+    // worker needs a new copy of the GEM system
+    delete worker_gem, worker_gem = nullptr;
+#endif
+    ++version;
+    entries.clear();
+    entry_map.clear();
+}
+
+void PRadEventCache::SetCapacity(size_t c)
+{
+#ifdef MULTI_THREAD
+    std::lock_guard<std::mutex> lock(locker);
+#endif
+    capacity = c;
+    while(entries.size() > capacity)
+    {
+        entry_map.erase(entries.back().index);
+        entries.pop_back();
+    }
+}
+
+//============================================================================//
+// Private Member Functions                                                   //
+//============================================================================//
+
+// get the entry if it is cached and up to date
+bool PRadEventCache::fromCache(int index, Entry &entry)
+{
+#ifdef MULTI_THREAD
+    std::lock_guard<std::mutex> lock(locker);
+#endif
+    auto it = entry_map.find(index);
+    if(it == entry_map.end())
+        return false;
+
+    if(it->second->version != version) {
+        entries.erase(it->second);
+        entry_map.erase(it);
+        return false;
+    }
+
+    // move to the front as the most recently used
+    entries.splice(entries.begin(), entries, it->second);
+    entry = entries.front();
+    return true;
+}
+
+// save an entry, the locker should be held by the caller
+void PRadEventCache::saveCache(const Entry &entry)
+{
+    if(!capacity)
+        return;
+
+    auto it = entry_map.find(entry.index);
+    if(it != entry_map.end())
+        entries.erase(it->second);
+
+    entries.push_front(entry);
+    entry_map[entry.index] = entries.begin();
+
+    // remove the least recently used
+    while(entries.size() > capacity)
+    {
+        entry_map.erase(entries.back().index);
+        entries.pop_back();
+    }
+}
+
+// reconstruct GEM hits of an event, the GEM system should not be used by the
+// other threads
+void PRadEventCache::reconGEM(const EventData &event,
+                              PRadGEMSystem *gem,
+                              Entry &entry)
+const
+{
+    if(!gem)
+        return;
+
+    gem->Reconstruct(event);
+    PRadGEMDetector *gem1 = gem->GetDetector(PRadDetector::PRadGEM1);
+    PRadGEMDetector *gem2 = gem->GetDetector(PRadDetector::PRadGEM2);
+    if(gem1)
+        entry.gem1_hits = gem1->GetHits();
+    if(gem2)
+        entry.gem2_hits = gem2->GetHits();
+}
+
+#ifdef MULTI_THREAD
+// add the HyCal results from the worker to the cache of HyCal system, it is
+// only called by the main thread
+void PRadEventCache::addHyCalCache()
+{
+    std::deque<std::pair<int, ReconCache>> results;
+    {
+        std::lock_guard<std::mutex> lock(locker);
+        results.swap(hycal_results);
+    }
+
+    int total = handler ? handler->GetEventCount() : 0;
+    for(auto &res : results)
+    {
+        if(res.first < total)
+            hycal_sys->AddReconCache(handler->GetEvent(res.first), std::move(res.second));
+    }
+}
+
+// reconstruct the queued events
+void PRadEventCache::workerLoop()
+{
+    while(true)
+    {
+        Task task;
+        Entry entry;
+        ReconCache cache;
+        {
+            std::unique_lock<std::mutex> lock(locker);
+            queue_cond.wait(lock, [this] {return stop || !queue.empty();});
+            if(stop)
+                return;
+
+            task = queue.front();
+            entry.index = task.index;
+            entry.version = version;
+            queue.pop_front();
+            busy = true;
+        }
+
+        bool success = true;
+        try {
+            const EventData &event = handler->GetEvent(task.index);
+            // HyCal detector is not changed
+            if(task.hycal)
+                hycal_sys->ReconstructCache(event, cache);
+            if(task.gem)
+                reconGEM(event, worker_gem, entry);
+        } catch(PRadException &e) {
+            std::cerr << e.FailureType() << ": "
+                      << e.FailureDesc() << std::endl
+                      << "PRad Event Cache Error: Failed to reconstruct event "
+                      << entry.index << " in background."
+                      << std::endl;
+            success = false;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(locker);
+            if(success && entry.version == version) {
+                if(task.gem)
+                    saveCache(entry);
+                if(task.hycal)
+                    hycal_results.emplace_back(task.index, std::move(cache));
+            }
+            busy = false;
+        }
+        idle_cond.notify_all();
+    }
+}
+#endif
@@ -98,6 +98,8 @@ PRadEventViewer::~PRadEventViewer()
     delete hvSystem;
 #endif
 #ifdef RECON_DISPLAY
+    // background reconstruction uses the systems
+    delete eventCache;
     delete coordSystem;
     delete detMatch;
 #endif
@@ -567,8 +569,9 @@ void PRadEventViewer::Refresh()
         break;
     case EnergyView:
 #ifdef RECON_DISPLAY
-        if(clusterSpin->value() > 0)
-            HyCal->ShowCluster(clusterSpin->value() - 1);
+        if(clusterSpin->value() > 0 &&
+           clusterSpin->value() <= (int)reconEvent.module_clusters.size())
+            HyCal->ShowCluster(reconEvent.module_clusters, clusterSpin->value() - 1);
         else
 #endif
         HyCal->ModuleAction(&HyCalModule::ShowEnergy);
@@ -613,6 +616,7 @@ void PRadEventViewer::Refresh()
 // clean all the data buffer
 void PRadEventViewer::eraseData()
 {
+    resetEventCache(true);
     handler->Clear();
     updateEventRange();
 }
@@ -683,6 +687,7 @@ void PRadEventViewer::initializeFromFile()
 
     PRadBenchMark timer;
 
+    resetEventCache();
     handler->InitializeByData(file.toStdString());
 
     updateEventRange();
@@ -705,7 +710,9 @@ void PRadEventViewer::openCalibrationFile()
     QString file = getFileName(tr("Open calibration constants file"), dir, filters, "");
 
     if (!file.isEmpty()) {
+        stopEventCache();
         hycal_sys->GetDetector()->ReadCalibrationFile(file.toStdString());
+        hycal_sys->UpdateEnergyTable();
     }
 }
 
@@ -720,6 +727,7 @@ void PRadEventViewer::openGainFactorFile()
     QString file = getFileName(tr("Open gain factors file"), dir, filters, "");
 
     if (!file.isEmpty()) {
+        stopEventCache();
         hycal_sys->ReadRunInfoFile(file.toStdString());
     }
 }
@@ -857,7 +865,10 @@ void PRadEventViewer::handleEventChange(int evt)
             HyCal->ClearHitsMarks();
 
             if(event.is_physics_event())
-                showReconEvent();
+                showReconEvent(evt - 1);
+
+            // reconstruct the neighbor events for browsing
+            eventCache->Prefetch(evt - 1);
         }
 #endif
 
@@ -869,6 +880,30 @@ void PRadEventViewer::handleEventChange(int evt)
     }
 }
 
+// the reconstruction results in cache are outdated, it should be called before
+// changing the events in data handler or the reconstruction settings
+void PRadEventViewer::resetEventCache(bool new_data)
+{
+#ifdef RECON_DISPLAY
+    if(new_data)
+        eventCache->Clear();
+    else
+        eventCache->UpdateVersion();
+    reconEvent = PRadEventCache::Entry();
+#else
+    (void) new_data;
+#endif
+}
+
+// stop the background reconstruction before changing the calibration, the
+// HyCal results in cache are rescaled or redone by HyCal system later
+void PRadEventViewer::stopEventCache()
+{
+#ifdef RECON_DISPLAY
+    eventCache->Stop();
+#endif
+}
+
 void PRadEventViewer::updateEventRange()
 {
     int total = handler->GetEventCount();
@@ -1163,6 +1198,7 @@ void PRadEventViewer::findPeak()
 
 void PRadEventViewer::fitPedestal()
 {
+    stopEventCache();
     hycal_sys->FitPedestal();
     UpdateHistCanvas();
     emit currentEventChanged(eventSpin->value());
@@ -1232,6 +1268,7 @@ void PRadEventViewer::fitHistogram()
 
 void PRadEventViewer::correctGainFactor()
 {
+    stopEventCache();
     hycal_sys->CorrectGainFactor(2);
     // Refill the histogram to show the changes
     handler->RefillEnergyHist();
@@ -1293,9 +1330,12 @@ void PRadEventViewer::setupReconDisplay()
     // add hycal clustering methods
     coordSystem = new PRadCoordSystem("database/coordinates.dat");
     detMatch = new PRadDetMatch("config/det_match.conf");
+    eventCache = new PRadEventCache(handler, hycal_sys, gem_sys);
 
     reconSetting = new ReconSettingPanel(this);
     reconSetting->ConnectHyCalSystem(hycal_sys);
+    // browsing events with calibration changes does not need regrouping
+    hycal_sys->SetReconCache(true);
     reconSetting->ConnectGEMSystem(gem_sys);
     reconSetting->ConnectCoordSystem(coordSystem);
     reconSetting->ConnectMatchSystem(detMatch);
@@ -1312,38 +1352,44 @@ void PRadEventViewer::enableReconstruct()
 
 void PRadEventViewer::setupReconMethods()
 {
+    // the panel may reload the configurations of the connected objects, so
+    // the background reconstruction is stopped before showing it
+    eventCache->Stop();
+
     // sync settings with the connected objects
     reconSetting->SyncSettings();
 
     // save for restore
     reconSetting->SaveSettings();
 
-    if(!reconSetting->exec()) {
+    if(reconSetting->exec()) {
+        // apply the changes to connected objects
+        reconSetting->ApplyChanges();
+    } else {
         reconSetting->RestoreSettings();
-        return;
     }
 
-    // apply the changes to connected objects
-    reconSetting->ApplyChanges();
+    // the configurations may be reloaded even if the changes are discarded
+    resetEventCache();
 
     emit(changeCurrentEvent(eventSpin->value()));
 }
 
-void PRadEventViewer::showReconEvent()
+void PRadEventViewer::showReconEvent(int index)
 {
     if(handler->GetEventCount() == 0)
         return;
 
-    // reconstruction
-    hycal_sys->Reconstruct();
-    gem_sys->Reconstruct();
+    // reconstruction, the results are from event cache if they are still valid
+    eventCache->Reconstruct(index, reconEvent);
     PRadGEMDetector *gem1 = gem_sys->GetDetector(PRadDetector::PRadGEM1);
     PRadGEMDetector *gem2 = gem_sys->GetDetector(PRadDetector::PRadGEM2);
 
-    // get reconstructed clusters
-    auto &hycal_hit = HyCal->GetHits();
-    auto &gem1_hit = gem1->GetHits();
-    auto &gem2_hit = gem2->GetHits();
+    // get reconstructed clusters, the cached entry keeps the hits before
+    // coordinates transform
+    auto hycal_hit = reconEvent.hycal_hits;
+    auto gem1_hit = reconEvent.gem1_hits;
+    auto gem2_hit = reconEvent.gem2_hits;
 
     // coordinates transform, projection
     coordSystem->Transform(HyCal->GetDetID(), hycal_hit.begin(), hycal_hit.end());
@@ -1420,7 +1466,7 @@ void PRadEventViewer::showReconEvent()
     }
 
     // update the cluster size
-    clusterSpin->setRange(0, HyCal->GetModuleClusters().size());
+    clusterSpin->setRange(0, reconEvent.module_clusters.size());
 }
 
 #endif
@@ -1560,6 +1606,9 @@ void PRadEventViewer::onlineUpdate(const size_t &max_events)
     try {
         size_t num;
 
+        // the events in data handler will be replaced
+        resetEventCache(true);
+
         for(num = 0; etChannel->Read() && num < max_events; ++num)
         {
             handler->Decode(etChannel->GetBuffer());
@@ -12,6 +12,10 @@
 #include <iostream>
 #include <iomanip>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #ifdef MULTI_THREAD
 #include <thread>
 #define ROC_THREAD_THRES 5000     // open a new thread for large roc buffer size
@@ -31,7 +35,8 @@ using namespace std;
 
 // constructor
 PRadEvioParser::PRadEvioParser(PRadDataHandler *handler)
-: myHandler(handler), event_number(0)
+: myHandler(handler), event_number(0), trigger_mask(0), adc_only_mask(0),
+  adc_only(false), event_adc_only(false)
 {
     // place holder
 }
@@ -168,6 +173,19 @@ int PRadEvioParser::parseEvent(const PRadEventHeader *header)
         return header->tag;
     }
 
+    // the trigger type is only peeked if there are selections on it
+    event_adc_only = adc_only;
+    if(header->tag == CODA_Event && (trigger_mask || adc_only_mask)) {
+        PRadTriggerType trg = peek_trigger(header);
+
+        // the trigger type is not selected, skip this event
+        if(trigger_mask && !TEST_BIT(trigger_mask, trg))
+            return header->tag;
+
+        if(TEST_BIT(adc_only_mask, trg))
+            event_adc_only = true;
+    }
+
     // inform handler the start of a new event
     myHandler->StartofNewEvent(header->tag);
 
@@ -253,6 +271,12 @@ void PRadEvioParser::parseDataBank(const PRadEventHeader *data_header)
     const uint32_t *buffer = (const uint32_t*) &data_header[1]; // skip current header
     uint32_t dataSize = data_header->length - 1;
 
+    // only the trigger information and HyCal ADC data are needed
+    if(event_adc_only &&
+       data_header->tag != TI_BANK &&
+       data_header->tag != FASTBUS_BANK)
+        return;
+
     // check the header, skip uninterested ones
     switch(data_header->tag)
     {
@@ -346,75 +370,104 @@ void PRadEvioParser::parseGEMData(const uint32_t *data, const uint32_t &size,  c
     }
 
     // parse raw GEM data
-    GEMRawData gemData;
-    uint32_t i = 0;
+    splitGEMFrames(data, size);
+}
 
-    while(i < size)
+// find the next APV header word or FEC end word from index i
+// 4 words are compared at a time with SSE2
+static inline uint32_t __evio_find_gem_marker(const uint32_t *data, uint32_t i, const uint32_t &size)
+{
+#ifdef __SSE2__
+    const __m128i mask = _mm_set1_epi32((int)0xffffff00);
+    const __m128i apv_beg = _mm_set1_epi32((int)GEMDATA_APVBEG);
+    const __m128i fec_end = _mm_set1_epi32((int)GEMDATA_FECEND);
+    for(; i + 4 <= size; i += 4)
     {
-        if((data[i]&0xffffff00) == GEMDATA_APVBEG) {
-            gemData.addr.adc_ch = data[i]&0xff;
-            gemData.addr.fec_id = (data[i+1] >> 16)&0xff;
-            gemData.buf = &data[i+2];
-            gemData.size = getAPVDataSize(gemData.buf);
+        __m128i words = _mm_loadu_si128((const __m128i*)(data + i));
+        __m128i found = _mm_or_si128(_mm_cmpeq_epi32(_mm_and_si128(words, mask), apv_beg),
+                                     _mm_cmpeq_epi32(words, fec_end));
+        if(_mm_movemask_epi8(found))
+            break;
+    }
+#endif
 
-            myHandler->FeedData(gemData);
+    for(; i < size; ++i)
+    {
+        if((data[i]&0xffffff00) == GEMDATA_APVBEG || data[i] == GEMDATA_FECEND)
+            return i;
+    }
 
-            i += gemData.size;
-        } else {
-            ++i;
+    return size;
+}
+
+// split the raw GEM data into APV frames in one pass
+// a frame begins with an APV header word and a FEC word, its data ends before
+// the word prior to the next APV header, or before the FEC end word
+// each frame is fed to the handler once its end is found
+void PRadEvioParser::splitGEMFrames(const uint32_t *data, const uint32_t &size)
+{
+    GEMRawData frame;
+    bool open = false;
+    uint32_t begin = 0;
+
+    uint32_t i = __evio_find_gem_marker(data, 0, size);
+    while(i < size)
+    {
+        if(data[i] == GEMDATA_FECEND) {
+            if(open) {
+                frame.size = i - begin;
+                myHandler->FeedData(frame);
+                open = false;
+            }
+            i = __evio_find_gem_marker(data, i + 1, size);
+            continue;
         }
+
+        // APV header, the previous frame ends here
+        if(open) {
+            frame.size = (i > begin) ? i - begin - 1 : 0;
+            myHandler->FeedData(frame);
+            open = false;
+        }
+
+        // incomplete header at the end of bank
+        if(i + 2 > size)
+            break;
+
+        frame.addr.adc_ch = data[i]&0xff;
+        frame.addr.fec_id = (data[i+1] >> 16)&0xff;
+        begin = i + 2;
+        frame.buf = &data[begin];
+        open = true;
+
+        i = __evio_find_gem_marker(data, begin, size);
+    }
+
+    // no end word for the last frame
+    if(open) {
+        frame.size = size - begin;
+        myHandler->FeedData(frame);
     }
 }
 
 // parse zero-suppressed GEM data
 void PRadEvioParser::parseGEMZeroSupData(const uint32_t *data, const uint32_t &size)
 {
-    // data word structure (32 bit word)
-    // detector: 1 bit
-    // plane: 1 bit
-    // fec id: 4 bit
-    // adc channel id: 4 bit
-    // strip number: 7 bit
-    // time sample number: 3 bit
-    // polarity: 1 bit
-    // adc value: 11 bit
-
+    // the data words are decoded by PRadGEMSystem::FillZeroSupData
     if((data[0]&0xffffff00) != GEMDATA_ZEROSUP) {
         cerr << "Unrecognized GEM zero suppressed data header word: "
              << "0x" << hex << setw(8) << setfill('0') << data[0]
              << endl;
     }
 
-    vector<GEMZeroSupData> gemDataPack;
-    for(uint32_t i = 1; i < size; ++i)
-    {
-        GEMZeroSupData gemData;
-        gemData.addr.fec_id = (data[i] >> 26)&0xf;
-        gemData.addr.adc_ch = (data[i] >> 22)&0xf;
-        gemData.channel = (data[i] >> 15)&0x7f;
-        gemData.time_sample = (data[i] >> 12)&0x7;
-        gemData.adc_value = data[i]&0x7ff;
-
-        gemDataPack.push_back(gemData);
-    }
+    if(size < 2)
+        return;
 
-    myHandler->FeedData(gemDataPack);
-}
+    GEMZeroSupData gemData;
+    gemData.buf = &data[1];
+    gemData.size = size - 1;
 
-// a helper function to determine the APV data size
-uint32_t PRadEvioParser::getAPVDataSize(const uint32_t *data)
-{
-    uint32_t idx = 0;
-
-    while((data[idx]&0xffffff00) != GEMDATA_APVBEG)
-    {
-        if(data[idx] == GEMDATA_FECEND) {
-            return idx;
-        }
-        ++idx;
-    }
-
-    return idx - 1;
+    myHandler->FeedData(gemData);
 }
 
 // parse CAEN V767 Data
@@ -574,3 +627,48 @@ unsigned int PRadEvioParser::trigger_to_bit(const PRadTriggerType &trg)
         return 1 << (int) trg;
 }
 
+// find the trigger type of an event from the TI bank without parsing the data
+PRadTriggerType PRadEvioParser::peek_trigger(const PRadEventHeader *header)
+{
+    const uint32_t buf_size = header->length - 1;
+    const uint32_t *buf = (const uint32_t*) &header[1];
+    uint32_t index = 0;
+
+    while(index < buf_size)
+    {
+        const PRadEventHeader *roc_header = (const PRadEventHeader*) &buf[index];
+        index += roc_header->length + 1;
+
+        // TI banks only exist in the DAQ ROCs
+        switch(roc_header->tag)
+        {
+        case PRadTagE:
+        case PRadSRS_2:
+        case PRadSRS_1:
+        case PRadROC_3:
+        case PRadROC_2:
+        case PRadROC_1:
+        case PRadTS:
+            break;
+        default:
+            continue;
+        }
+
+        const uint32_t *roc_buf = (const uint32_t*) &roc_header[1];
+        const uint32_t roc_size = roc_header->length - 1;
+        uint32_t roc_index = 0;
+
+        while(roc_index < roc_size)
+        {
+            const PRadEventHeader *bank_header = (const PRadEventHeader*) &roc_buf[roc_index];
+            roc_index += bank_header->length + 1;
+
+            if(bank_header->tag == TI_BANK) {
+                const uint32_t *data = (const uint32_t*) &bank_header[1];
+                return bit_to_trigger(data[2]>>24);
+            }
+        }
+    }
+
+    return NotFromTI;
+}
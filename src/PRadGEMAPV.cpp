@@ -8,12 +8,17 @@
 
 #include <iostream>
 #include <iomanip>
+#include <algorithm>
+#include <cmath>
 #include "PRadGEMFEC.h"
 #include "PRadGEMPlane.h"
 #include "PRadGEMAPV.h"
-#include "TF1.h"
 #include "TH1.h"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 
 // macro to get the data index
 #define DATA_INDEX(ch, ts) (ts_begin + ch + ts*TIME_SAMPLE_DIFF)
@@ -39,6 +44,9 @@ PRadGEMAPV::PRadGEMAPV(const int &o,
     raw_data = nullptr;
     SetTimeSample(t);
 
+    offset_stat = nullptr;
+    noise_stat = nullptr;
+
     for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
     {
         offset_hist[i] = nullptr;
@@ -51,6 +59,7 @@ PRadGEMAPV::PRadGEMAPV(const int &o,
         split = false;
 
     ClearData();
+    updateThresholds();
 }
 
 // only used in constructors
@@ -65,6 +74,9 @@ void PRadGEMAPV::initialize()
     // these can only be assigned by a Plane (SetDetectorPlane)
     plane = nullptr;
     plane_index = -1;
+
+    // set by FillRawData, the GEM system processes the filled APVs only
+    raw_filled = false;
 }
 
 // The copy and move constructor/assignment operator won't copy or replace the
@@ -89,12 +101,23 @@ PRadGEMAPV::PRadGEMAPV(const PRadGEMAPV &that)
         raw_data[i] = that.raw_data[i];
     }
 
+    // pedestal estimators
+    offset_stat = nullptr;
+    noise_stat = nullptr;
+    if(that.offset_stat && that.noise_stat) {
+        CreatePedStat();
+        for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
+        {
+            offset_stat[i] = that.offset_stat[i];
+            noise_stat[i] = that.noise_stat[i];
+        }
+    }
+
     // copy other arrays
     for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
     {
         pedestal[i] = that.pedestal[i];
         strip_map[i] = that.strip_map[i];
-        hit_pos[i] = that.hit_pos[i];
 
         // dangerous part, may fail due to lack of memory
         if(that.offset_hist[i] != nullptr) {
@@ -109,6 +132,15 @@ PRadGEMAPV::PRadGEMAPV(const PRadGEMAPV &that)
             noise_hist[i] = nullptr;
         }
     }
+
+    dirty_end = that.dirty_end;
+    for(uint32_t i = 0; i < APV_CHANNEL_SIZE/32; ++i)
+    {
+        hit_mask[i] = that.hit_mask[i];
+        dirty_mask[i] = that.dirty_mask[i];
+    }
+
+    updateThresholds();
 }
 
 // move constructor
@@ -128,13 +160,18 @@ PRadGEMAPV::PRadGEMAPV(PRadGEMAPV &&that)
     that.buffer_size = 0;
     that.raw_data = nullptr;
 
+    // pedestal estimators
+    offset_stat = that.offset_stat;
+    noise_stat = that.noise_stat;
+    that.offset_stat = nullptr;
+    that.noise_stat = nullptr;
+
     // other arrays
     // static array, so no need to move, just copy elements
     for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
     {
         pedestal[i] = that.pedestal[i];
         strip_map[i] = that.strip_map[i];
-        hit_pos[i] = that.hit_pos[i];
 
         // these need to be moved
         offset_hist[i] = that.offset_hist[i];
@@ -142,6 +179,17 @@ PRadGEMAPV::PRadGEMAPV(PRadGEMAPV &&that)
         that.offset_hist[i] = nullptr;
         that.noise_hist[i] = nullptr;
     }
+
+    dirty_end = that.dirty_end;
+    that.dirty_end = 0;
+    for(uint32_t i = 0; i < APV_CHANNEL_SIZE/32; ++i)
+    {
+        hit_mask[i] = that.hit_mask[i];
+        dirty_mask[i] = that.dirty_mask[i];
+        that.dirty_mask[i] = 0;
+    }
+
+    updateThresholds();
 }
 
 // destructor
@@ -150,6 +198,7 @@ PRadGEMAPV::~PRadGEMAPV()
     UnsetFEC();
     UnsetDetectorPlane();
     ReleasePedHist();
+    ReleasePedStat();
 
     delete[] raw_data;
 }
@@ -173,6 +222,7 @@ PRadGEMAPV &PRadGEMAPV::operator= (PRadGEMAPV &&rhs)
 
     // release memory
     ReleasePedHist();
+    ReleasePedStat();
     delete[] raw_data;
 
     // members
@@ -192,13 +242,18 @@ PRadGEMAPV &PRadGEMAPV::operator= (PRadGEMAPV &&rhs)
     rhs.buffer_size = 0;
     rhs.raw_data = nullptr;
 
+    // pedestal estimators
+    offset_stat = rhs.offset_stat;
+    noise_stat = rhs.noise_stat;
+    rhs.offset_stat = nullptr;
+    rhs.noise_stat = nullptr;
+
     // other arrays
     // static array, so no need to move, just copy elements
     for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
     {
         pedestal[i] = rhs.pedestal[i];
         strip_map[i] = rhs.strip_map[i];
-        hit_pos[i] = rhs.hit_pos[i];
 
         // these need to be moved
         offset_hist[i] = rhs.offset_hist[i];
@@ -207,6 +262,17 @@ PRadGEMAPV &PRadGEMAPV::operator= (PRadGEMAPV &&rhs)
         rhs.noise_hist[i] = nullptr;
     }
 
+    dirty_end = rhs.dirty_end;
+    rhs.dirty_end = 0;
+    for(uint32_t i = 0; i < APV_CHANNEL_SIZE/32; ++i)
+    {
+        hit_mask[i] = rhs.hit_mask[i];
+        dirty_mask[i] = rhs.dirty_mask[i];
+        rhs.dirty_mask[i] = 0;
+    }
+
+    updateThresholds();
+
     return *this;
 }
 
@@ -317,6 +383,47 @@ void PRadGEMAPV::ReleasePedHist()
     }
 }
 
+// create the pedestal estimators
+void PRadGEMAPV::CreatePedStat()
+{
+    if(offset_stat == nullptr)
+        offset_stat = new PedestalStat[APV_CHANNEL_SIZE];
+    if(noise_stat == nullptr)
+        noise_stat = new PedestalStat[APV_CHANNEL_SIZE];
+}
+
+void PRadGEMAPV::ResetPedStat()
+{
+    for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
+    {
+        if(offset_stat)
+            offset_stat[i].Clear();
+        if(noise_stat)
+            noise_stat[i].Clear();
+    }
+}
+
+// release the memory for pedestal estimators
+void PRadGEMAPV::ReleasePedStat()
+{
+    delete[] offset_stat, offset_stat = nullptr;
+    delete[] noise_stat, noise_stat = nullptr;
+}
+
+// set common mode threshold level
+void PRadGEMAPV::SetCommonModeThresLevel(const float &t)
+{
+    common_thres = t;
+    updateThresholds();
+}
+
+// set zero suppression threshold level
+void PRadGEMAPV::SetZeroSupThresLevel(const float &t)
+{
+    zerosup_thres = t;
+    updateThresholds();
+}
+
 // set time samples and reserve memory for raw data
 void PRadGEMAPV::SetTimeSample(const uint32_t &t)
 {
@@ -328,24 +435,48 @@ void PRadGEMAPV::SetTimeSample(const uint32_t &t)
 
     raw_data = new float[buffer_size];
 
+    // the new buffer is all dirty
+    dirty_end = buffer_size;
+    for(uint32_t i = 0; i < APV_CHANNEL_SIZE/32; ++i)
+        dirty_mask[i] = 0;
+
     ClearData();
 }
 
 // clear all the data
+// the raw data are set to a high value that won't trigger zero suppression,
+// only the parts written since last clear are reset, so the cost depends on
+// the filled data instead of the buffer size
 void PRadGEMAPV::ClearData()
 {
-    // set to a high value that won't trigger zero suppression
-    for(uint32_t i = 0; i < buffer_size; ++i)
+    for(uint32_t i = 0; i < dirty_end; ++i)
         raw_data[i] = 5000.;
+    dirty_end = 0;
+
+    // zero suppressed data are filled with ts_begin = 0
+    for(uint32_t i = 0; i < APV_CHANNEL_SIZE/32; ++i)
+    {
+        for(uint32_t bit = 0; dirty_mask[i]; ++bit)
+        {
+            if(!(dirty_mask[i] & (1u << bit)))
+                continue;
+
+            dirty_mask[i] &= ~(1u << bit);
+            uint32_t ch = i*32 + bit;
+            for(uint32_t ts = 0; ts < time_samples; ++ts)
+                raw_data[ch + ts*TIME_SAMPLE_DIFF] = 5000.;
+        }
+    }
 
+    raw_filled = false;
     ResetHitPos();
 }
 
 // reset hit position array
 void PRadGEMAPV::ResetHitPos()
 {
-    for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
-        hit_pos[i] = false;
+    for(uint32_t i = 0; i < APV_CHANNEL_SIZE/32; ++i)
+        hit_mask[i] = 0;
 }
 
 // clear all the pedestal
@@ -353,6 +484,8 @@ void PRadGEMAPV::ClearPedestal()
 {
     for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
         pedestal[i] = Pedestal(0, 0);
+
+    updateThresholds();
 }
 
 // update pedestal
@@ -360,6 +493,8 @@ void PRadGEMAPV::UpdatePedestal(std::vector<Pedestal> &ped)
 {
     for(uint32_t i = 0; (i < ped.size()) && (i < APV_CHANNEL_SIZE); ++i)
         pedestal[i] = ped[i];
+
+    updateThresholds();
 }
 
 // update single channel pedestal
@@ -369,6 +504,7 @@ void PRadGEMAPV::UpdatePedestal(const Pedestal &ped, const uint32_t &index)
         return;
 
     pedestal[index] = ped;
+    updateThreshold(index);
 }
 
 // update single channel pedestal
@@ -379,6 +515,7 @@ void PRadGEMAPV::UpdatePedestal(const float &offset, const float &noise, const u
 
     pedestal[index].offset = offset;
     pedestal[index].noise = noise;
+    updateThreshold(index);
 }
 
 // fill raw data
@@ -391,12 +528,30 @@ void PRadGEMAPV::FillRawData(const uint32_t *buf, const uint32_t &size)
         return;
     }
 
-    for(uint32_t i = 0; i < size; ++i)
+    // time sample data begin after 3 consecutive words below the header
+    // level, it is searched while the first words are being split
+    ts_begin = buffer_size;
+    uint32_t i = 0, below = 0;
+
+    for(; i < size && ts_begin == buffer_size; ++i)
+    {
+        SplitData(buf[i], raw_data[2*i], raw_data[2*i+1]);
+
+        for(uint32_t j = 2*i; j < 2*i + 2 && ts_begin == buffer_size; ++j)
+        {
+            below = (raw_data[j] < header_level) ? below + 1 : 0;
+            if(below == 3)
+                ts_begin = j + 10;
+        }
+    }
+
+    for(; i < size; ++i)
     {
         SplitData(buf[i], raw_data[2*i], raw_data[2*i+1]);
     }
 
-    ts_begin = getTimeSampleStart();
+    dirty_end = std::max(dirty_end, 2*size);
+    raw_filled = true;
 }
 
 // fill zero suppressed data
@@ -415,7 +570,8 @@ void PRadGEMAPV::FillZeroSupData(const uint32_t &ch, const uint32_t &ts, const u
         return;
     }
 
-    hit_pos[ch] = true;
+    setHit(ch);
+    setDirty(ch);
     raw_data[idx] = val;
 }
 
@@ -433,7 +589,8 @@ void PRadGEMAPV::FillZeroSupData(const uint32_t &ch, const std::vector<float> &v
         return;
     }
 
-    hit_pos[ch] = true;
+    setHit(ch);
+    setDirty(ch);
 
     for(uint32_t i = 0; i < vals.size(); ++i)
     {
@@ -452,8 +609,8 @@ void PRadGEMAPV::SplitData(const uint32_t &data, float &word1, float &word2)
     word2 = (float)data2;
 }
 
-// fill pedestal histogram
-void PRadGEMAPV::FillPedHist()
+// fill pedestal estimators, and also the histograms if they are created
+void PRadGEMAPV::FillPedestal()
 {
     float average[2][3];
 
@@ -484,32 +641,38 @@ void PRadGEMAPV::FillPedHist()
             }
         }
 
+        ch_average /= time_samples;
+        noise_average /= time_samples;
+
+        // same ranges as the histograms
+        if(offset_stat && ch_average >= 2000. && ch_average < 3500.)
+            offset_stat[i].Fill(ch_average);
+
+        if(noise_stat && noise_average >= -200. && noise_average < 200.)
+            noise_stat[i].Fill(noise_average);
+
         if(offset_hist[i])
-            offset_hist[i]->Fill(ch_average/time_samples);
+            offset_hist[i]->Fill(ch_average);
 
         if(noise_hist[i])
-            noise_hist[i]->Fill(noise_average/time_samples);
+            noise_hist[i]->Fill(noise_average);
     }
 }
 
-// fit pedestal histogram
+// update pedestal from the estimators
+// the histograms are only for saving, they are not fitted anymore
 void PRadGEMAPV::FitPedestal()
 {
+    if(!offset_stat || !noise_stat)
+        return;
+
     for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
     {
-        if( (offset_hist[i] == nullptr) ||
-            (noise_hist[i] == nullptr) ||
-            (offset_hist[i]->Integral() < 1000) ||
-            (noise_hist[i]->Integral() < 1000) )
+        if( (offset_stat[i].GetEntries() < 1000) ||
+            (noise_stat[i].GetEntries() < 1000) )
             continue;
 
-        offset_hist[i]->Fit("gaus", "qww");
-        noise_hist[i]->Fit("gaus", "qww");
-        TF1 *myfit = (TF1*) offset_hist[i]->GetFunction("gaus");
-        double p0 = myfit->GetParameter(1);
-        myfit = (TF1*) noise_hist[i]->GetFunction("gaus");
-        double p1 = myfit->GetParameter(2);
-        UpdatePedestal((float)p0, (float)p1, i);
+        UpdatePedestal((float)offset_stat[i].Mean(), (float)noise_stat[i].Sigma(), i);
     }
 }
 
@@ -535,28 +698,39 @@ void PRadGEMAPV::ZeroSuppression()
         return;
     }
 
-    // common mode correction
+    // common mode correction, the data are corrected in place
+    dirty_end = std::max(dirty_end, DATA_INDEX(APV_CHANNEL_SIZE, time_samples - 1));
     for(uint32_t ts = 0; ts < time_samples; ++ts)
     {
-        if(split)
-            CommonModeCorrection_Split(&raw_data[DATA_INDEX(0, ts)], APV_CHANNEL_SIZE);
-        else
-            CommonModeCorrection(&raw_data[DATA_INDEX(0, ts)], APV_CHANNEL_SIZE);
+        CommonModeCorrection(&raw_data[DATA_INDEX(0, ts)], APV_CHANNEL_SIZE);
     }
 
-    for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
+    // the time sample averaged charge is compared with the threshold
+    ResetHitPos();
+    uint32_t ch = 0;
+
+#ifdef __SSE2__
+    const __m128 nts = _mm_set1_ps((float)time_samples);
+    for(; ch + 4 <= APV_CHANNEL_SIZE; ch += 4)
+    {
+        __m128 sum = _mm_setzero_ps();
+        for(uint32_t ts = 0; ts < time_samples; ++ts)
+            sum = _mm_add_ps(sum, _mm_loadu_ps(&raw_data[DATA_INDEX(ch, ts)]));
+
+        __m128 hit = _mm_cmpgt_ps(_mm_div_ps(sum, nts), _mm_load_ps(&zs_thres[ch]));
+        hit_mask[ch >> 5] |= (uint32_t)_mm_movemask_ps(hit) << (ch & 31);
+    }
+#endif
+
+    for(; ch < APV_CHANNEL_SIZE; ++ch)
     {
         float average = 0.;
-        for(uint32_t j = 0; j < time_samples; ++j)
-        {
-            average += raw_data[DATA_INDEX(i, j)];
-        }
+        for(uint32_t ts = 0; ts < time_samples; ++ts)
+            average += raw_data[DATA_INDEX(ch, ts)];
         average /= time_samples;
 
-        if(average > pedestal[i].noise * zerosup_thres)
-            hit_pos[i] = true;
-        else
-            hit_pos[i] = false;
+        if(average > zs_thres[ch])
+            setHit(ch);
     }
 }
 
@@ -565,7 +739,7 @@ void PRadGEMAPV::CollectZeroSupHits(std::vector<GEM_Data> &hits)
 {
     for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
     {
-        if(hit_pos[i] == false)
+        if(!isHit(i))
             continue;
 
         GEM_Data hit(fec_id, adc_ch, i);
@@ -585,7 +759,7 @@ void PRadGEMAPV::CollectZeroSupHits()
 
     for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
     {
-        if(hit_pos[i] == false)
+        if(!isHit(i))
             continue;
 
         plane->AddStripHit(strip_map[i].plane,
@@ -597,63 +771,75 @@ void PRadGEMAPV::CollectZeroSupHits()
 }
 
 // do common mode correction (bring the signal average to 0)
+// the channels under threshold are averaged as the common mode, the first 16
+// strips of a split APV have their own common mode
+// the sums are accumulated in 4 lanes, so the vectorized and scalar versions
+// give the same results
 void PRadGEMAPV::CommonModeCorrection(float *buf, const uint32_t &size)
 {
-    int count = 0;
-    float average = 0;
+    float sum[2][4] = {{0., 0., 0., 0.}, {0., 0., 0., 0.}};
+    float count[2][4] = {{0., 0., 0., 0.}, {0., 0., 0., 0.}};
+    uint32_t i = 0;
+
+#ifdef __SSE2__
+    const __m128 one = _mm_set1_ps(1.);
+    __m128 sum0 = _mm_setzero_ps(), sum1 = _mm_setzero_ps();
+    __m128 cnt0 = _mm_setzero_ps(), cnt1 = _mm_setzero_ps();
+    for(; i + 4 <= size; i += 4)
+    {
+        __m128 val = _mm_sub_ps(_mm_load_ps(&ped_offset[i]), _mm_loadu_ps(&buf[i]));
+        _mm_storeu_ps(&buf[i], val);
+
+        __m128 group = _mm_castsi128_ps(_mm_load_si128((const __m128i*) &cm_split[i]));
+        __m128 under = _mm_cmplt_ps(val, _mm_load_ps(&cm_thres[i]));
+        __m128 under_val = _mm_and_ps(under, val);
+        __m128 under_cnt = _mm_and_ps(under, one);
+
+        sum0 = _mm_add_ps(sum0, _mm_andnot_ps(group, under_val));
+        sum1 = _mm_add_ps(sum1, _mm_and_ps(group, under_val));
+        cnt0 = _mm_add_ps(cnt0, _mm_andnot_ps(group, under_cnt));
+        cnt1 = _mm_add_ps(cnt1, _mm_and_ps(group, under_cnt));
+    }
+    _mm_storeu_ps(sum[0], sum0);
+    _mm_storeu_ps(sum[1], sum1);
+    _mm_storeu_ps(count[0], cnt0);
+    _mm_storeu_ps(count[1], cnt1);
+#endif
 
-    for(uint32_t i = 0; i < size; ++i)
+    for(; i < size; ++i)
     {
-        buf[i] = pedestal[i].offset - buf[i];
+        buf[i] = ped_offset[i] - buf[i];
 
-        if(buf[i] < pedestal[i].noise * common_thres) {
-            average += buf[i];
-            count++;
+        if(buf[i] < cm_thres[i]) {
+            int group = cm_split[i] ? 1 : 0;
+            sum[group][i & 3] += buf[i];
+            count[group][i & 3] += 1.;
         }
     }
 
-    if(count)
-        average /= (float)count;
-
-    for(uint32_t i = 0; i < size; ++i)
+    float average[2];
+    for(int k = 0; k < 2; ++k)
     {
-        buf[i] -= average;
+        float total = (sum[k][0] + sum[k][1]) + (sum[k][2] + sum[k][3]);
+        float n = (count[k][0] + count[k][1]) + (count[k][2] + count[k][3]);
+        average[k] = (n > 0.) ? total/n : 0.;
     }
-}
 
-// do common mode correction for split APV
-void PRadGEMAPV::CommonModeCorrection_Split(float *buf, const uint32_t &size)
-{
-    int count1 = 0, count2 = 0;
-    float average1 = 0, average2 = 0;
+    i = 0;
 
-    for(uint32_t i = 0; i < size; ++i)
+#ifdef __SSE2__
+    const __m128 ave0 = _mm_set1_ps(average[0]), ave1 = _mm_set1_ps(average[1]);
+    for(; i + 4 <= size; i += 4)
     {
-        buf[i] = pedestal[i].offset - buf[i];
-        if(strip_map[i].local < 16) {
-            if(buf[i] < pedestal[i].noise * common_thres * 10.) {
-                average1 += buf[i];
-                count1++;
-            }
-        } else {
-            if(buf[i] < pedestal[i].noise * common_thres) {
-                average2 += buf[i];
-                count2++;
-            }
-        }
+        __m128 group = _mm_castsi128_ps(_mm_load_si128((const __m128i*) &cm_split[i]));
+        __m128 ave = _mm_or_ps(_mm_andnot_ps(group, ave0), _mm_and_ps(group, ave1));
+        _mm_storeu_ps(&buf[i], _mm_sub_ps(_mm_loadu_ps(&buf[i]), ave));
     }
+#endif
 
-    if(count1)
-        average1 /= (float)count1;
-    if(count2)
-        average2 /= (float)count2;
-
-    for(uint32_t i = 0; i < size; ++i)
+    for(; i < size; ++i)
     {
-        if(strip_map[i].local < 16)
-            buf[i] -= average1;
-        else
-            buf[i] -= average2;
+        buf[i] -= average[cm_split[i] ? 1 : 0];
     }
 }
 
@@ -765,6 +951,23 @@ const
     return hist_list;
 }
 
+// get the pedestal estimators of a channel, return nullptr if they do not exist
+const PRadGEMAPV::PedestalStat *PRadGEMAPV::GetOffsetStat(const uint32_t &ch)
+const
+{
+    if(!offset_stat || ch >= APV_CHANNEL_SIZE)
+        return nullptr;
+    return &offset_stat[ch];
+}
+
+const PRadGEMAPV::PedestalStat *PRadGEMAPV::GetNoiseStat(const uint32_t &ch)
+const
+{
+    if(!noise_stat || ch >= APV_CHANNEL_SIZE)
+        return nullptr;
+    return &noise_stat[ch];
+}
+
 // pack all pedestal info into a vector and return
 std::vector<PRadGEMAPV::Pedestal> PRadGEMAPV::GetPedestalList()
 const
@@ -782,7 +985,7 @@ const
 float PRadGEMAPV::GetMaxCharge(const uint32_t &ch)
 const
 {
-    if(ch >= APV_CHANNEL_SIZE || !hit_pos[ch])
+    if(ch >= APV_CHANNEL_SIZE || !isHit(ch))
         return 0.;
 
     float val = 0.;
@@ -800,7 +1003,7 @@ const
 float PRadGEMAPV::GetIntegratedCharge(const uint32_t &ch)
 const
 {
-    if(ch >= APV_CHANNEL_SIZE || !hit_pos[ch])
+    if(ch >= APV_CHANNEL_SIZE || !isHit(ch))
         return 0.;
 
     float val = 0.;
@@ -816,7 +1019,7 @@ const
 float PRadGEMAPV::GetAveragedCharge(const uint32_t &ch)
 const
 {
-    if(ch >= APV_CHANNEL_SIZE || !hit_pos[ch])
+    if(ch >= APV_CHANNEL_SIZE || !isHit(ch))
         return 0.;
 
     float val = 0.;
@@ -832,7 +1035,7 @@ const
 bool PRadGEMAPV::IsCrossTalkStrip(const uint32_t &ch)
 const
 {
-    if(ch >= APV_CHANNEL_SIZE || !hit_pos[ch])
+    if(ch >= APV_CHANNEL_SIZE || !isHit(ch))
         return false;
 
     float max_charge = GetMaxCharge(ch);
@@ -851,20 +1054,6 @@ const
 // Private Member Functions                                                   //
 //============================================================================//
 
-// Compare the data with header level and find where the time sample data begin
-uint32_t PRadGEMAPV::getTimeSampleStart()
-{
-    for(uint32_t i = 2; i < buffer_size; ++i)
-    {
-        if( (raw_data[i]   < header_level) &&
-            (raw_data[i-1] < header_level) &&
-            (raw_data[i-2] < header_level) )
-            return i + 10;
-    }
-
-    return buffer_size;
-}
-
 // get the average within one time sample
 // set is for split apv
 // if set = 0, it is normal apv, all strips are in
@@ -898,6 +1087,114 @@ void PRadGEMAPV::buildStripMap()
     {
         strip_map[i] = MapStrip(i);
     }
+
+    // split groups are from the local strip number
+    updateThresholds();
+}
+
+// update the arrays used in zero suppression, it should be called after the
+// pedestal, strip map or threshold levels are changed
+void PRadGEMAPV::updateThresholds()
+{
+    for(uint32_t i = 0; i < APV_CHANNEL_SIZE; ++i)
+        updateThreshold(i);
+}
+
+// update the zero suppression arrays for a single channel
+void PRadGEMAPV::updateThreshold(const uint32_t &ch)
+{
+    ped_offset[ch] = pedestal[ch].offset;
+    zs_thres[ch] = pedestal[ch].noise * zerosup_thres;
+
+    // the first 16 strips of a split APV have a higher threshold
+    if(split && plane && strip_map[ch].local < 16) {
+        cm_thres[ch] = pedestal[ch].noise * common_thres * 10.;
+        cm_split[ch] = 0xffffffff;
+    } else {
+        cm_thres[ch] = pedestal[ch].noise * common_thres;
+        cm_split[ch] = 0;
+    }
+}
+
+//============================================================================//
+// Pedestal Estimator                                                         //
+//============================================================================//
+
+// merge the other estimator in, so the samples can be filled separately
+void PRadGEMAPV::PedestalStat::Merge(const PedestalStat &that)
+{
+    // that one is not seeded, simply fill its samples
+    if(that.seed_size < PED_SEED_SIZE) {
+        for(uint32_t i = 0; i < that.seed_size; ++i)
+            Fill(that.seed[i]);
+        return;
+    }
+
+    // this one is not seeded, start from that one
+    if(seed_size < PED_SEED_SIZE) {
+        PedestalStat tmp(that);
+        for(uint32_t i = 0; i < seed_size; ++i)
+            tmp.Fill(seed[i]);
+        *this = tmp;
+        return;
+    }
+
+    rejected += that.rejected;
+    addStat(that.count, that.mean, that.m2);
+}
+
+double PRadGEMAPV::PedestalStat::Sigma()
+const
+{
+    return std::sqrt(Variance());
+}
+
+// get the seed from the first samples, the median and the median absolute
+// deviation are used so the seed won't be biased by signals
+void PRadGEMAPV::PedestalStat::seedStat()
+{
+    float buf[PED_SEED_SIZE];
+    uint32_t half = PED_SEED_SIZE/2;
+
+    std::copy(seed, seed + PED_SEED_SIZE, buf);
+    std::nth_element(buf, buf + half, buf + PED_SEED_SIZE);
+    float median = buf[half];
+
+    for(uint32_t i = 0; i < PED_SEED_SIZE; ++i)
+        buf[i] = std::abs(seed[i] - median);
+    std::nth_element(buf, buf + half, buf + PED_SEED_SIZE);
+    // scale factor of MAD to sigma for Gaussian distribution
+    float sigma = 1.4826*buf[half];
+
+    count = 0;
+    mean = 0.;
+    m2 = 0.;
+    for(uint32_t i = 0; i < PED_SEED_SIZE; ++i)
+    {
+        double delta = seed[i] - median;
+        if(sigma > 0. && std::abs(delta) > PED_REJECT_LEVEL*sigma) {
+            ++rejected;
+            continue;
+        }
+
+        delta = seed[i] - mean;
+        ++count;
+        mean += delta/count;
+        m2 += delta*(seed[i] - mean);
+    }
+}
+
+// combine the mean and variance (Chan et al.)
+void PRadGEMAPV::PedestalStat::addStat(const uint32_t &n, const double &m, const double &s2)
+{
+    if(n == 0)
+        return;
+
+    uint32_t total = count + n;
+    double delta = m - mean;
+    mean += delta*n/total;
+    m2 += s2 + delta*delta*count*n/total;
+    count = total;
 }
 
 //============================================================================//
@@ -14,6 +14,7 @@
 #include <iomanip>
 #include <algorithm>
 #include <vector>
+#include <cmath>
 #include "PRadGEMCluster.h"
 #include "PRadGEMDetector.h"
 
@@ -45,6 +46,44 @@ void PRadGEMCluster::Configure(const std::string &path)
     split_cluster_diff = getDefConfig<float>("Split Threshold", 14, verbose);
     cross_talk_width = getDefConfig<float>("Cross Talk Width", 2, verbose);
 
+    // X/Y pairing, by default all the combinations are kept
+    std::string mode = getDefConfig<std::string>("XY Pairing", "All", verbose);
+    pairing_mode = Pairing_All;
+    for(int i = 0; i < Max_PairingModes; ++i)
+    {
+        if(ConfigParser::strcmp_case_insensitive(mode, GetPairingModeName(i)))
+            pairing_mode = i;
+    }
+    if(!ConfigParser::strcmp_case_insensitive(mode, GetPairingModeName(pairing_mode))) {
+        std::cout << "PRad GEM Cluster Warning: Unknown XY pairing mode "
+                  << mode << ", all the combinations will be kept."
+                  << std::endl;
+    }
+    pairing_topk = getDefConfig<unsigned int>("XY Pairing Top K", 2, verbose);
+    pairing_ratio = getDefConfig<float>("XY Charge Ratio", 1.0, verbose);
+    pairing_charge_sigma = getDefConfig<float>("XY Charge Sigma", 0.3, verbose);
+    pairing_peak_sigma = getDefConfig<float>("XY Peak Sigma", 0.4, verbose);
+    pairing_max_chi2 = getDefConfig<float>("XY Max Chi2", 16, verbose);
+    // the chi2 takes log of the ratio and divides by the sigmas
+    if(pairing_ratio <= 0.) {
+        std::cout << "PRad GEM Cluster Warning: Non-positive XY charge ratio "
+                  << pairing_ratio << ", use 1.0 instead."
+                  << std::endl;
+        pairing_ratio = 1.0;
+    }
+    if(pairing_charge_sigma <= 0.) {
+        std::cout << "PRad GEM Cluster Warning: Non-positive XY charge sigma "
+                  << pairing_charge_sigma << ", use 0.3 instead."
+                  << std::endl;
+        pairing_charge_sigma = 0.3;
+    }
+    if(pairing_peak_sigma <= 0.) {
+        std::cout << "PRad GEM Cluster Warning: Non-positive XY peak sigma "
+                  << pairing_peak_sigma << ", use 0.4 instead."
+                  << std::endl;
+        pairing_peak_sigma = 0.4;
+    }
+
     // get cross talk characteristic distance
     charac_distance.clear();
     std::string dist_str = GetConfig<std::string>("Characteristic Distance");
@@ -55,98 +94,165 @@ void PRadGEMCluster::Configure(const std::string &path)
 	    dists.pop_front();
 	    charac_distance.push_back(std::stod(dist)); // convert string to double and save it
     }
+
+    // merge the overlapped windows for searching the cross talk clusters
+    cross_talk_windows.clear();
+    for(auto &dist : charac_distance)
+        cross_talk_windows.emplace_back(dist - cross_talk_width, dist + cross_talk_width);
+    std::sort(cross_talk_windows.begin(), cross_talk_windows.end());
+
+    size_t nwin = 0;
+    for(size_t i = 0; i < cross_talk_windows.size(); ++i)
+    {
+        if(nwin && cross_talk_windows[i].first <= cross_talk_windows[nwin - 1].second)
+            cross_talk_windows[nwin - 1].second = std::max(cross_talk_windows[nwin - 1].second,
+                                                           cross_talk_windows[i].second);
+        else
+            cross_talk_windows[nwin++] = cross_talk_windows[i];
+    }
+    cross_talk_windows.resize(nwin);
 }
 
 // group hits into clusters
-void PRadGEMCluster::FormClusters(std::vector<StripHit> &hits,
+void PRadGEMCluster::FormClusters(const std::vector<StripHit> &hits,
                                   std::vector<StripCluster> &clusters)
 const
 {
     // clean container first
     clusters.clear();
 
+    if(hits.empty())
+        return;
+
+    // the clusters are the ranges of this buffer, which has the hits sorted by
+    // their strip numbers
+    std::vector<StripHit> buf;
+    std::vector<ClusterRange> ranges;
+    sortHits(hits, buf);
+
     // group consecutive hits as the preliminary clusters
-    groupHits(hits, clusters);
+    groupHits(buf, 0, buf.size(), ranges);
 
     // split the clusters that may contain multiple physical hits
-    splitCluster(clusters);
+    splitCluster(buf, ranges);
 
     // reconstruct the cluster position
-    reconstructCluster(clusters);
+    reconstructCluster(buf, ranges);
 
     // remove the clusters that does not pass certain criteria
-    filterCluster(clusters);
+    filterCluster(buf, ranges);
+
+    // fill the output clusters
+    clusters.reserve(ranges.size());
+    for(auto &range : ranges)
+    {
+        clusters.emplace_back(std::vector<StripHit>(buf.begin() + range.begin,
+                                                    buf.begin() + range.end));
+        StripCluster &cluster = clusters.back();
+        cluster.position = range.position;
+        cluster.peak_charge = range.peak_charge;
+        cluster.total_charge = range.total_charge;
+    }
+}
+
+// sort the hits by their strip numbers
+// it is a counting sort since the strip numbers are bounded by plane capacity
+void PRadGEMCluster::sortHits(const std::vector<StripHit> &hits,
+                              std::vector<StripHit> &buf)
+const
+{
+    int min_strip = hits.front().strip, max_strip = hits.front().strip;
+    for(auto &hit : hits)
+    {
+        min_strip = std::min(min_strip, hit.strip);
+        max_strip = std::max(max_strip, hit.strip);
+    }
+
+    // count the hits on each strip, and convert the counts to the offsets
+    std::vector<uint32_t> offset(max_strip - min_strip + 2, 0);
+    for(auto &hit : hits)
+        ++offset[hit.strip - min_strip + 1];
+    for(size_t i = 1; i < offset.size(); ++i)
+        offset[i] += offset[i - 1];
+
+    buf.resize(hits.size());
+    for(auto &hit : hits)
+        buf[offset[hit.strip - min_strip]++] = hit;
 }
 
 // used for separate hits of overlapped APVs
 #define IS_FROM_APV_SET1(hit) ( ((hit).apv_addr == APVAddress(1, 8)) || \
                                 ((hit).apv_addr == APVAddress(6, 8)) )
 
-// group consecutive hits
-void PRadGEMCluster::groupHits(std::vector<StripHit> &hits,
-                               std::vector<StripCluster> &clusters)
+// group consecutive hits in the sorted buffer range [begin, end)
+void PRadGEMCluster::groupHits(std::vector<StripHit> &buf,
+                               size_t begin, size_t end,
+                               std::vector<ClusterRange> &clusters)
 const
 {
-    // sort the hits by its strip number
-    std::sort(hits.begin(), hits.end(),
-              // lamda expr, compare hit by their strip numbers
-              [](const StripHit &h1, const StripHit &h2)
-              {
-                  return h1.strip < h2.strip;
-              });
-
     // group the hits that have consecutive strip number
-    auto cluster_begin = hits.begin();
-    for(auto it = hits.begin(); it != hits.end(); ++it)
+    size_t cluster_begin = begin;
+    for(size_t i = begin; i < end; ++i)
     {
-        auto next = it + 1;
+        size_t next = i + 1;
 
         // end of list, group the last cluster
-        if(next == hits.end()) {
-            clusters.emplace_back(std::vector<StripHit>(cluster_begin, next));
+        if(next == end) {
+            clusters.emplace_back(cluster_begin, next);
             break;
         }
 
         // recursively group hits for overlapped APVs
-        if(next->strip == it->strip)
+        if(buf[next].strip == buf[i].strip)
         {
-            std::vector<StripHit> dup1, dup2;
+            // the two sets are appended to the buffer, they are still sorted
+            // no reallocation so the references are valid for push_back
+            buf.reserve(buf.size() + 2*(end - cluster_begin));
 
+            size_t dup1 = buf.size();
             // duplicate shared strips but halve the charge
-            for(auto itd = cluster_begin; itd != it; ++itd)
+            for(size_t j = cluster_begin; j < i; ++j)
             {
-                StripHit shared_hit(*itd);
-                shared_hit.charge /= 2.;
-
-                dup1.push_back(shared_hit);
-                dup2.push_back(shared_hit);
+                buf.push_back(buf[j]);
+                buf.back().charge /= 2.;
             }
-
             // dispatch the rest strips by APV address
-            for(auto itd = it; itd != hits.end(); ++itd)
+            for(size_t j = i; j < end; ++j)
+            {
+                if(IS_FROM_APV_SET1(buf[j]))
+                    buf.push_back(buf[j]);
+            }
+
+            size_t dup2 = buf.size();
+            for(size_t j = cluster_begin; j < i; ++j)
+            {
+                buf.push_back(buf[j]);
+                buf.back().charge /= 2.;
+            }
+            for(size_t j = i; j < end; ++j)
             {
-                if(IS_FROM_APV_SET1(*itd))
-                    dup1.push_back(*itd);
-                else
-                    dup2.push_back(*itd);
+                if(!IS_FROM_APV_SET1(buf[j]))
+                    buf.push_back(buf[j]);
             }
+            size_t dup_end = buf.size();
 
             // group the remaining strips into clusters
-            groupHits(dup1, clusters);
-            groupHits(dup2, clusters);
+            groupHits(buf, dup1, dup2, clusters);
+            groupHits(buf, dup2, dup_end, clusters);
 
             break; // finished all grouping, break out the entire loop
 
         // not consecutive, create a new cluster
-        } else if(next->strip - it->strip > 1) {
-            clusters.emplace_back(std::vector<StripHit>(cluster_begin, next));
+        } else if(buf[next].strip - buf[i].strip > 1) {
+            clusters.emplace_back(cluster_begin, next);
             cluster_begin = next;
         }
     }
 }
 
 // split cluster at valley
-void PRadGEMCluster::splitCluster(std::vector<StripCluster> &clusters)
+void PRadGEMCluster::splitCluster(std::vector<StripHit> &buf,
+                                  std::vector<ClusterRange> &clusters)
 const
 {
     // We are trying to find the valley that satisfies certain critieria,
@@ -155,23 +261,27 @@ const
     // will be separated, and each gets 1/2 of the charge from the overlap
     // strip.
 
-    // loop over the cluster list
-    // since the vector size is changing, it cannot use iterator
-    for(size_t i = 0; i < clusters.size(); ++i)
-    {
-        // no need to do separation if less than 3 hits
-        if(clusters[i].hits.size() < 3)
-            continue;
+    // the split clusters are placed right after the original ones, and they
+    // are also checked for further splitting
+    std::vector<ClusterRange> result;
+    result.reserve(clusters.size());
 
+    for(auto cluster : clusters)
+    {
         // new cluster for the latter part after split
-        StripCluster split_cluster;
+        ClusterRange split_cluster;
 
-        // insert the splited cluster if there is one
-        if(splitCluster_sub(clusters[i], split_cluster)) {
-            // insert keeps the original order, but has a worse performance
-            clusters.insert(clusters.begin()+i+1, split_cluster);
+        // no need to do separation if less than 3 hits
+        while(cluster.size() >= 3 && splitCluster_sub(buf, cluster, split_cluster))
+        {
+            result.push_back(cluster);
+            cluster = split_cluster;
         }
+
+        result.push_back(cluster);
     }
+
+    clusters.swap(result);
 }
 
 // This function helps splitCluster
@@ -179,48 +289,47 @@ const
 // The charge at local minimum strip will be halved, and kept for both original
 // and split clusters.
 // It returns true if a cluster is split, and vice versa
-// The split part of the original cluster c will be removed, and filled in c1
-bool PRadGEMCluster::splitCluster_sub(StripCluster &c, StripCluster &c1)
+// The split part of the original cluster c will be removed, and filled in c1,
+// they share the minimum strip in the buffer
+bool PRadGEMCluster::splitCluster_sub(std::vector<StripHit> &buf,
+                                      ClusterRange &c,
+                                      ClusterRange &c1)
 const
 {
-    // we use 2 consecutive iterator
-    auto it = c.hits.begin();
-    auto it_next = it + 1;
-
     // loop to find the local minimum
     bool descending = false, extremum = false;
-    auto minimum = it;
-    for(; it_next != c.hits.end(); ++it, ++it_next)
+    size_t minimum = c.begin;
+    for(size_t i = c.begin; i + 1 < c.end; ++i)
     {
         if(descending) {
             // update minimum
-            if(it->charge < minimum->charge)
-                minimum = it;
+            if(buf[i].charge < buf[minimum].charge)
+                minimum = i;
 
             // transcending trend, confirm a local minimum (valley)
-            if(it_next->charge - it->charge > split_cluster_diff) {
+            if(buf[i + 1].charge - buf[i].charge > split_cluster_diff) {
                 extremum = true;
                 // only needs the first local minimum, thus exit the loop
                 break;
             }
         } else {
             // descending trend, expect a local minimum
-            if(it->charge - it_next->charge > split_cluster_diff) {
+            if(buf[i].charge - buf[i + 1].charge > split_cluster_diff) {
                 descending = true;
-                minimum = it_next;
+                minimum = i + 1;
             }
         }
     }
 
     if(extremum) {
         // half the charge of overlap strip
-        minimum->charge /= 2.;
+        buf[minimum].charge /= 2.;
 
         // new split cluster
-        c1 = StripCluster(std::vector<StripHit>(minimum, c.hits.end()));
+        c1 = ClusterRange(minimum, c.end);
 
         // remove the hits that are moved into new cluster, but keep the minimum
-        c.hits.erase(std::next(minimum, 1), c.hits.end());
+        c.end = minimum + 1;
     }
 
     return extremum;
@@ -228,42 +337,106 @@ const
 
 // filter out bad clusters
 #define MAX_CLUSTER_WIDTH 2.0
-void PRadGEMCluster::filterCluster(std::vector<StripCluster> &clusters)
+void PRadGEMCluster::filterCluster(const std::vector<StripHit> &buf,
+                                   std::vector<ClusterRange> &clusters)
 const
 {
     // remove cluster that has too less/many hits
-    for(auto it = clusters.begin(); it != clusters.end(); ++it)
-    {
-        if((it->hits.size() < min_cluster_hits) ||
-           (it->hits.size() > max_cluster_hits))
-            clusters.erase(it--);
-    }
+    clusters.erase(std::remove_if(clusters.begin(), clusters.end(),
+                                  [this] (const ClusterRange &c)
+                                  {
+                                      return (c.size() < min_cluster_hits) ||
+                                             (c.size() > max_cluster_hits);
+                                  }),
+                   clusters.end());
+
+    // sort the clusters by position, so the clusters at the characteristic
+    // distances can be found by binary search
+    std::vector<size_t> order(clusters.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::sort(order.begin(), order.end(),
+              [&clusters] (const size_t &i, const size_t &j)
+              {
+                  return clusters[i].position < clusters[j].position;
+              });
+
+    std::vector<float> positions(order.size());
+    for(size_t i = 0; i < order.size(); ++i)
+        positions[i] = clusters[order[i]].position;
 
     // remove cross talk cluster
-    for(auto it = clusters.begin(); it != clusters.end(); ++it)
+    // the removed clusters are not used to identify the others
+    std::vector<char> keep(clusters.size(), 1);
+    for(size_t i = 0; i < clusters.size(); ++i)
     {
-	    if(filterCrossTalk(*it, clusters)) {
-            clusters.erase(it--);
-        }
+        if(filterCrossTalk(buf, clusters, i, order, positions, keep))
+            keep[i] = 0;
     }
 
+    // compact the kept clusters, the order is not changed
+    size_t nkeep = 0;
+    for(size_t i = 0; i < clusters.size(); ++i)
+    {
+        if(keep[i])
+            clusters[nkeep++] = clusters[i];
+    }
+    clusters.resize(nkeep);
 }
 
-bool PRadGEMCluster::filterCrossTalk(const StripCluster &cluster,
-                                     const std::vector<StripCluster> &clusters)
+// margin for searching the clusters in windows, the distance is checked again
+#define CROSS_TALK_MARGIN 1e-3
+bool PRadGEMCluster::filterCrossTalk(const std::vector<StripHit> &buf,
+                                     const std::vector<ClusterRange> &clusters,
+                                     const size_t &idx,
+                                     const std::vector<size_t> &order,
+                                     const std::vector<float> &positions,
+                                     const std::vector<char> &keep)
 const
 {
-    if(!cluster.IsCrossTalk())
-        return false;
+    const ClusterRange &cluster = clusters[idx];
 
-    for(auto it = clusters.begin(); it != clusters.end(); ++it)
+    // cross talk cluster only has cross talk strips
+    for(size_t i = cluster.begin; i < cluster.end; ++i)
     {
-        double delta = fabs(it->position - cluster.position);
+        if(!buf[i].cross_talk)
+            return false;
+    }
 
-        for(auto &dist : charac_distance)
+    // check the clusters with positions in [lo, hi]
+    auto check_range = [&] (double lo, double hi)
+    {
+        auto first = std::lower_bound(positions.begin(), positions.end(), lo);
+        auto last = std::upper_bound(first, positions.end(), hi);
+        for(auto it = first; it != last; ++it)
         {
-            if(delta > dist - cross_talk_width &&
-               delta < dist + cross_talk_width)
+            const size_t &j = order[it - positions.begin()];
+            if(!keep[j])
+                continue;
+
+            double delta = fabs(clusters[j].position - cluster.position);
+
+            for(auto &dist : charac_distance)
+            {
+                if(delta > dist - cross_talk_width &&
+                   delta < dist + cross_talk_width)
+                    return true;
+            }
+        }
+        return false;
+    };
+
+    double pos = cluster.position;
+    for(auto &win : cross_talk_windows)
+    {
+        double lo = win.first - CROSS_TALK_MARGIN;
+        double hi = win.second + CROSS_TALK_MARGIN;
+
+        if(lo <= 0.) {
+            if(check_range(pos - hi, pos + hi))
+                return true;
+        } else {
+            if(check_range(pos + lo, pos + hi) || check_range(pos - hi, pos - lo))
                 return true;
         }
     }
@@ -273,7 +446,8 @@ const
 
 // calculate the cluster position
 // it reconstruct the position of cluster using linear weight of charge portion
-void PRadGEMCluster::reconstructCluster(std::vector<StripCluster> &clusters)
+void PRadGEMCluster::reconstructCluster(const std::vector<StripHit> &buf,
+                                        std::vector<ClusterRange> &clusters)
 const
 {
     for(auto &c : clusters)
@@ -284,11 +458,12 @@ const
         float weight_pos = 0.;
 
         // no hits
-        if(!c.hits.size())
+        if(!c.size())
             continue;
 
-        for(auto &hit : c.hits)
+        for(size_t i = c.begin; i < c.end; ++i)
         {
+            const StripHit &hit = buf[i];
             if(c.peak_charge < hit.charge)
                 c.peak_charge = hit.charge;
 
@@ -303,6 +478,9 @@ const
 
 // this function accepts x, y clusters from detectors and then form GEM Cluster
 // it return the number of clusters
+// the X and Y clusters from the same particle should have correlated charges,
+// so the pairs can be selected by the charge and peak ratios if the pairing
+// mode is not Pairing_All
 void PRadGEMCluster::CartesianReconstruct(const std::vector<StripCluster> &x_cluster,
                                           const std::vector<StripCluster> &y_cluster,
                                           std::vector<GEMHit> &container,
@@ -312,12 +490,66 @@ const
     // empty first
     container.clear();
 
-    // TODO, probably add some criteria here to filter out some bad clusters
-    // fill possible clusters in
-    for(auto &xc : x_cluster)
+    size_t nx = x_cluster.size(), ny = y_cluster.size();
+    std::vector<char> keep(nx*ny, (pairing_mode == Pairing_All) ? 1 : 0);
+
+    if(pairing_mode != Pairing_All) {
+        // score all the pairs, and sort them from the best one
+        struct XYPair
+        {
+            size_t ix, iy;
+            float chi2;
+        };
+
+        std::vector<XYPair> pairs;
+        pairs.reserve(nx*ny);
+        for(size_t ix = 0; ix < nx; ++ix)
+        {
+            for(size_t iy = 0; iy < ny; ++iy)
+            {
+                float chi2 = PairChi2(x_cluster[ix], y_cluster[iy]);
+                if(chi2 < pairing_max_chi2)
+                    pairs.push_back(XYPair{ix, iy, chi2});
+            }
+        }
+
+        std::stable_sort(pairs.begin(), pairs.end(),
+                         [] (const XYPair &p1, const XYPair &p2)
+                         {
+                             return p1.chi2 < p2.chi2;
+                         });
+
+        // rank of the visited pairs for each cluster
+        std::vector<unsigned int> rank_x(nx, 0), rank_y(ny, 0);
+        for(auto &p : pairs)
+        {
+            if(pairing_mode == Pairing_Best) {
+                // each cluster is only used once
+                if(!rank_x[p.ix] && !rank_y[p.iy]) {
+                    keep[p.ix*ny + p.iy] = 1;
+                    rank_x[p.ix] = 1;
+                    rank_y[p.iy] = 1;
+                }
+            } else {
+                // among the K best pairs of either cluster
+                if(rank_x[p.ix] < pairing_topk || rank_y[p.iy] < pairing_topk)
+                    keep[p.ix*ny + p.iy] = 1;
+                ++rank_x[p.ix];
+                ++rank_y[p.iy];
+            }
+        }
+    }
+
+    // fill possible clusters in, keep the order of X and Y clusters
+    for(size_t ix = 0; ix < nx; ++ix)
     {
-        for(auto &yc : y_cluster)
+        auto &xc = x_cluster[ix];
+        for(size_t iy = 0; iy < ny; ++iy)
         {
+            if(!keep[ix*ny + iy])
+                continue;
+
+            auto &yc = y_cluster[iy];
             container.emplace_back(xc.position, yc.position, 0.,        // by default z = 0
                                    det_id,                              // detector id
                                    xc.total_charge, yc.total_charge,    // fill in total charge
@@ -326,3 +558,29 @@ const
         }
     }
 }
+
+// score of a X/Y cluster pair, smaller means more likely from the same particle
+// it is the chi2 of the log ratios of the total and peak charges
+float PRadGEMCluster::PairChi2(const StripCluster &xc, const StripCluster &yc)
+const
+{
+    if(xc.total_charge <= 0. || yc.total_charge <= 0. ||
+       xc.peak_charge <= 0. || yc.peak_charge <= 0.)
+        return pairing_max_chi2;
+
+    float log_ratio = std::log(pairing_ratio);
+    float dq = (std::log(xc.total_charge/yc.total_charge) - log_ratio)/pairing_charge_sigma;
+    float dp = (std::log(xc.peak_charge/yc.peak_charge) - log_ratio)/pairing_peak_sigma;
+
+    return dq*dq + dp*dp;
+}
+
+static const char *__gem_pairing_list[] = {"All", "Best", "TopK", "Undefined"};
+
+const char *PRadGEMCluster::GetPairingModeName(int mode)
+{
+    if(mode < 0 || mode > (int)Max_PairingModes)
+        return "";
+
+    return __gem_pairing_list[mode];
+}
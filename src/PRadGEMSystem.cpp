@@ -21,6 +21,7 @@
 #include <iomanip>
 #include <algorithm>
 #include <list>
+#include <iterator>
 #include "TFile.h"
 #include "TH1.h"
 
@@ -34,6 +35,7 @@
 PRadGEMSystem::PRadGEMSystem(const std::string &config_file, int daq_cap, int det_cap)
 : PedestalMode(false), def_ts(3), def_cth(20.), def_zth(5.), def_ctth(8.)
 {
+    initWorkers();
     daq_slots.resize(daq_cap, nullptr);
     det_slots.resize(det_cap, nullptr);
 
@@ -51,6 +53,8 @@ PRadGEMSystem::PRadGEMSystem(const PRadGEMSystem &that)
   def_ts(that.def_ts), def_cth(that.def_cth), def_zth(that.def_zth),
   def_ctth(that.def_ctth)
 {
+    initWorkers();
+
     // copy daq system first
     for(auto &fec : that.daq_slots)
     {
@@ -95,6 +99,8 @@ PRadGEMSystem::PRadGEMSystem(PRadGEMSystem &&that)
   det_name_map(std::move(that.det_name_map)), def_ts(that.def_ts),
   def_cth(that.def_cth), def_zth(that.def_zth), def_ctth(that.def_ctth)
 {
+    initWorkers();
+
     // reset the system for all components
     for(auto &fec : daq_slots)
     {
@@ -112,6 +118,9 @@ PRadGEMSystem::PRadGEMSystem(PRadGEMSystem &&that)
 // desctructor
 PRadGEMSystem::~PRadGEMSystem()
 {
+#ifdef MULTI_THREAD
+    stopWorkers();
+#endif
     Clear();
 }
 
@@ -520,27 +529,94 @@ const
 }
 
 // fill raw data to a certain apv
-void PRadGEMSystem::FillRawData(const GEMRawData &raw, EventData &event)
+void PRadGEMSystem::FillRawData(const GEMRawData &raw)
 {
     PRadGEMAPV *apv = GetAPV(raw.addr);
 
-    if(apv != nullptr) {
-
+    if(apv != nullptr)
         apv->FillRawData(raw.buf, raw.size);
+}
+
+// process the APVs filled in this event, it should be called at the end of
+// the event, after all the raw data are filled
+// each APV is an independent job, zero suppression for the physics events or
+// pedestal estimators filling for the monitor events in pedestal mode
+// the zero suppressed hits are collected in the DAQ order
+void PRadGEMSystem::ProcessRawData(EventData &event)
+{
+    event_apvs.clear();
+    for(auto &fec : daq_slots)
+    {
+        if(!fec)
+            continue;
+
+        for(uint32_t i = 0; i < fec->GetCapacity(); ++i)
+        {
+            PRadGEMAPV *apv = fec->GetAPV(i);
+            if(apv && apv->HasRawData())
+                event_apvs.push_back(apv);
+        }
+    }
+
+    if(event_apvs.empty())
+        return;
+
+    event_ped = event.is_monitor_event();
+
+    // nothing to do for monitor events if not in pedestal mode
+    if(event_ped && !PedestalMode) {
+        for(auto &apv : event_apvs)
+            apv->ResetRawFlag();
+        return;
+    }
+
+    if(apv_hits.size() < event_apvs.size())
+        apv_hits.resize(event_apvs.size());
 
-        if(event.is_monitor_event()) {
-            if(PedestalMode)
-                apv->FillPedHist();
-        } else {
-            apv->ZeroSuppression();
-#ifdef MULTI_THREAD
-            __gem_locker.lock();
-#endif
-            apv->CollectZeroSupHits(event.get_gem_data());
 #ifdef MULTI_THREAD
-            __gem_locker.unlock();
-#endif
+    if(event_apvs.size() > 1) {
+        if(workers.empty())
+            startWorkers();
+
+        next_job = 0;
+        {
+            std::lock_guard<std::mutex> lock(pool_locker);
+            pending = workers.size();
+            ++generation;
         }
+        start_cond.notify_all();
+
+        // this thread also takes the jobs
+        for(uint32_t i = next_job++; i < event_apvs.size(); i = next_job++)
+            processAPV(i);
+
+        std::unique_lock<std::mutex> lock(pool_locker);
+        done_cond.wait(lock, [this] {return pending == 0;});
+    } else {
+        processAPV(0);
+    }
+#else
+    for(uint32_t i = 0; i < event_apvs.size(); ++i)
+        processAPV(i);
+#endif
+
+    if(event_ped)
+        return;
+
+    // join the hits in order
+    auto &gem_data = event.get_gem_data();
+    size_t total = gem_data.size();
+    for(uint32_t i = 0; i < event_apvs.size(); ++i)
+        total += apv_hits[i].size();
+    gem_data.reserve(total);
+
+    for(uint32_t i = 0; i < event_apvs.size(); ++i)
+    {
+        auto &hits = apv_hits[i];
+        gem_data.insert(gem_data.end(),
+                        std::make_move_iterator(hits.begin()),
+                        std::make_move_iterator(hits.end()));
+        hits.clear();
     }
 }
 
@@ -554,6 +630,7 @@ void PRadGEMSystem::Reset()
 
         fec->APVControl(&PRadGEMAPV::ClearData);
         fec->APVControl(&PRadGEMAPV::ResetPedHist);
+        fec->APVControl(&PRadGEMAPV::ResetPedStat);
     }
 
     for(auto &det : det_slots)
@@ -564,43 +641,114 @@ void PRadGEMSystem::Reset()
     }
 }
 
-// fill zero suppressed data and re-collect these data in GEM_Data format
-void PRadGEMSystem::FillZeroSupData(const std::vector<GEMZeroSupData> &data_pack,
-                                    EventData &event)
+// buffers to decode the zero suppressed data, the banks from different ROCs
+// may be decoded by several threads, so every thread has its own buffers
+static thread_local std::vector<uint32_t> __gem_zs_words;
+static thread_local std::vector<uint32_t> __gem_zs_buffer;
+static thread_local std::vector<GEM_Data> __gem_zs_hits;
+
+// sort the zero suppressed data words by (fec, adc, strip, time sample), it is
+// a stable LSD radix sort over the 18 address bits in 2 passes, the original
+// order is kept for the repeated words, the buffer is reused between events
+#define ZS_SORT_BITS 9
+#define ZS_SORT_SHIFT 12
+static void __gem_zs_sort(std::vector<uint32_t> &words, std::vector<uint32_t> &buf)
 {
-    // clear all the APVs' hits
-    for(auto &fec : daq_slots)
-    {
-        if(fec)
-            fec->APVControl(&PRadGEMAPV::ResetHitPos);
-    }
-
-    // fill in the online zero-suppressed data
-    for(auto &data : data_pack)
-        FillZeroSupData(data);
+    auto key = [] (const uint32_t &w) {return (w >> ZS_SORT_SHIFT)&0x3ffff;};
+
+    // the data are usually in order already
+    if(std::is_sorted(words.begin(), words.end(),
+                      [&key] (const uint32_t &w1, const uint32_t &w2)
+                      {
+                          return key(w1) < key(w2);
+                      }))
+        return;
 
-#ifdef MULTI_THREAD
-        __gem_locker.lock();
-#endif
-    // collect these zero-suppressed hits
-    for(auto &fec : daq_slots)
+    buf.resize(words.size());
+    const uint32_t nbins = 1 << ZS_SORT_BITS;
+    for(uint32_t pass = 0; pass < 2; ++pass)
     {
-        if(fec)
-            fec->APVControl(&PRadGEMAPV::CollectZeroSupHits, event.get_gem_data());
+        uint32_t shift = ZS_SORT_SHIFT + pass*ZS_SORT_BITS;
+        uint32_t count[nbins + 1] = {0};
+        for(auto &w : words)
+            ++count[((w >> shift)&(nbins - 1)) + 1];
+        for(uint32_t i = 1; i <= nbins; ++i)
+            count[i] += count[i - 1];
+        for(auto &w : words)
+            buf[count[(w >> shift)&(nbins - 1)]++] = w;
+        words.swap(buf);
     }
-#ifdef MULTI_THREAD
-        __gem_locker.unlock();
-#endif
 }
 
-// fill zero suppressed data
-void PRadGEMSystem::FillZeroSupData(const GEMZeroSupData &data)
+// decode the online zero suppressed data words directly to GEM_Data
+// data word structure (32 bit word)
+// detector: 1 bit
+// plane: 1 bit
+// fec id: 4 bit
+// adc channel id: 4 bit
+// strip number: 7 bit
+// time sample number: 3 bit
+// polarity: 1 bit
+// adc value: 11 bit
+// the words are sorted by (fec, adc, strip, time sample), so the hits are in
+// DAQ order, the same as the ones from zero suppression of raw data
+void PRadGEMSystem::FillZeroSupData(const GEMZeroSupData &data, EventData &event)
 {
-    PRadGEMAPV *apv = GetAPV(data.addr);
+    auto &words = __gem_zs_words;
+    words.assign(data.buf, data.buf + data.size);
+    __gem_zs_sort(words, __gem_zs_buffer);
+
+    // decode to a local container first, the event is shared by the threads
+    auto &hits = __gem_zs_hits;
+    hits.clear();
+    PRadGEMAPV *apv = nullptr;
+    uint32_t apv_key = -1, strip_key = -1;
+    GEM_Data *hit = nullptr;
 
-    if(apv != nullptr) {
-        apv->FillZeroSupData(data.channel, data.time_sample, data.adc_value);
+    for(auto &word : words)
+    {
+        uint32_t fec_id = (word >> 26)&0xf;
+        uint32_t adc_ch = (word >> 22)&0xf;
+        uint32_t channel = (word >> 15)&0x7f;
+        uint32_t ts = (word >> 12)&0x7;
+
+        // new APV
+        if(((word >> 22)&0xff) != apv_key) {
+            apv_key = (word >> 22)&0xff;
+            apv = GetAPV(fec_id, adc_ch);
+            hit = nullptr;
+            strip_key = -1;
+        }
+
+        if(apv == nullptr)
+            continue;
+
+        if(ts >= apv->GetNTimeSamples()) {
+            std::cerr << "PRad GEM System Error: Failed to fill zero suppressed data, "
+                      << "time sample " << ts << " is not allowed for APV "
+                      << adc_ch << " in FEC " << fec_id << "."
+                      << std::endl;
+            continue;
+        }
+
+        // new strip, time samples not in data are 0
+        if(channel != strip_key) {
+            strip_key = channel;
+            hits.emplace_back(fec_id, adc_ch, channel);
+            hit = &hits.back();
+            hit->values.assign(apv->GetNTimeSamples(), 0.);
+        }
+
+        hit->values[ts] = word&0x7ff;
     }
+
+#ifdef MULTI_THREAD
+    std::lock_guard<std::mutex> lock(__gem_locker);
+#endif
+    auto &gem_data = event.get_gem_data();
+    gem_data.insert(gem_data.end(),
+                    std::make_move_iterator(hits.begin()),
+                    std::make_move_iterator(hits.end()));
 }
 
 // update EventData to all APVs
@@ -678,11 +826,12 @@ const
 }
 
 // set pedestal mode on/off
-// if the pedestal mode is on, filling raw data will also fill the histograms in
-// APV for future pedestal fitting
-// turn on the pedestal mode will greatly slow down the raw data handling and
-// consume a significant amount of memories
-void PRadGEMSystem::SetPedestalMode(const bool &m)
+// if the pedestal mode is on, filling raw data will also fill the pedestal
+// estimators in APV for future pedestal fitting
+// the histograms are only created on request (for SaveHistograms), they will
+// greatly slow down the raw data handling and consume a significant amount of
+// memories
+void PRadGEMSystem::SetPedestalMode(const bool &m, const bool &hist)
 {
     PedestalMode = m;
 
@@ -691,10 +840,14 @@ void PRadGEMSystem::SetPedestalMode(const bool &m)
         if(!fec)
             continue;
 
-        if(m)
-            fec->APVControl(&PRadGEMAPV::CreatePedHist);
-        else
+        if(m) {
+            fec->APVControl(&PRadGEMAPV::CreatePedStat);
+            if(hist)
+                fec->APVControl(&PRadGEMAPV::CreatePedHist);
+        } else {
+            fec->APVControl(&PRadGEMAPV::ReleasePedStat);
             fec->APVControl(&PRadGEMAPV::ReleasePedHist);
+        }
     }
 }
 
@@ -774,6 +927,27 @@ const
 }
 
 // get the whole APV list
+// a hash of the pedestals of all APVs, it can be chained with the
+// configuration hash by using it as seed
+uint32_t PRadGEMSystem::GetCalibHash(uint32_t seed)
+const
+{
+    uint32_t hash = seed;
+    for(auto apv : GetAPVList())
+    {
+        int addr[] = {apv->GetFECID(), apv->GetADCChannel()};
+        hash = HashData(addr, sizeof(addr), hash);
+
+        for(auto &ped : apv->GetPedestalList())
+        {
+            hash = HashData(&ped.offset, sizeof(ped.offset), hash);
+            hash = HashData(&ped.noise, sizeof(ped.noise), hash);
+        }
+    }
+
+    return hash;
+}
+
 std::vector<PRadGEMAPV *> PRadGEMSystem::GetAPVList()
 const
 {
@@ -962,3 +1136,85 @@ void PRadGEMSystem::buildAPV(std::list<ConfigValue> &apv_args)
 
     pln->ConnectAPV(new_apv, index);
 }
+
+// only used in constructors, the workers are not copied or moved, they are
+// started when they are needed
+void PRadGEMSystem::initWorkers()
+{
+    event_ped = false;
+#ifdef MULTI_THREAD
+    next_job = 0;
+    generation = 0;
+    pending = 0;
+    stop = false;
+#endif
+}
+
+// process an APV in the job list, the APV and the output slot are only used
+// by this job
+void PRadGEMSystem::processAPV(uint32_t idx)
+{
+    PRadGEMAPV *apv = event_apvs[idx];
+
+    if(event_ped) {
+        apv->FillPedestal();
+    } else {
+        apv->ZeroSuppression();
+        apv->CollectZeroSupHits(apv_hits[idx]);
+    }
+
+    apv->ResetRawFlag();
+}
+
+#ifdef MULTI_THREAD
+// start the workers, the thread calling ProcessRawData also takes the jobs
+void PRadGEMSystem::startWorkers()
+{
+    unsigned int nthreads = std::thread::hardware_concurrency();
+    if(nthreads > MAX_APV_WORKERS)
+        nthreads = MAX_APV_WORKERS;
+    if(nthreads < 2)
+        nthreads = 2;
+
+    for(unsigned int i = 1; i < nthreads; ++i)
+        workers.emplace_back(&PRadGEMSystem::workerLoop, this);
+}
+
+void PRadGEMSystem::stopWorkers()
+{
+    {
+        std::lock_guard<std::mutex> lock(pool_locker);
+        stop = true;
+    }
+    start_cond.notify_all();
+
+    for(auto &worker : workers)
+        worker.join();
+    workers.clear();
+}
+
+// wait for a new event and take the APV jobs until there is none left
+void PRadGEMSystem::workerLoop()
+{
+    unsigned int done = 0;
+    while(true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(pool_locker);
+            start_cond.wait(lock, [&] {return stop || generation != done;});
+            if(stop)
+                return;
+            done = generation;
+        }
+
+        for(uint32_t i = next_job++; i < event_apvs.size(); i = next_job++)
+            processAPV(i);
+
+        {
+            std::lock_guard<std::mutex> lock(pool_locker);
+            --pending;
+        }
+        done_cond.notify_one();
+    }
+}
+#endif
@@ -9,16 +9,47 @@
 #include <cmath>
 #include <iostream>
 #include <iomanip>
+#include <deque>
+#ifdef MULTI_THREAD
+#include <mutex>
+#endif
 #include "PRadHyCalCluster.h"
 #include "PRadClusterProfile.h"
+#include "PRadTDCChannel.h"
 
 
 const PRadClusterProfile &__hc_prof = PRadClusterProfile::Instance();
 
+// geometries of the virtual modules, the virtual hits refer to them so they are
+// kept for the whole program, the same geometry is only stored once
+static std::deque<PRadHyCalModule::Geometry> __hc_vgeo;
+#ifdef MULTI_THREAD
+static std::mutex __hc_vgeo_locker;
+#endif
+
+static const PRadHyCalModule::Geometry *__hc_vgeo_get(const PRadHyCalModule::Geometry &geo)
+{
+#ifdef MULTI_THREAD
+    std::lock_guard<std::mutex> lock(__hc_vgeo_locker);
+#endif
+    for(auto &vgeo : __hc_vgeo)
+    {
+        if(vgeo.type == geo.type &&
+           vgeo.x == geo.x && vgeo.y == geo.y && vgeo.z == geo.z &&
+           vgeo.size_x == geo.size_x && vgeo.size_y == geo.size_y &&
+           vgeo.size_z == geo.size_z)
+            return &vgeo;
+    }
+
+    __hc_vgeo.push_back(geo);
+    return &__hc_vgeo.back();
+}
+
 PRadHyCalCluster::PRadHyCalCluster()
 : depth_corr(true), leak_corr(true), linear_corr(true),
   log_weight_thres(3.6), min_cluster_energy(30.), min_center_energy(10.),
-  least_leak(0.05), linear_corr_limit(0.6), min_cluster_size(1), leak_iters(3)
+  least_leak(0.05), linear_corr_limit(0.6), min_cluster_size(1), leak_iters(3),
+  use_pipeline(true), pipeline(nullptr)
 {
     // place holder
 }
@@ -52,6 +83,9 @@ void PRadHyCalCluster::Configure(const std::string &path)
     least_leak = getDefConfig<float>("Least Leakage Fraction", 0.05, verbose);
     leak_iters = getDefConfig<unsigned int>("Leakage Iterations", 3, verbose);
     linear_corr_limit = getDefConfig<float>("Non Linearity Limit", 0.6, verbose);
+    use_pipeline = getDefConfig<bool>("Specialized Pipeline", true, verbose);
+    // the methods select their own pipeline
+    pipeline = nullptr;
 
     ReadVModuleList(GetConfig<std::string>("Virtual Module List"));
 }
@@ -66,6 +100,9 @@ void PRadHyCalCluster::ReadVModuleList(const std::string &path)
 
     inner_virtual.clear();
     outer_virtual.clear();
+    // neighbors need to be rebuilt for the new list
+    inner_neighbors.clear();
+    outer_neighbors.clear();
 
     std::string name;
     std::string type, sector;
@@ -86,21 +123,46 @@ void PRadHyCalCluster::ReadVModuleList(const std::string &path)
         if(ConfigParser::str_upper(name) == "INNER") {
             ModuleHit inner_hit(false);
             inner_hit.id = -1;
-            inner_hit.geo = geo;
+            inner_hit.geo = __hc_vgeo_get(geo);
             inner_hit.sector = 0;
             inner_virtual.push_back(inner_hit);
         } else if(ConfigParser::str_upper(name) == "OUTER") {
             ModuleHit outer_hit(false);
             outer_hit.id = -1;
-            outer_hit.geo = geo;
+            outer_hit.geo = __hc_vgeo_get(geo);
             outer_hit.sector = 1;
             outer_virtual.push_back(outer_hit);
         }
     }
 }
 
+// save the virtual modules within profile reach for each module
+// it should be called when the module list or virtual module list is changed
+void PRadHyCalCluster::UpdateVModuleNeighbors(const std::vector<PRadHyCalModule*> &mlist)
+{
+    inner_neighbors.clear();
+    outer_neighbors.clear();
+
+    for(auto &module : mlist)
+    {
+        ModuleHit mhit(module, 0.);
+
+        for(auto &vhit : inner_virtual)
+        {
+            if(PRadHyCalDetector::in_profile_reach(mhit, vhit))
+                inner_neighbors[mhit.id].push_back(vhit);
+        }
+
+        for(auto &vhit : outer_virtual)
+        {
+            if(PRadHyCalDetector::in_profile_reach(mhit, vhit))
+                outer_neighbors[mhit.id].push_back(vhit);
+        }
+    }
+}
+
 void PRadHyCalCluster::FormCluster(std::vector<ModuleHit> &,
-                                   std::vector<ModuleCluster> &)
+                                   ModuleClusters &)
 const
 {
     // to be implemented by methods
@@ -119,21 +181,8 @@ const
 float PRadHyCalCluster::GetShowerDepth(int module_type, const float &E)
 const
 {
-    if(depth_corr && E > 0.) {
-        // here all the values are hard coded, because these are all physical
-        // values corresponding to the material, so no need to change
-        // it returns the maximum shower depth that
-        // t = X0*(ln(E0/Ec) - Cf),
-        // where X0 is radiation length, Ec is critical energy, Cf = -0.5 for
-        // electron induced shower and 0.5 for photon
-        // units are in mm and MeV
-        if(module_type == PRadHyCalModule::PbWO4)
-            return 8.6*(log(E/1.1) - 0.5);
-
-        // -101.2 is the surface difference between Lead Glass and Lead Tungstate modules
-        if(module_type == PRadHyCalModule::PbGlass)
-            return 26.7*(log(E/2.84) - 0.5);
-    }
+    if(depth_corr)
+        return showerDepth(module_type, E);
 
     return 0.;
 }
@@ -143,69 +192,58 @@ bool PRadHyCalCluster::CheckCluster(const ModuleCluster &cluster)
 const
 {
     if((cluster.energy < min_cluster_energy) ||
-       (cluster.hits.size() < min_cluster_size))
+       (cluster.size() < min_cluster_size))
             return false;
 
     return true;
 }
 
 // reconstruct cluster
-HyCalHit PRadHyCalCluster::Reconstruct(const ModuleCluster &cluster, const float &alpE)
+HyCalHit PRadHyCalCluster::Reconstruct(const ModuleCluster &cluster,
+                                       const ModuleHitArray &hits,
+                                       const float &alpE)
 const
 {
-    // initialize the hit
-    HyCalHit hycal_hit(cluster.center.id,       // center id
-                       cluster.center.flag,     // module flag
-                       cluster.energy,          // total energy
-                       cluster.leakage);        // energy from leakage corr
-
-    // do non-linearity energy correction
-    if(linear_corr && fabs(alpE) < linear_corr_limit) {
-        float corr = 1./(1 + alpE);
-        // save the correction factor, not alpha(E)
-        hycal_hit.lin_corr = corr;
-        hycal_hit.E *= corr;
-    }
-
-    // count modules
-    hycal_hit.nblocks = cluster.hits.size();
-
-    // fill 3x3 hits around center into temp container for position reconstruction
-    BaseHit cl[POS_RECON_HITS];
-    int count = fillHits(cl, POS_RECON_HITS, cluster.center, cluster.hits);
-
-    // record how many hits participated in position reconstruction
-    hycal_hit.npos = count;
-
-    // reconstruct position
-    reconstructPos(cl, count, (BaseHit*)&hycal_hit);
-    hycal_hit.z = cluster.center.geo.z;
-
-    // z position will need a depth correction
-    hycal_hit.z += GetShowerDepth(cluster.center.geo.type, cluster.energy);
-
-    return hycal_hit;
+    if(depth_corr)
+        return linear_corr ? reconstruct<true, true>(cluster, hits, alpE)
+                           : reconstruct<true, false>(cluster, hits, alpE);
+    else
+        return linear_corr ? reconstruct<false, true>(cluster, hits, alpE)
+                           : reconstruct<false, false>(cluster, hits, alpE);
 }
 
 // leakage correction, dead module hits will be provided by hycal detector
-void PRadHyCalCluster::LeakCorr(ModuleCluster &cluster, const std::vector<ModuleHit> &dead)
+void PRadHyCalCluster::LeakCorr(ModuleCluster &cluster,
+                                ModuleHitArray &hits,
+                                const std::vector<ModuleHit> &dead)
 const
 {
-    if(!leak_corr)
-        return;
+    if(leak_corr)
+        leakCorr(cluster, hits, dead);
+}
 
-    if(TEST_BIT(cluster.center.flag, kDeadNeighbor))
-        AddVirtHits(cluster, dead);
+// temp container for position reconstruction, it has one entry for each hit in
+// the cluster span, followed by the virtual hits, the entries out of the 3x3
+// around the center have zero energy, so the loops over it are branch free
+struct __hc_pos_buffer
+{
+    std::vector<float> x, y, E;
 
-    if(TEST_BIT(cluster.center.flag, kInnerBound))
-        AddVirtHits(cluster, inner_virtual);
+    void add(float xi, float yi, float Ei)
+    {
+        x.push_back(xi);
+        y.push_back(yi);
+        E.push_back(Ei);
+    }
+};
 
-    if(TEST_BIT(cluster.center.flag, kOuterBound))
-        AddVirtHits(cluster, outer_virtual);
-}
+// one buffer for each thread, so different cluster instances can run in parallel
+static thread_local __hc_pos_buffer __hc_pb;
 
 // add virtual hits to correct energy leakage
-void PRadHyCalCluster::AddVirtHits(ModuleCluster &cluster, const std::vector<ModuleHit> &dead)
+void PRadHyCalCluster::AddVirtHits(ModuleCluster &cluster,
+                                   ModuleHitArray &hits,
+                                   const std::vector<ModuleHit> &dead)
 const
 {
     if(dead.empty())
@@ -213,17 +251,18 @@ const
 
     const auto &center = cluster.center;
 
-    // temp container to reconstruct position
-    BaseHit cl[POS_RECON_HITS], temp_hit(center.geo.x, center.geo.y, 0., cluster.energy);
+    // temp hit to reconstruct position
+    BaseHit temp_hit(center.geo->x, center.geo->y, 0., cluster.energy);
 
     // estimator to check if virtual hits will improve the profile
-    float estimator = __hc_prof.EvalEstimator(temp_hit, cluster);
+    float estimator = __hc_prof.EvalEstimator(temp_hit, cluster, hits);
 
     // this cluster is too bad
     if(estimator > 5.)
         return;
 
     // temporty container for dead hits energies
+    // the list is expected to only have the modules within profile reach
     float dead_energy[dead.size()], temp_energy[dead.size()];
     // initialize
     for(unsigned int i = 0; i < dead.size(); ++i)
@@ -244,7 +283,7 @@ const
 
         // reconstruct position using cluster hits and dead modules
         // fill existing cluster hits
-        int count = fillHits(cl, POS_RECON_HITS, center, cluster.hits);
+        fillHits(center, cluster, hits);
 
         // fill virtual hits for dead modules
         temp_hit.E = cluster.energy;
@@ -255,19 +294,16 @@ const
 
             const auto &hit = dead.at(i);
             if(PRadHyCalDetector::hit_distance(center, hit) < CORNER_ADJACENT) {
-                cl[count].x = hit.geo.x;
-                cl[count].y = hit.geo.y;
-                cl[count].E = temp_energy[i];
+                __hc_pb.add(hit.geo->x, hit.geo->y, temp_energy[i]);
                 temp_hit.E += temp_energy[i];
-                count++;
             }
         }
 
         // reconstruct position
-        reconstructPos(cl, count, &temp_hit);
+        reconstructPos(&temp_hit);
 
         // check if the correction helps improve the cluster profile
-        float new_est = __hc_prof.EvalEstimator(temp_hit, cluster);
+        float new_est = __hc_prof.EvalEstimator(temp_hit, cluster, hits);
         // not improving, stop!
         if(new_est > estimator)
             break;
@@ -289,7 +325,7 @@ const
             // add virtual hit
             ModuleHit vhit(dead.at(i));
             vhit.energy = dead_energy[i];
-            cluster.AddHit(vhit);
+            hits.AddHit(cluster, vhit);
 
             // record leakage correction
             cluster.leakage += vhit.energy;
@@ -297,52 +333,102 @@ const
     }
 }
 
-// only use the center 3x3 to fill the temp container
-inline int PRadHyCalCluster::fillHits(BaseHit *temp,
-                                      int max_hits,
-                                      const ModuleHit &center,
-                                      const std::vector<ModuleHit> &hits)
+// get the virtual modules within profile reach of the center
+// the whole list is returned if the neighbors are not built
+const std::vector<ModuleHit> &PRadHyCalCluster::getVModuleNeighbors(const ModuleHit &center,
+                                                                    const std::vector<ModuleHit> &vlist,
+                                                                    const VModuleMap &neighbors)
+const
+{
+    static const std::vector<ModuleHit> no_neighbors;
+
+    if(neighbors.empty())
+        return vlist;
+
+    auto it = neighbors.find(center.id);
+    if(it == neighbors.end())
+        return no_neighbors;
+    return it->second;
+}
+
+// only use the center 3x3 to fill the temp container, it returns the number
+// of hits selected for position reconstruction
+inline int PRadHyCalCluster::fillHits(const ModuleHit &center,
+                                      const ModuleCluster &cluster,
+                                      const ModuleHitArray &hits)
 const
 {
+    auto &pb = __hc_pb;
+    const size_t nh = cluster.size();
+    const float *x = hits.x.data() + cluster.begin, *y = hits.y.data() + cluster.begin;
+    const float *sx = hits.size_x.data() + cluster.begin;
+    const float *sy = hits.size_y.data() + cluster.begin;
+    const float *energy = hits.energy.data() + cluster.begin;
+
+    pb.x.assign(x, x + nh);
+    pb.y.assign(y, y + nh);
+    pb.E.resize(nh);
+    float *pE = pb.E.data();
+    const float cx = center.geo->x, cy = center.geo->y;
+    const float csx = center.geo->size_x, csy = center.geo->size_y;
+    // hit_distance() < CORNER_ADJACENT, without the square root
+    const float adj2 = CORNER_ADJACENT*CORNER_ADJACENT/4.;
+
     int count = 0;
-    for(auto &hit : hits)
+    for(size_t i = 0; i < nh; ++i)
     {
-        if(count >= max_hits) {
-            std::cout << "PRad HyCal Cluster Warning: Exceeds the "
-                      << "hits limit (" << max_hits << ") "
-                      << "for  position reconstruction."
-                      << std::endl;
-            break;
-        }
+        float dx = (x[i] - cx)/(sx[i] + csx);
+        float dy = (y[i] - cy)/(sy[i] + csy);
+        bool adjacent = (dx*dx + dy*dy < adj2);
+        float e = energy[i];
+        pE[i] = adjacent ? e : 0.f;
+        count += adjacent;
+    }
+
+    if(count > POS_RECON_HITS) {
+        std::cout << "PRad HyCal Cluster Warning: Exceeds the "
+                  << "hits limit (" << POS_RECON_HITS << ") "
+                  << "for  position reconstruction."
+                  << std::endl;
 
-        if(PRadHyCalDetector::hit_distance(center, hit) < CORNER_ADJACENT) {
-            temp[count].x = hit.geo.x;
-            temp[count].y = hit.geo.y;
-            temp[count].E = hit.energy;
-            count++;
+        // only keep the first hits within the limit
+        int kept = 0;
+        for(size_t i = 0; i < nh; ++i)
+        {
+            float dx = (x[i] - cx)/(sx[i] + csx);
+            float dy = (y[i] - cy)/(sy[i] + csy);
+            if(dx*dx + dy*dy < adj2 && ++kept > POS_RECON_HITS)
+                pE[i] = 0.;
         }
+        count = POS_RECON_HITS;
     }
+
     return count;
 }
 
 // reconstruct position from the temp container
-void PRadHyCalCluster::reconstructPos(BaseHit *temp, int count, BaseHit *recon)
+void PRadHyCalCluster::reconstructPos(BaseHit *recon)
 const
 {
+    auto &pb = __hc_pb;
+    const size_t nh = pb.E.size();
+    const float *x = pb.x.data(), *y = pb.y.data(), *E = pb.E.data();
+
     // get total energy
     float energy = 0;
-    for(int i= 0; i < count; ++i)
+    for(size_t i = 0; i < nh; ++i)
     {
-        energy += temp[i].E;
+        energy += E[i];
     }
 
-    // reconstruct position
+    // reconstruct position, same weights as GetWeight()
     float wx = 0, wy = 0, wtot = 0;
-    for(int i = 0; i < count; ++i)
+    for(size_t i = 0; i < nh; ++i)
     {
-        float weight = GetWeight(temp[i].E, energy);
-        wx += temp[i].x*weight;
-        wy += temp[i].y*weight;
+        float w = (E[i] > 0.) ? log_weight_thres + log(E[i]/energy) : 0.;
+        float weight = (w > 0.) ? w : 0.;
+        wx += x[i]*weight;
+        wy += y[i]*weight;
         wtot += weight;
     }
 
@@ -351,7 +437,9 @@ const
 }
 
 // correct virtual hits energy if we know the real positon (from other detector)
-void PRadHyCalCluster::CorrectVirtHits(ModuleCluster &cluster, float x, float y)
+void PRadHyCalCluster::CorrectVirtHits(ModuleCluster &cluster,
+                                       ModuleHitArray &hits,
+                                       float x, float y)
 const
 {
     // no need to correct
@@ -363,25 +451,160 @@ const
     cluster.leakage = 0.;
 
     // change virtual hits
-    for(auto it = cluster.hits.begin(); it != cluster.hits.end(); ++it)
+    unsigned int i = cluster.begin;
+    while(i < cluster.end)
     {
         // real hit, no need to correct
-        if(it->real)
+        if(hits.real[i]) {
+            ++i;
             continue;
+        }
 
         // check profile
-        float frac = __hc_prof.GetProfile(x, y, *it).frac;
+        float frac = __hc_prof.GetProfile(x, y, hits.get(i)).frac;
 
         // full energy correction because we trust the position
         if(frac > 0. && frac < 1.) {
-            it->energy = cluster.energy*frac/(1 - frac);
-            cluster.leakage += it->energy;
+            hits.energy[i] = cluster.energy*frac/(1 - frac);
+            cluster.leakage += hits.energy[i];
+            ++i;
         // remove virtual hit if its energy should be zero
         } else {
-            cluster.hits.erase(it--);
+            hits.RemoveHit(cluster, i);
         }
     }
 
     // update energy
     cluster.energy += cluster.leakage;
 }
+
+// get the specialized pipeline for the correction flags
+PRadHyCalCluster::Pipeline PRadHyCalCluster::getPipeline(bool leak, bool depth, bool linear)
+{
+    static const Pipeline pipelines[8] = {
+        &PRadHyCalCluster::reconstructClusters<false, false, false>,
+        &PRadHyCalCluster::reconstructClusters<false, false, true>,
+        &PRadHyCalCluster::reconstructClusters<false, true, false>,
+        &PRadHyCalCluster::reconstructClusters<false, true, true>,
+        &PRadHyCalCluster::reconstructClusters<true, false, false>,
+        &PRadHyCalCluster::reconstructClusters<true, false, true>,
+        &PRadHyCalCluster::reconstructClusters<true, true, false>,
+        &PRadHyCalCluster::reconstructClusters<true, true, true>,
+    };
+
+    return pipelines[(leak ? 4 : 0) + (depth ? 2 : 0) + (linear ? 1 : 0)];
+}
+
+//============================================================================//
+// Private Member Functions                                                   //
+//============================================================================//
+
+// the same procedure as PRadHyCalDetector::ReconstructHits, but the stages are
+// called directly and the disabled corrections are compiled out
+template<bool LEAK, bool DEPTH, bool LINEAR>
+void PRadHyCalCluster::reconstructClusters(const PRadHyCalDetector *det,
+                                           ModuleClusters &clusters,
+                                           std::vector<HyCalHit> &hits,
+                                           const EventData *event)
+const
+{
+    hits.clear();
+
+    for(auto &cluster : clusters)
+    {
+        if(!PRadHyCalCluster::CheckCluster(cluster))
+            continue;
+
+        if(LEAK)
+            leakCorr(cluster, clusters.hits, det->GetDeadNeighbors(cluster.center.id));
+
+        PRadHyCalModule *center = det->GetModule(cluster.center.id);
+
+        float lin_corr = 0.;
+        if(LINEAR)
+            lin_corr = center->GetCalibConst().NonLinearCorr(cluster.energy);
+
+        hits.emplace_back(reconstruct<DEPTH, LINEAR>(cluster, clusters.hits, lin_corr));
+
+        PRadHyCalDetector::set_hit_time(hits.back(), center, event);
+    }
+}
+
+template<bool DEPTH, bool LINEAR>
+HyCalHit PRadHyCalCluster::reconstruct(const ModuleCluster &cluster,
+                                       const ModuleHitArray &hits,
+                                       const float &alpE)
+const
+{
+    // initialize the hit
+    HyCalHit hycal_hit(cluster.center.id,       // center id
+                       cluster.center.flag,     // module flag
+                       cluster.energy,          // total energy
+                       cluster.leakage);        // energy from leakage corr
+
+    // do non-linearity energy correction
+    if(LINEAR && fabs(alpE) < linear_corr_limit) {
+        float corr = 1./(1 + alpE);
+        // save the correction factor, not alpha(E)
+        hycal_hit.lin_corr = corr;
+        hycal_hit.E *= corr;
+    }
+
+    // count modules
+    hycal_hit.nblocks = cluster.size();
+
+    // fill 3x3 hits around center into temp container for position reconstruction
+    int count = fillHits(cluster.center, cluster, hits);
+
+    // record how many hits participated in position reconstruction
+    hycal_hit.npos = count;
+
+    // reconstruct position
+    reconstructPos((BaseHit*)&hycal_hit);
+    hycal_hit.z = cluster.center.geo->z;
+
+    // z position will need a depth correction
+    if(DEPTH)
+        hycal_hit.z += showerDepth(cluster.center.geo->type, cluster.energy);
+
+    return hycal_hit;
+}
+
+// add virtual hits for dead modules and boundaries
+void PRadHyCalCluster::leakCorr(ModuleCluster &cluster,
+                                ModuleHitArray &hits,
+                                const std::vector<ModuleHit> &dead)
+const
+{
+    if(TEST_BIT(cluster.center.flag, kDeadNeighbor))
+        AddVirtHits(cluster, hits, dead);
+
+    if(TEST_BIT(cluster.center.flag, kInnerBound))
+        AddVirtHits(cluster, hits, getVModuleNeighbors(cluster.center, inner_virtual, inner_neighbors));
+
+    if(TEST_BIT(cluster.center.flag, kOuterBound))
+        AddVirtHits(cluster, hits, getVModuleNeighbors(cluster.center, outer_virtual, outer_neighbors));
+}
+
+// shower depth without checking the flag
+float PRadHyCalCluster::showerDepth(int module_type, const float &E)
+const
+{
+    if(E > 0.) {
+        // here all the values are hard coded, because these are all physical
+        // values corresponding to the material, so no need to change
+        // it returns the maximum shower depth that
+        // t = X0*(ln(E0/Ec) - Cf),
+        // where X0 is radiation length, Ec is critical energy, Cf = -0.5 for
+        // electron induced shower and 0.5 for photon
+        // units are in mm and MeV
+        if(module_type == PRadHyCalModule::PbWO4)
+            return 8.6*(log(E/1.1) - 0.5);
+
+        // -101.2 is the surface difference between Lead Glass and Lead Tungstate modules
+        if(module_type == PRadHyCalModule::PbGlass)
+            return 26.7*(log(E/2.84) - 0.5);
+    }
+
+    return 0.;
+}
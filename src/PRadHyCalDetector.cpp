@@ -32,23 +32,27 @@ PRadHyCalDetector::PRadHyCalDetector(const std::string &det, PRadHyCalSystem *sy
 // copy and move assignment will copy or move the modules, but the connection to
 // HyCal system and the connections between modules and DAQ units won't be copied
 // copy constructor
+// hits refer to the geometry of the modules, so they are not copied, the dead
+// hits are created from the new modules
 PRadHyCalDetector::PRadHyCalDetector(const PRadHyCalDetector &that)
-: PRadDetector(that), system(nullptr), module_hits(that.module_hits),
-  dead_hits(that.dead_hits), module_clusters(that.module_clusters),
-  hycal_hits(that.hycal_hits)
+: PRadDetector(that), system(nullptr)
 {
     for(auto module : that.module_list)
     {
         AddModule(new PRadHyCalModule(*module));
     }
+
+    buildModuleGrid();
+    CreateDeadHits();
 }
 
 // move constructor
 PRadHyCalDetector::PRadHyCalDetector(PRadHyCalDetector &&that)
 : PRadDetector(that), system(nullptr), module_list(std::move(that.module_list)),
   id_map(std::move(that.id_map)), name_map(std::move(that.name_map)),
+  module_grid(std::move(that.module_grid)), module_reach(std::move(that.module_reach)),
   module_hits(std::move(that.module_hits)), dead_hits(std::move(that.dead_hits)),
-  module_clusters(std::move(that.module_clusters)), hycal_hits(std::move(that.hycal_hits))
+  dead_neighbors(std::move(that.dead_neighbors)), module_clusters(std::move(that.module_clusters)), hycal_hits(std::move(that.hycal_hits))
 {
     // reset the connections between module and HyCal
     for(auto module : module_list)
@@ -90,8 +94,11 @@ PRadHyCalDetector &PRadHyCalDetector::operator =(PRadHyCalDetector &&rhs)
     module_list = std::move(rhs.module_list);
     id_map = std::move(rhs.id_map);
     name_map = std::move(rhs.name_map);
+    module_grid = std::move(rhs.module_grid);
+    module_reach = std::move(rhs.module_reach);
     module_hits = std::move(rhs.module_hits);
     dead_hits = std::move(rhs.dead_hits);
+    dead_neighbors = std::move(rhs.dead_neighbors);
     module_clusters = std::move(rhs.module_clusters);
     hycal_hits = std::move(rhs.hycal_hits);
 
@@ -275,6 +282,9 @@ bool PRadHyCalDetector::AddModule(PRadHyCalModule *module)
     name_map[name] = module;
     id_map[id] = module;
 
+    // the grid needs to be rebuilt, it will be done in SortModuleList
+    clearModuleGrid();
+
     return true;
 }
 
@@ -304,6 +314,11 @@ void PRadHyCalDetector::RemoveModule(PRadHyCalModule *module)
     module_list.clear();
     for(auto &it : id_map)
         module_list.push_back(it.second);
+    SortModuleList();
+
+    // hits refer to the geometry of the removed module
+    clearModuleHits();
+    CreateDeadHits();
 }
 
 // disconnect module
@@ -332,6 +347,7 @@ void PRadHyCalDetector::DisconnectModule(PRadHyCalModule *module, bool force_dis
     module_list.clear();
     for(auto &it : id_map)
         module_list.push_back(it.second);
+    SortModuleList();
 }
 
 void PRadHyCalDetector::SortModuleList()
@@ -341,6 +357,9 @@ void PRadHyCalDetector::SortModuleList()
              {
                 return *m1 < *m2;
              });
+
+    // module list is finalized, build the position grid
+    buildModuleGrid();
 }
 
 void PRadHyCalDetector::ClearModuleList()
@@ -355,6 +374,8 @@ void PRadHyCalDetector::ClearModuleList()
     module_list.clear();
     id_map.clear();
     name_map.clear();
+    clearModuleGrid();
+    clearModuleHits();
 }
 
 void PRadHyCalDetector::OutputModuleList(std::ostream &os)
@@ -376,12 +397,14 @@ void PRadHyCalDetector::CreateDeadHits()
 {
     // clear current dead hits
     dead_hits.clear();
+    dead_neighbors.clear();
 
     // create dead hits
     for(auto module : module_list)
     {
-        // clear the dead module flag
+        // clear the dead module flags
         CLEAR_BIT(module->layout.flag, kDeadModule);
+        CLEAR_BIT(module->layout.flag, kDeadNeighbor);
 
         // module is not connected to a adc channel or the channel is dead
         if(!module->GetChannel() || module->GetChannel()->IsDead()) {
@@ -390,43 +413,129 @@ void PRadHyCalDetector::CreateDeadHits()
         }
     }
 
-    // check if any modules are very close to this dead module, and set a bit
-    // for the future correction
-    for(auto module : module_list)
+    // only the modules within reach of the dead modules are affected, set a
+    // bit for the close ones for the future correction
+    // also save the dead hits within profile reach for each module, so the
+    // leakage correction only needs to check the relevant ones
+    // dead hits are in the order of id, so are the lists for each module
+    for(auto &dead : dead_hits)
     {
-        const auto &geo = module->GetGeometry();
+        for(auto &link : GetModuleReach(dead.id))
+        {
+            if(link.adjacent)
+                SET_BIT(link.module->layout.flag, kDeadNeighbor);
+
+            dead_neighbors[link.module->GetID()].push_back(dead);
+        }
+    }
+}
+
+// update the dead hits after the channel status of a module is changed, only
+// the modules within its reach are updated
+void PRadHyCalDetector::UpdateDeadModule(PRadHyCalModule *module)
+{
+    if(!module || module->detector != this)
+        return;
+
+    bool dead = !module->GetChannel() || module->GetChannel()->IsDead();
+    if(dead == TEST_BIT(module->layout.flag, kDeadModule))
+        return;
 
-        for(auto &dead : dead_hits)
+    auto id_less = [](const ModuleHit &hit, int id) {return hit.id < id;};
+    int id = module->GetID();
+    const auto &links = GetModuleReach(id);
+
+    if(dead) {
+        SET_BIT(module->layout.flag, kDeadModule);
+        ModuleHit dhit(module, 0., false);
+        dead_hits.insert(std::lower_bound(dead_hits.begin(), dead_hits.end(), id, id_less), dhit);
+
+        for(auto &link : links)
         {
-            float dx = (geo.x - dead.geo.x)/(geo.size_x + dead.geo.size_x);
-            float dy = (geo.y - dead.geo.y)/(geo.size_y + dead.geo.size_y);
+            if(link.adjacent)
+                SET_BIT(link.module->layout.flag, kDeadNeighbor);
 
-            if(sqrt(dx*dx + dy*dy)*2. < CORNER_ADJACENT)
+            auto &dlist = dead_neighbors[link.module->GetID()];
+            dlist.insert(std::lower_bound(dlist.begin(), dlist.end(), id, id_less), dhit);
+        }
+        return;
+    }
+
+    CLEAR_BIT(module->layout.flag, kDeadModule);
+    auto it = std::lower_bound(dead_hits.begin(), dead_hits.end(), id, id_less);
+    if(it != dead_hits.end() && it->id == id)
+        dead_hits.erase(it);
+
+    for(auto &link : links)
+    {
+        int nid = link.module->GetID();
+        auto &dlist = dead_neighbors[nid];
+        auto dit = std::lower_bound(dlist.begin(), dlist.end(), id, id_less);
+        if(dit != dlist.end() && dit->id == id)
+            dlist.erase(dit);
+
+        // check if the module is still close to other dead modules
+        if(link.adjacent) {
+            CLEAR_BIT(link.module->layout.flag, kDeadNeighbor);
+            ModuleHit mhit(link.module, 0.);
+            for(auto &dhit : dlist)
             {
-               SET_BIT(module->layout.flag, kDeadNeighbor);
-               break;
+                if(hit_distance(mhit, dhit) < CORNER_ADJACENT) {
+                    SET_BIT(link.module->layout.flag, kDeadNeighbor);
+                    break;
+                }
             }
         }
+
+        if(dlist.empty())
+            dead_neighbors.erase(nid);
     }
 }
 
 // hits/clusters reconstruction
 void PRadHyCalDetector::Reconstruct(PRadHyCalCluster *method)
 {
-    // clear containers
-    hycal_hits.clear();
-
     // group module hits into clusters
     method->FormCluster(module_hits, module_clusters);
 
-    for(auto &cluster : module_clusters)
+    // reconstruct hits from the clusters
+    ReconstructHits(method);
+}
+
+// reconstruct hits from the current module clusters
+void PRadHyCalDetector::ReconstructHits(PRadHyCalCluster *method)
+{
+    ReconstructHits(method, module_clusters, hycal_hits);
+}
+
+// reconstruct hits from the given clusters, it does not change the detector so
+// different methods can use it at the same time
+// if the event is given, the timing is taken from its TDC data instead of the
+// TDC channels, so it can be called while the system is choosing other events
+void PRadHyCalDetector::ReconstructHits(PRadHyCalCluster *method,
+                                        ModuleClusters &clusters,
+                                        std::vector<HyCalHit> &hits,
+                                        const EventData *event)
+const
+{
+    // the method has a specialized pipeline for its configuration
+    auto pipeline = method->GetPipeline();
+    if(pipeline) {
+        (method->*pipeline)(this, clusters, hits, event);
+        return;
+    }
+
+    // clear containers
+    hits.clear();
+
+    for(auto &cluster : clusters)
     {
         // discard cluster that does not satisfy certain conditions
         if(!method->CheckCluster(cluster))
             continue;
 
         // leakage correction for dead modules
-        method->LeakCorr(cluster, dead_hits);
+        method->LeakCorr(cluster, clusters.hits, GetDeadNeighbors(cluster.center.id));
 
         // the center module does not exist should be a fatal problem, thus no
         // safety check here
@@ -436,15 +545,13 @@ void PRadHyCalDetector::Reconstruct(PRadHyCalCluster *method)
         float lin_corr = center->GetCalibConst().NonLinearCorr(cluster.energy);
 
         // reconstruct hit the position based on the cluster
-        HyCalHit hit = method->Reconstruct(cluster, lin_corr);
+        HyCalHit hit = method->Reconstruct(cluster, clusters.hits, lin_corr);
 
         // add timing information
-        PRadTDCChannel *tdc = center->GetTDC();
-        if(tdc)
-            hit.set_time(tdc->GetTimeMeasure());
+        set_hit_time(hit, center, event);
 
         // final hit reconstructed
-        hycal_hits.emplace_back(std::move(hit));
+        hits.emplace_back(std::move(hit));
     }
 }
 
@@ -467,6 +574,30 @@ void PRadHyCalDetector::ClearHits()
     module_hits.clear();
 }
 
+// get the dead hits that are within the profile reach of a module
+const std::vector<ModuleHit> &PRadHyCalDetector::GetDeadNeighbors(const int &id)
+const
+{
+    static const std::vector<ModuleHit> no_neighbors;
+
+    auto it = dead_neighbors.find(id);
+    if(it == dead_neighbors.end())
+        return no_neighbors;
+    return it->second;
+}
+
+// get the modules within profile reach of a module
+const std::vector<ModuleLink> &PRadHyCalDetector::GetModuleReach(const int &id)
+const
+{
+    static const std::vector<ModuleLink> no_links;
+
+    auto it = module_reach.find(id);
+    if(it == module_reach.end())
+        return no_links;
+    return it->second;
+}
+
 PRadHyCalModule *PRadHyCalDetector::GetModule(const int &id)
 const
 {
@@ -485,21 +616,36 @@ const
     return it->second;
 }
 
+// inline function to check if the point is inside the module
+inline bool __hd_inside(const PRadHyCalModule &module, const float &x, const float &y)
+{
+    const auto &geo = module.GetGeometry();
+    return (x <= geo.x + geo.size_x/2.) && (x >= geo.x - geo.size_x/2.) &&
+           (y <= geo.y + geo.size_y/2.) && (y >= geo.y - geo.size_y/2.);
+}
+
 PRadHyCalModule *PRadHyCalDetector::GetModule(const float &x, const float &y)
 const
 {
-    for(auto &module : module_list)
-    {
-        float pos_x = module->GetX();
-        float size_x = module->GetSizeX();
-        if((x > pos_x + size_x/2.) || (x < pos_x - size_x/2.))
-            continue;
-        float pos_y = module->GetY();
-        float size_y = module->GetSizeY();
-        if((y > pos_y + size_y/2.) || (y < pos_y - size_x/2.))
-            continue;
+    // grid is not built, check all modules
+    if(module_grid.empty()) {
+        for(auto &module : module_list)
+        {
+            if(__hd_inside(*module, x, y))
+                return module;
+        }
+        return nullptr;
+    }
+
+    // only check the modules that overlap with the grid cell
+    auto cell = module_grid.get_cell(x, y);
+    if(!cell)
+        return nullptr;
 
-        return module;
+    for(auto &module : *cell)
+    {
+        if(__hd_inside(*module, x, y))
+            return module;
     }
     return nullptr;
 }
@@ -515,6 +661,147 @@ const
     return energy;
 }
 
+//============================================================================//
+// Protected Member Functions                                                 //
+//============================================================================//
+
+// build the uniform grid for finding module by position
+void PRadHyCalDetector::buildModuleGrid()
+{
+    clearModuleGrid();
+
+    if(module_list.empty())
+        return;
+
+    // determine the grid range and the cell size
+    float x_min = module_list.front()->GetX(), x_max = x_min;
+    float y_min = module_list.front()->GetY(), y_max = y_min;
+    float step_x = module_list.front()->GetSizeX();
+    float step_y = module_list.front()->GetSizeY();
+
+    for(auto &module : module_list)
+    {
+        const auto &geo = module->GetGeometry();
+        // skip modules without a proper size
+        if(geo.size_x <= 0. || geo.size_y <= 0.)
+            continue;
+
+        x_min = std::min(x_min, float(geo.x - geo.size_x/2.));
+        x_max = std::max(x_max, float(geo.x + geo.size_x/2.));
+        y_min = std::min(y_min, float(geo.y - geo.size_y/2.));
+        y_max = std::max(y_max, float(geo.y + geo.size_y/2.));
+        step_x = std::min(step_x, float(geo.size_x));
+        step_y = std::min(step_y, float(geo.size_y));
+    }
+
+    if(step_x <= 0. || step_y <= 0.)
+        return;
+
+    module_grid.x_min = x_min;
+    module_grid.y_min = y_min;
+    module_grid.step_x = step_x;
+    module_grid.step_y = step_y;
+    module_grid.nx = int((x_max - x_min)/step_x) + 1;
+    module_grid.ny = int((y_max - y_min)/step_y) + 1;
+    module_grid.cells.resize(module_grid.nx*module_grid.ny);
+
+    // register the modules to all the cells they overlap with
+    for(auto &module : module_list)
+    {
+        const auto &geo = module->GetGeometry();
+        if(geo.size_x <= 0. || geo.size_y <= 0.)
+            continue;
+
+        int ix_min = int((geo.x - geo.size_x/2. - x_min)/step_x);
+        int ix_max = int((geo.x + geo.size_x/2. - x_min)/step_x);
+        int iy_min = int((geo.y - geo.size_y/2. - y_min)/step_y);
+        int iy_max = int((geo.y + geo.size_y/2. - y_min)/step_y);
+
+        for(int iy = std::max(iy_min, 0); iy <= iy_max && iy < module_grid.ny; ++iy)
+        {
+            for(int ix = std::max(ix_min, 0); ix <= ix_max && ix < module_grid.nx; ++ix)
+            {
+                module_grid.cells[iy*module_grid.nx + ix].push_back(module);
+            }
+        }
+    }
+
+    // the links between modules are found with the grid
+    buildModuleReach();
+}
+
+// clear the position grid
+void PRadHyCalDetector::clearModuleGrid()
+{
+    module_grid = ModuleGrid();
+    module_reach.clear();
+}
+
+// build the links between modules within profile reach, the grid is used to
+// find the candidates, so it is not needed to test every pair of modules
+void PRadHyCalDetector::buildModuleReach()
+{
+    module_reach.clear();
+
+    if(module_grid.empty())
+        return;
+
+    // largest module size to determine the search range
+    float max_x = 0., max_y = 0.;
+    for(auto &module : module_list)
+    {
+        max_x = std::max(max_x, float(module->GetSizeX()));
+        max_y = std::max(max_y, float(module->GetSizeY()));
+    }
+
+    int reach_x = int(PROFILE_REACH*max_x/module_grid.step_x) + 1;
+    int reach_y = int(PROFILE_REACH*max_y/module_grid.step_y) + 1;
+
+    for(auto &module : module_list)
+    {
+        ModuleHit mhit(module, 0.);
+        auto &links = module_reach[mhit.id];
+
+        int ix0 = int((mhit.geo->x - module_grid.x_min)/module_grid.step_x);
+        int iy0 = int((mhit.geo->y - module_grid.y_min)/module_grid.step_y);
+
+        for(int iy = std::max(iy0 - reach_y, 0); iy <= iy0 + reach_y && iy < module_grid.ny; ++iy)
+        {
+            for(int ix = std::max(ix0 - reach_x, 0); ix <= ix0 + reach_x && ix < module_grid.nx; ++ix)
+            {
+                for(auto &other : module_grid.cells[iy*module_grid.nx + ix])
+                {
+                    ModuleHit ohit(other, 0.);
+                    if(in_profile_reach(mhit, ohit))
+                        links.emplace_back(other, hit_distance(mhit, ohit) < CORNER_ADJACENT);
+                }
+            }
+        }
+
+        // a large module is registered in several cells
+        std::sort(links.begin(), links.end(),
+                  [](const ModuleLink &l1, const ModuleLink &l2)
+                  {
+                      return *l1.module < *l2.module;
+                  });
+        links.erase(std::unique(links.begin(), links.end(),
+                                [](const ModuleLink &l1, const ModuleLink &l2)
+                                {
+                                    return l1.module == l2.module;
+                                }),
+                    links.end());
+    }
+}
+
+// clear all the hits, they refer to the geometry of modules
+void PRadHyCalDetector::clearModuleHits()
+{
+    module_hits.clear();
+    dead_hits.clear();
+    dead_neighbors.clear();
+    module_clusters.clear();
+}
+
 // using primex id to get layout information
 // TODO now it is highly specific to the current HyCal layout, make it configurable
 void PRadHyCalDetector::setLayout(PRadHyCalModule &module)
@@ -593,12 +880,48 @@ const
 // only useful for adjacent module checking
 float PRadHyCalDetector::hit_distance(const ModuleHit &m1, const ModuleHit &m2)
 {
-    float dx = (m1.geo.x - m2.geo.x)/(m1.geo.size_x + m2.geo.size_x);
-    float dy = (m1.geo.y - m2.geo.y)/(m1.geo.size_y + m2.geo.size_y);
+    float dx = (m1.geo->x - m2.geo->x)/(m1.geo->size_x + m2.geo->size_x);
+    float dy = (m1.geo->y - m2.geo->y)/(m1.geo->size_y + m2.geo->size_y);
 
     return sqrt(dx*dx + dy*dy)*2.;
 }
 
+// check if two modules are close enough that one may have a share from the
+// profile of the other, the distance is quantized to the larger module size
+// thus it is a conservative check for modules with different sizes
+bool PRadHyCalDetector::in_profile_reach(const ModuleHit &m1, const ModuleHit &m2)
+{
+    float size_x = std::max(m1.geo->size_x, m2.geo->size_x);
+    float size_y = std::max(m1.geo->size_y, m2.geo->size_y);
+
+    return (fabs(m1.geo->x - m2.geo->x) < PROFILE_REACH*size_x) &&
+           (fabs(m1.geo->y - m2.geo->y) < PROFILE_REACH*size_y);
+}
+
+// set the timing of the hit from the TDC group of its center module, the time
+// measure is collected from the event if it is given, otherwise it is taken
+// from the TDC channel filled by PRadHyCalSystem::ChooseEvent
+void PRadHyCalDetector::set_hit_time(HyCalHit &hit, const PRadHyCalModule *center,
+                                     const EventData *event)
+{
+    PRadTDCChannel *tdc = center->GetTDC();
+    if(!tdc)
+        return;
+
+    if(!event) {
+        hit.set_time(tdc->GetTimeMeasure());
+        return;
+    }
+
+    std::vector<unsigned short> time;
+    for(auto &tdc_data : event->tdc_data)
+    {
+        if(tdc_data.channel_id == tdc->GetID())
+            time.push_back(tdc_data.value);
+    }
+    hit.set_time(time);
+}
+
 // get enum HyCalSector by its name
 int PRadHyCalDetector::get_sector_id(const char *name)
 {
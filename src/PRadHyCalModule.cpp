@@ -7,6 +7,7 @@
 
 #include "PRadHyCalModule.h"
 #include "PRadHyCalDetector.h"
+#include "PRadHyCalSystem.h"
 #include "PRadADCChannel.h"
 #include "PRadEventStruct.h"
 #include <exception>
@@ -146,6 +147,27 @@ void PRadHyCalModule::UnsetChannel(bool force_unset)
     daq_ch = nullptr;
 }
 
+void PRadHyCalModule::SetCalibConst(const PRadCalibConst &c)
+{
+    cal_const = c;
+    UpdateEnergyTable();
+}
+
+void PRadHyCalModule::GainCorrection(const double &g, const int &ref)
+{
+    cal_const.GainCorrection(g, ref);
+    UpdateEnergyTable();
+}
+
+// update the energy of this module in the fused table of HyCal system, it is
+// needed once the calibration or the pedestal of its channel is changed
+void PRadHyCalModule::UpdateEnergyTable()
+const
+{
+    if(detector && detector->GetSystem() && daq_ch)
+        detector->GetSystem()->UpdateEnergyTable(daq_ch);
+}
+
 // get module type name
 std::string PRadHyCalModule::GetTypeName()
 const
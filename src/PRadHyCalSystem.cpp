@@ -12,11 +12,151 @@
 #include <iostream>
 #include <iomanip>
 #include <algorithm>
+#include <cmath>
 #include "canalib.h"
 #include "TFile.h"
 #include "TF1.h"
 #include "TH1D.h"
 
+#ifdef MULTI_THREAD
+#include <thread>
+#endif
+
+// minimum number of channels for a fitting thread
+#define FIT_THREAD_BLOCK 32
+
+// status of the histogram fitting
+enum __hc_fit_status
+{
+    __hc_fit_success = 0,
+    __hc_fit_no_entry,
+    __hc_fit_failed,
+};
+
+// the second moment of a gaussian truncated to mean +- half_width underestimates
+// sigma (by ~4.5% for a 2.5 sigma window), invert the truncation to get sigma
+// back, the window in units of sigma depends on sigma, so iterate a few times
+static double __hc_untruncate_sigma(double sigma_t, double half_width)
+{
+    double sigma = sigma_t;
+    for(int i = 0; i < 10 && sigma > 0.; ++i)
+    {
+        double k = half_width/sigma;
+        double pdf = std::exp(-k*k/2.)/std::sqrt(2.*cana::pi);
+        double ratio = 1. - 2.*k*pdf/std::erf(k/std::sqrt(2.));
+        if(ratio <= 0.)
+            break;
+        sigma = sigma_t/std::sqrt(ratio);
+    }
+    return sigma;
+}
+
+// gaussian fit to the histogram in range, it does not use TH1::Fit so the
+// channels can be fitted in parallel
+// it starts from the peak and its FWHM, and the fit range is narrowed to
+// mean +- 2.5 sigma iteratively
+static int __hc_fit_gaussian(const TH1 *hist,
+                             const double &range_min, const double &range_max,
+                             double &mean, double &sigma)
+{
+    const TAxis *axis = hist->GetXaxis();
+    int beg_bin = axis->FindFixBin(range_min);
+    int end_bin = axis->FindFixBin(range_max) - 1;
+
+    if(hist->Integral(beg_bin, end_bin) < 1000)
+        return __hc_fit_no_entry;
+
+    int peak_bin = beg_bin;
+    for(int i = beg_bin; i <= end_bin; ++i)
+    {
+        if(hist->GetBinContent(i) > hist->GetBinContent(peak_bin))
+            peak_bin = i;
+    }
+
+    double half_max = hist->GetBinContent(peak_bin)/2.;
+    int low_bin = peak_bin, high_bin = peak_bin;
+    while(low_bin > beg_bin && hist->GetBinContent(low_bin - 1) > half_max)
+        --low_bin;
+    while(high_bin < end_bin && hist->GetBinContent(high_bin + 1) > half_max)
+        ++high_bin;
+
+    double bin_width = axis->GetBinWidth(peak_bin);
+    mean = axis->GetBinCenter(peak_bin);
+    sigma = (high_bin - low_bin + 1)*bin_width/2.355;
+
+    std::vector<double> x, y;
+    for(int iter = 0; iter < 3; ++iter)
+    {
+        double half_width = std::max(2.5*sigma, 2.5*bin_width);
+        int fit_beg = std::max(beg_bin, axis->FindFixBin(mean - half_width));
+        int fit_end = std::min(end_bin, axis->FindFixBin(mean + half_width));
+
+        x.clear();
+        y.clear();
+        double sum = 0., sum_x = 0., sum_x2 = 0.;
+        for(int i = fit_beg; i <= fit_end; ++i)
+        {
+            double val = hist->GetBinContent(i), center = axis->GetBinCenter(i);
+            if(val <= 0.)
+                continue;
+            x.push_back(center);
+            y.push_back(val);
+            sum += val;
+            sum_x += val*center;
+            sum_x2 += val*center*center;
+        }
+
+        if(sum <= 0.)
+            return __hc_fit_failed;
+
+        double amp, fit_mean, fit_sigma;
+        if(cana::gaus_fit(&x[0], &y[0], x.size(), amp, fit_mean, fit_sigma) &&
+           fit_mean > range_min && fit_mean < range_max) {
+            mean = fit_mean;
+            sigma = fit_sigma;
+        } else {
+            // too narrow for a fit, use the moments within the window
+            mean = sum_x/sum;
+            sigma = std::sqrt(std::max(0., sum_x2/sum - mean*mean));
+            double window = std::min(mean - axis->GetBinLowEdge(fit_beg),
+                                     axis->GetBinUpEdge(fit_end) - mean);
+            sigma = __hc_untruncate_sigma(sigma, window);
+            break;
+        }
+    }
+
+    return __hc_fit_success;
+}
+
+// do job(i) for i in [0, n), the indices are divided into blocks for threads
+// if MULTI_THREAD is defined, the job should only save the result of index i
+template<typename Job>
+static void __hc_parallel_for(size_t n, Job job)
+{
+#ifdef MULTI_THREAD
+    size_t nthreads = std::min<size_t>(std::thread::hardware_concurrency(),
+                                       n/FIT_THREAD_BLOCK);
+    if(nthreads > 1) {
+        size_t block = (n + nthreads - 1)/nthreads;
+        std::vector<std::thread> threads;
+        for(size_t t = 0; t < nthreads; ++t)
+        {
+            threads.emplace_back([&, t] ()
+                                 {
+                                     size_t end = std::min(n, (t + 1)*block);
+                                     for(size_t i = t*block; i < end; ++i)
+                                         job(i);
+                                 });
+        }
+        for(auto &thread : threads)
+            thread.join();
+        return;
+    }
+#endif
+    for(size_t i = 0; i < n; ++i)
+        job(i);
+}
+
 
 
 //============================================================================//
@@ -25,7 +165,8 @@
 
 // constructor
 PRadHyCalSystem::PRadHyCalSystem(const std::string &path)
-: hycal(new PRadHyCalDetector("HyCal", this)), recon(nullptr)
+: hycal(new PRadHyCalDetector("HyCal", this)), recon(nullptr), use_cache(false),
+  ped_version(0), gain_version(0), recon_version(0)
 {
     // reserve enough buckets for the adc maps
     adc_addr_map.reserve(ADC_BUCKETS);
@@ -46,9 +187,10 @@ PRadHyCalSystem::PRadHyCalSystem(const std::string &path)
 
 // copy constructor
 // it does not only copy the members, but also copy the connections between the
-// members
+// members, the reconstruction cache is not copied
 PRadHyCalSystem::PRadHyCalSystem(const PRadHyCalSystem &that)
-: ConfigObject(that), hycal(nullptr), cal_period(that.cal_period)
+: ConfigObject(that), hycal(nullptr), cal_period(that.cal_period),
+  use_cache(that.use_cache), ped_version(0), gain_version(0), recon_version(0)
 {
     // copy detector
     if(that.hycal) {
@@ -94,7 +236,11 @@ PRadHyCalSystem::PRadHyCalSystem(PRadHyCalSystem &&that)
   adc_list(std::move(that.adc_list)), tdc_list(std::move(that.tdc_list)),
   adc_addr_map(std::move(that.adc_addr_map)), adc_name_map(std::move(that.adc_name_map)),
   tdc_addr_map(std::move(that.tdc_addr_map)), tdc_name_map(std::move(that.tdc_name_map)),
-  recon_map(std::move(that.recon_map))
+  recon_map(std::move(that.recon_map)), ch_ped(std::move(that.ch_ped)),
+  ch_gain(std::move(that.ch_gain)), use_cache(that.use_cache),
+  ped_version(that.ped_version), gain_version(that.gain_version),
+  recon_version(that.recon_version), recon_cache(std::move(that.recon_cache)),
+  gain_history(std::move(that.gain_history))
 {
     hycal = that.hycal;
     that.hycal = nullptr;
@@ -159,6 +305,14 @@ PRadHyCalSystem &PRadHyCalSystem::operator =(PRadHyCalSystem &&rhs)
     tdc_addr_map = std::move(rhs.tdc_addr_map);
     tdc_name_map = std::move(rhs.tdc_name_map);
     recon_map = std::move(rhs.recon_map);
+    ch_ped = std::move(rhs.ch_ped);
+    ch_gain = std::move(rhs.ch_gain);
+    use_cache = rhs.use_cache;
+    ped_version = rhs.ped_version;
+    gain_version = rhs.gain_version;
+    recon_version = rhs.recon_version;
+    recon_cache = std::move(rhs.recon_cache);
+    gain_history = std::move(rhs.gain_history);
 
     return *this;
 }
@@ -186,8 +340,11 @@ void PRadHyCalSystem::Configure(const std::string &path)
 
     // reconstruction configuration
     SetClusterMethod(GetConfig<std::string>("Cluster Method"));
-    if(recon)
+    if(recon) {
         recon->Configure(GetConfig<std::string>("Cluster Configuration"));
+        if(hycal)
+            recon->UpdateVModuleNeighbors(hycal->GetModuleList());
+    }
 
     // load profile
     std::string pwo_prof, lg_prof;
@@ -202,9 +359,16 @@ void PRadHyCalSystem::Configure(const std::string &path)
     if(method) {
         method->LoadCrystalProfile(pwo_prof);
         method->LoadLeadGlassProfile(lg_prof);
+        // the workers are forked only once, when the system is configured and
+        // before any threads are spawned, the later changes are sent to them
+        if(method == recon && !method->GetNbofWorkers())
+            method->StartWorkers();
     }
 #endif
 
+    // settings and profiles are changed
+    UpdateReconVersion();
+
     // read calibration period
     std::string file_path = ConfigParser::form_path(
                             GetConfig<std::string>("Calibration Folder"),
@@ -339,6 +503,13 @@ void PRadHyCalSystem::BuildConnections()
         adc->SetModule(module);
         module->SetChannel(adc);
     }
+
+    // modules without a channel are dead, rebuild the dead module list, the
+    // later status changes are updated per channel
+    hycal->CreateDeadHits();
+
+    // module connections changed, update the energy table
+    UpdateEnergyTable();
 }
 
 // read module status file
@@ -403,7 +574,7 @@ void PRadHyCalSystem::ReadRunInfoFile(const std::string &path)
         PRadADCChannel *ch = GetADCChannel(name);
         if(ch) {
             ch->SetPedestal(ped_mean, ped_sig);
-            ch->SetDead(status&1);
+            setDeadChannel(ch, status&1);
             PRadHyCalModule *module = ch->GetModule();
             if(module)
                 module->GainCorrection((lms_mean - ped_mean)/ref_gain[ref], ref);
@@ -414,9 +585,11 @@ void PRadHyCalSystem::ReadRunInfoFile(const std::string &path)
         }
     }
 
-    // finished reading, inform detector to update dead module listg
-    if(hycal)
-        hycal->CreateDeadHits();
+    // dead modules affect the leakage correction
+    UpdateReconVersion();
+
+    // pedestal and gain factors changed
+    UpdateEnergyTable();
 
 #ifdef USE_PRIMEX_METHOD
     // original primex method needs to load the profile into fortran coe
@@ -559,6 +732,8 @@ void PRadHyCalSystem::UpdateRunFiles(bool verbose)
                       << std::endl;
         }
     }
+
+    UpdateEnergyTable();
 }
 
 // update the event info to DAQ system
@@ -603,27 +778,258 @@ void PRadHyCalSystem::Reconstruct(const EventData &event)
     if(!event.is_physics_event())
         return;
 
+    // the cached results are still valid or only need a rescale
+    if(use_cache && reconFromCache(event))
+        return;
+
     // collect hits from eventdata
-    auto &hits = hycal->module_hits;
+    CollectHits(event, hycal->module_hits);
+
+    if(!use_cache) {
+        hycal->Reconstruct(recon);
+        return;
+    }
+
+    // the clusters are cached before hits reconstruction, which adds the
+    // leakage corrections to them, so a gain change can rescale the clusters
+    // and redo the corrections
+    recon->FormCluster(hycal->module_hits, hycal->module_clusters);
+    auto &cache = newCache(event);
+    cache.module_hits = hycal->module_hits;
+    cache.module_clusters = hycal->module_clusters;
+
+    hycal->ReconstructHits(recon);
+    cache.recon_clusters = hycal->module_clusters;
+    cache.hycal_hits = hycal->hycal_hits;
+}
 
+// collect module hits from the event data
+void PRadHyCalSystem::CollectHits(const EventData &event, std::vector<ModuleHit> &hits)
+const
+{
     hits.clear();
 
-    for(auto adc : event.get_adc_data())
+    for(auto &adc : event.get_adc_data())
     {
-        if(adc.channel_id >= adc_list.size())
+        if(adc.channel_id >= ch_gain.size())
             continue;
 
-        PRadHyCalModule *module = adc_list.at(adc.channel_id)->GetModule();
+        PRadHyCalModule *module = adc_list[adc.channel_id]->GetModule();
         if(!module)
             continue;
 
-        double val = (double)adc.value - adc_list.at(adc.channel_id)->GetPedestal().mean;
+        double val = (double)adc.value - ch_ped[adc.channel_id];
+        hits.emplace_back(module, std::max(val, 0.)*ch_gain[adc.channel_id]);
+    }
+}
+
+// a simple hash of the adc data to make sure the cache is for the same event
+inline size_t __hs_adc_hash(const EventData &event)
+{
+    size_t hash = event.adc_data.size();
+    for(auto &adc : event.adc_data)
+        hash = hash*31 + ((size_t)adc.channel_id << 16 | adc.value);
+    return hash;
+}
+
+// enable or disable the reconstruction cache
+// with the cache, Reconstruct(event) only redoes the stages affected by the
+// changes since the event was reconstructed
+void PRadHyCalSystem::SetReconCache(bool enable)
+{
+    use_cache = enable;
+    ClearReconCache();
+}
 
-        hits.emplace_back(module, module->GetEnergy(val));
+void PRadHyCalSystem::ClearReconCache()
+{
+    recon_cache.clear();
+    gain_history.clear();
+}
+
+// check if the event does not need a full reconstruction
+bool PRadHyCalSystem::IsReconCached(const EventData &event)
+const
+{
+    auto it = recon_cache.find(event.event_number);
+    return it != recon_cache.end() && checkCache(it->second, event);
+}
+
+// reconstruct the event to a cache entry without changing the detector, so it
+// can be done in another thread, as long as the pedestals, gains and the
+// clustering settings are not changed meanwhile
+// the entry is added to the cache by AddReconCache
+void PRadHyCalSystem::ReconstructCache(const EventData &event, ReconCache &cache)
+const
+{
+    cache.method = recon;
+    cache.adc_hash = __hs_adc_hash(event);
+    cache.ped_version = ped_version;
+    cache.gain_version = gain_version;
+    cache.recon_version = recon_version;
+    cache.module_hits.clear();
+    cache.module_clusters.clear();
+    cache.recon_clusters.clear();
+    cache.hycal_hits.clear();
+
+    if(!hycal || !recon || !event.is_physics_event())
+        return;
+
+    CollectHits(event, cache.module_hits);
+    recon->FormCluster(cache.module_hits, cache.module_clusters);
+    cache.recon_clusters = cache.module_clusters;
+    hycal->ReconstructHits(recon, cache.recon_clusters, cache.hycal_hits, &event);
+}
+
+// add an entry from ReconstructCache, it is discarded if the settings have
+// been changed in a way that the entry cannot be rescaled
+void PRadHyCalSystem::AddReconCache(const EventData &event, ReconCache &&cache)
+{
+    if(!use_cache || !event.is_physics_event() || !checkCache(cache, event))
+        return;
+
+    // the gains used by the entry are needed by a later rescale
+    if(cache.gain_version == gain_version)
+        saveGains();
+
+    if(recon_cache.size() >= RECON_CACHE_SIZE)
+        recon_cache.clear();
+
+    recon_cache[event.event_number] = std::move(cache);
+}
+
+// try to get the reconstruction results from the cache
+// pedestal or cluster setting changes need a full reconstruction, while a gain
+// change only rescales the cached clusters, thresholds on module energy are
+// not applied again in this case
+bool PRadHyCalSystem::reconFromCache(const EventData &event)
+{
+    auto it = recon_cache.find(event.event_number);
+    if(it == recon_cache.end() || !checkCache(it->second, event))
+        return false;
+
+    auto &cache = it->second;
+
+    // everything is up to date
+    if(cache.gain_version == gain_version) {
+        hycal->module_hits = cache.module_hits;
+        hycal->module_clusters = cache.recon_clusters;
+        hycal->hycal_hits = cache.hycal_hits;
+        return true;
     }
 
-    // reoncsturct
-    hycal->Reconstruct(recon);
+    // energy scale changed, no need to group hits again
+    rescaleCache(cache);
+    saveGains();
+    hycal->module_hits = cache.module_hits;
+    hycal->module_clusters = cache.module_clusters;
+    hycal->ReconstructHits(recon);
+    cache.recon_clusters = hycal->module_clusters;
+    cache.hycal_hits = hycal->hycal_hits;
+    return true;
+}
+
+// check if the cache is for the event and can be used with current settings,
+// it may need a rescale for the gain changes
+bool PRadHyCalSystem::checkCache(const ReconCache &cache, const EventData &event)
+const
+{
+    if(cache.adc_hash != __hs_adc_hash(event) ||
+       cache.method != recon ||
+       cache.ped_version != ped_version ||
+       cache.recon_version != recon_version)
+        return false;
+
+    return cache.gain_version == gain_version ||
+           gain_history.count(cache.gain_version);
+}
+
+// scale the cached module energies with the gain changes
+void PRadHyCalSystem::rescaleCache(ReconCache &cache)
+const
+{
+    const auto &old_gain = gain_history.at(cache.gain_version);
+
+    auto ratio = [&] (int id)
+                 {
+                     PRadHyCalModule *module = hycal->GetModule(id);
+                     if(!module || !module->GetChannel())
+                         return 1.;
+                     size_t ch = module->GetChannel()->GetID();
+                     if(ch >= old_gain.size() || ch >= ch_gain.size() || old_gain[ch] <= 0.)
+                         return 1.;
+                     return ch_gain[ch]/old_gain[ch];
+                 };
+
+    for(auto &hit : cache.module_hits)
+        hit.energy *= ratio(hit.id);
+
+    auto &hits = cache.module_clusters.hits;
+    for(auto &cluster : cache.module_clusters)
+    {
+        float old_sum = 0., new_sum = 0.;
+        for(unsigned int i = cluster.begin; i < cluster.end; ++i)
+        {
+            old_sum += hits.energy[i];
+            hits.energy[i] *= ratio(hits.id[i]);
+            new_sum += hits.energy[i];
+        }
+        cluster.center.energy *= ratio(cluster.center.id);
+
+        if(old_sum > 0.) {
+            cluster.energy *= new_sum/old_sum;
+            cluster.leakage *= new_sum/old_sum;
+        }
+    }
+
+    cache.gain_version = gain_version;
+}
+
+// the gains are going to change, a new version is only needed if the current
+// one has been used by the cache, so changing many channels one by one does not
+// create a version for each of them
+void PRadHyCalSystem::newGainVersion()
+{
+    if(gain_history.count(gain_version))
+        ++gain_version;
+}
+
+// keep the gains of current version for rescaling the cache later, only the
+// latest versions are kept, the cache of an older version needs a full
+// reconstruction
+void PRadHyCalSystem::saveGains()
+{
+    if(gain_history.count(gain_version))
+        return;
+
+    if(gain_history.size() >= RECON_GAIN_HISTORY) {
+        auto oldest = gain_history.begin();
+        for(auto it = gain_history.begin(); it != gain_history.end(); ++it)
+        {
+            if(it->first < oldest->first)
+                oldest = it;
+        }
+        gain_history.erase(oldest);
+    }
+
+    gain_history[gain_version] = ch_gain;
+}
+
+// create the cache entry of the event with current version stamps, the
+// results are filled by the caller
+ReconCache &PRadHyCalSystem::newCache(const EventData &event)
+{
+    if(recon_cache.size() >= RECON_CACHE_SIZE)
+        recon_cache.clear();
+
+    auto &cache = recon_cache[event.event_number];
+    cache.method = recon;
+    cache.adc_hash = __hs_adc_hash(event);
+    cache.ped_version = ped_version;
+    cache.gain_version = gain_version;
+    cache.recon_version = recon_version;
+    saveGains();
+    return cache;
 }
 
 void PRadHyCalSystem::Reconstruct()
@@ -660,6 +1066,8 @@ void PRadHyCalSystem::SetDetector(PRadHyCalDetector *h)
 
     if(hycal)
         hycal->SetSystem(this);
+
+    UpdateEnergyTable();
 }
 
 // remove current detector
@@ -669,6 +1077,10 @@ void PRadHyCalSystem::RemoveDetector()
         hycal->UnsetSystem(true);
         delete hycal, hycal = nullptr;
     }
+
+    // cached hits refer to the geometry of the modules
+    ClearReconCache();
+    UpdateEnergyTable();
 }
 
 void PRadHyCalSystem::DisconnectDetector(bool force_disconn)
@@ -678,6 +1090,9 @@ void PRadHyCalSystem::DisconnectDetector(bool force_disconn)
             hycal->UnsetSystem(true);
         hycal = nullptr;
     }
+
+    ClearReconCache();
+    UpdateEnergyTable();
 }
 
 // add adc channel
@@ -741,6 +1156,8 @@ void PRadHyCalSystem::ClearADCChannel()
     adc_list.clear();
     adc_name_map.clear();
     adc_addr_map.clear();
+    ch_ped.clear();
+    ch_gain.clear();
 }
 
 void PRadHyCalSystem::ClearTDCChannel()
@@ -752,6 +1169,50 @@ void PRadHyCalSystem::ClearTDCChannel()
     tdc_addr_map.clear();
 }
 
+// change the status of a single channel, the dead hits of the detector are
+// updated only around its module
+void PRadHyCalSystem::SetDeadChannel(PRadADCChannel *adc, bool dead)
+{
+    SetDeadChannels(std::vector<PRadADCChannel*>{adc}, dead);
+}
+
+// change the status of several channels, the reconstruction version and the
+// primex module status are updated once for all of them
+void PRadHyCalSystem::SetDeadChannels(const std::vector<PRadADCChannel*> &adcs, bool dead)
+{
+    bool changed = false;
+    for(auto adc : adcs)
+        changed |= setDeadChannel(adc, dead);
+
+    if(!changed || !hycal)
+        return;
+
+    // dead modules affect the leakage correction
+    UpdateReconVersion();
+
+#ifdef USE_PRIMEX_METHOD
+    PRadPrimexCluster *method = static_cast<PRadPrimexCluster*>(GetClusterMethod("Primex"));
+    if(method)
+        method->UpdateModuleStatus(hycal->GetModuleList());
+#endif
+}
+
+// set the channel status and update the dead hits around its module, return
+// true if the status is changed
+bool PRadHyCalSystem::setDeadChannel(PRadADCChannel *adc, bool dead)
+{
+    if(!adc || adc->IsDead() == dead)
+        return false;
+
+    adc->SetDead(dead);
+
+    PRadHyCalModule *module = adc->GetModule();
+    if(hycal && module)
+        hycal->UpdateDeadModule(module);
+
+    return true;
+}
+
 PRadHyCalModule *PRadHyCalSystem::GetModule(const int &id)
 const
 {
@@ -829,6 +1290,92 @@ const
     return nullptr;
 }
 
+// update the fused pedestal and gain arrays from adc channels and modules
+// the energy of a channel is max(adc - pedestal, 0)*gain, the gain is 0 for the
+// channel without module, so the loop over adc data does not need to branch
+void PRadHyCalSystem::UpdateEnergyTable()
+{
+    std::vector<double> new_ped(adc_list.size()), new_gain(adc_list.size());
+
+    for(size_t i = 0; i < adc_list.size(); ++i)
+    {
+        PRadHyCalModule *module = adc_list[i]->GetModule();
+        new_ped[i] = adc_list[i]->GetPedestal().mean;
+        new_gain[i] = module ? module->GetCalibrationFactor() : 0.;
+    }
+
+    // update the version stamps for the reconstruction cache
+    if(new_ped != ch_ped)
+        ++ped_version;
+
+    if(new_gain != ch_gain) {
+        // a channel list change needs a full reconstruction
+        if(new_gain.size() != ch_gain.size())
+            ++ped_version;
+        newGainVersion();
+    }
+
+    ch_ped = std::move(new_ped);
+    ch_gain = std::move(new_gain);
+}
+
+// update the fused pedestal and gain of a single channel
+void PRadHyCalSystem::UpdateEnergyTable(const PRadADCChannel *adc)
+{
+    // the channel is not in this system, or the table is not built yet
+    if(!adc || adc->GetID() >= ch_gain.size() || adc_list[adc->GetID()] != adc)
+        return;
+
+    size_t i = adc->GetID();
+    PRadHyCalModule *module = adc->GetModule();
+    double ped = adc->GetPedestal().mean;
+    double gain = module ? module->GetCalibrationFactor() : 0.;
+
+    if(ped != ch_ped[i]) {
+        ch_ped[i] = ped;
+        ++ped_version;
+    }
+
+    if(gain != ch_gain[i]) {
+        newGainVersion();
+        ch_gain[i] = gain;
+    }
+}
+
+// a hash of the calibration used by the reconstruction, it includes the
+// calibration constants, the pedestals and the dead status of all modules
+// it can be chained with the configuration hash by using it as seed
+uint32_t PRadHyCalSystem::GetCalibHash(uint32_t seed)
+const
+{
+    if(!hycal)
+        return seed;
+
+    uint32_t hash = seed;
+    for(auto module : hycal->GetModuleList())
+    {
+        const PRadCalibConst &cal = module->GetCalibConst();
+        PRadADCChannel *adc = module->GetChannel();
+
+        // the flag has the bits of dead module and its neighbors
+        unsigned int id = module->GetID();
+        unsigned int flag = module->GetLayoutFlag();
+        unsigned char dead = !adc || adc->IsDead();
+        double vals[] = {cal.GetCalibConst(),
+                         cal.GetCalibEnergy(),
+                         cal.GetNonLinearFactor(),
+                         adc ? adc->GetPedestal().mean : 0.,
+                         adc ? adc->GetPedestal().sigma : 0.};
+
+        hash = HashData(&id, sizeof(id), hash);
+        hash = HashData(&flag, sizeof(flag), hash);
+        hash = HashData(&dead, sizeof(dead), hash);
+        hash = HashData(vals, sizeof(vals), hash);
+    }
+
+    return hash;
+}
+
 void PRadHyCalSystem::Sparsify(const EventData &event)
 {
     for(auto &adc : event.adc_data)
@@ -844,10 +1391,11 @@ const
     double energy = 0.;
     for(auto &adc : event.adc_data)
     {
-        if(adc.channel_id >= adc_list.size())
+        if(adc.channel_id >= ch_gain.size())
             continue;
 
-        energy += adc_list[adc.channel_id]->GetEnergy(adc.value);
+        double val = (double)adc.value - ch_ped[adc.channel_id];
+        energy += std::max(val, 0.)*ch_gain[adc.channel_id];
     }
 
     return energy;
@@ -864,9 +1412,12 @@ void PRadHyCalSystem::FillHists(const EventData &event)
         if(adc.channel_id >= adc_list.size())
             continue;
 
-        PRadADCChannel *channel = adc_list.at(adc.channel_id);
+        PRadADCChannel *channel = adc_list[adc.channel_id];
         channel->FillHist(adc.value, event.get_trigger());
-        energy += channel->GetEnergy(adc.value);
+        if(adc.channel_id < ch_gain.size()) {
+            double val = (double)adc.value - ch_ped[adc.channel_id];
+            energy += std::max(val, 0.)*ch_gain[adc.channel_id];
+        }
     }
 
     // energy and tdc for only physics events
@@ -967,6 +1518,8 @@ void PRadHyCalSystem::SetClusterMethod(const std::string &name)
 
     if(it != recon_map.end()) {
         recon = it->second;
+        // settings may be changed along with the method
+        UpdateReconVersion();
     } else {
         std::cout << "PRad HyCal System Warning: Cannot find clustering method "
                   << name << ", skip setting method."
@@ -1149,23 +1702,41 @@ throw(PRadException)
     return result;
 }
 
+// the channels are fitted in parallel, and updated in order
 void PRadHyCalSystem::FitPedestal()
 {
-    for(auto &channel : adc_list)
+    struct FitResult
     {
-        TH1 *ped_hist = channel->GetHist("Pedestal");
-
-        if(ped_hist == nullptr || ped_hist->Integral() < 1000)
-            continue;
-
-        ped_hist->Fit("gaus", "qww");
-
-        TF1 *myfit = (TF1*) ped_hist->GetFunction("gaus");
-        double p0 = myfit->GetParameter(1);
-        double p1 = myfit->GetParameter(2);
-
-        channel->SetPedestal(p0, p1);
+        TH1 *hist;
+        int status;
+        double mean, sigma;
+    };
+
+    std::vector<FitResult> results(adc_list.size());
+    for(size_t i = 0; i < adc_list.size(); ++i)
+        results[i].hist = adc_list[i]->GetHist("Pedestal");
+
+    __hc_parallel_for(results.size(), [&results] (size_t i)
+                      {
+                          FitResult &res = results[i];
+                          if(res.hist == nullptr) {
+                              res.status = __hc_fit_no_entry;
+                              return;
+                          }
+                          const TAxis *axis = res.hist->GetXaxis();
+                          res.status = __hc_fit_gaussian(res.hist,
+                                                         axis->GetXmin(),
+                                                         axis->GetXmax(),
+                                                         res.mean, res.sigma);
+                      });
+
+    for(size_t i = 0; i < adc_list.size(); ++i)
+    {
+        if(results[i].status == __hc_fit_success)
+            adc_list[i]->SetPedestal(results[i].mean, results[i].sigma);
     }
+
+    UpdateEnergyTable();
 }
 
 void PRadHyCalSystem::CorrectGainFactor(int ref)
@@ -1214,38 +1785,40 @@ void PRadHyCalSystem::CorrectGainFactor(int ref)
     }
 
     // lamda expression, fit a gaussian and return the mean value
-    auto fit_gaussian = [] (TH1* hist,
-                            const int &range_min = 0,
-                            const int &range_max = 8191,
-                            const double &warn_ratio = 0.06)
+    // the warnings are printed here, so it is not used in the threads
+    auto get_mean = [] (const TH1 *hist,
+                        const int &status,
+                        const double &mean,
+                        const double &sigma,
+                        const double &warn_ratio = 0.06)
+                    {
+                        if(status == __hc_fit_no_entry) {
+                            std::cout << "PRad HyCal System Warning: "
+                                      << "Not enough entries in histogram "
+                                      << hist->GetName()
+                                      << ". Abort fitting!"
+                                      << std::endl;
+                            return 0.;
+                        }
+
+                        if(status != __hc_fit_success || sigma/mean > warn_ratio) {
+                            std::cout << "PRad HyCal System Warning: "
+                                      << "Bad fit for " << hist->GetTitle()
+                                      << ". Mean: " << mean
+                                      << ", sigma: " << sigma
+                                      << std::endl;
+                        }
+                        return (status == __hc_fit_success) ? mean : 0.;
+                    };
+
+    auto fit_gaussian = [&get_mean] (const TH1* hist,
+                                     const int &range_min = 0,
+                                     const int &range_max = 8191,
+                                     const double &warn_ratio = 0.06)
                         {
-                            int beg_bin = hist->GetXaxis()->FindBin(range_min);
-                            int end_bin = hist->GetXaxis()->FindBin(range_max) - 1;
-
-                            if(hist->Integral(beg_bin, end_bin) < 1000) {
-                                std::cout << "PRad HyCal System Warning: "
-                                          << "Not enough entries in histogram "
-                                          << hist->GetName()
-                                          << ". Abort fitting!"
-                                          << std::endl;
-                                return 0.;
-                            }
-
-                            TF1 *fit = new TF1("tmpfit", "gaus", range_min, range_max);
-
-                            hist->Fit(fit, "qR");
-                            TF1 *hist_fit = hist->GetFunction("tmpfit");
-                            double mean = hist_fit->GetParameter(1);
-                            double sigma = hist_fit->GetParameter(2);
-                            if(sigma/mean > warn_ratio) {
-                                std::cout << "PRad HyCal System Warning: "
-                                          << "Bad fit for " << hist->GetTitle()
-                                          << ". Mean: " << mean
-                                          << ", sigma: " << sigma
-                                          << std::endl;
-                            }
-                            delete fit;
-                            return mean;
+                            double mean = 0., sigma = 0.;
+                            int status = __hc_fit_gaussian(hist, range_min, range_max, mean, sigma);
+                            return get_mean(hist, status, mean, sigma, warn_ratio);
                         };
 
     double ped_mean = fit_gaussian(ref_alpha, 0, PED_LED_REF, 0.02);
@@ -1261,17 +1834,40 @@ void PRadHyCalSystem::CorrectGainFactor(int ref)
 
     double ref_factor = (led_mean - ped_mean)/(alpha_mean - ped_mean);
 
-    for(auto channel : adc_list)
+    // fit the led signals of all modules in parallel
+    struct FitResult
     {
-        PRadHyCalModule *module = channel->GetModule();
-        if(!module)
-            continue;
+        TH1 *hist;
+        int status;
+        double mean, sigma;
+    };
+
+    std::vector<FitResult> results(adc_list.size());
+    for(size_t i = 0; i < adc_list.size(); ++i)
+    {
+        results[i].hist = adc_list[i]->GetModule() ? adc_list[i]->GetHist("LMS") : nullptr;
+        results[i].status = __hc_fit_failed;
+    }
+
+    __hc_parallel_for(results.size(), [&results] (size_t i)
+                      {
+                          FitResult &res = results[i];
+                          if(res.hist)
+                              res.status = __hc_fit_gaussian(res.hist, 0, 8191,
+                                                             res.mean, res.sigma);
+                      });
 
-        TH1 *hist = channel->GetHist("LMS");
-        if(!hist)
+    // update the gain factors in order
+    for(size_t i = 0; i < adc_list.size(); ++i)
+    {
+        PRadADCChannel *channel = adc_list[i];
+        PRadHyCalModule *module = channel->GetModule();
+        FitResult &res = results[i];
+        if(!module || !res.hist)
             continue;
 
-        double ch_led = fit_gaussian(hist) - channel->GetPedestal().mean;
+        double ch_led = get_mean(res.hist, res.status, res.mean, res.sigma)
+                        - channel->GetPedestal().mean;
 
         if(ch_led > PED_LED_HYC) {// meaningful led signal
             module->GainCorrection(ch_led/ref_factor, ref);
@@ -1282,5 +1878,7 @@ void PRadHyCalSystem::CorrectGainFactor(int ref)
                       << std::endl;
         }
     }
+
+    UpdateEnergyTable();
 }
 
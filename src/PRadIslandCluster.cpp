@@ -70,6 +70,8 @@ void PRadIslandCluster::Configure(const std::string &path)
         if(!value.IsEmpty())
             min_module_energy[i] = value.Float();
     }
+
+    selectPipeline<PRadIslandCluster>();
 }
 
 
@@ -80,7 +82,7 @@ void PRadIslandCluster::Configure(const std::string &path)
 #ifdef ISLAND_FINE_SPLIT
 
 void PRadIslandCluster::FormCluster(std::vector<ModuleHit> &hits,
-                                    std::vector<ModuleCluster> &clusters)
+                                    ModuleClusters &clusters)
 const
 {
     // clear container first
@@ -108,7 +110,7 @@ const
     // roughly combine all adjacent hits
     for(auto &hit : hits)
     {
-        if(hit.energy < min_module_energy.at(hit.geo.type))
+        if(hit.energy < min_module_energy.at(hit.geo->type))
             continue;
 
         // not belong to any existing cluster
@@ -173,24 +175,92 @@ const
 }
 
 // some global container and function to help splitting and improve performance
-#define SPLIT_MAX_HITS 100
-#define SPLIT_MAX_CLUSTERS 10
-float __ic_frac[SPLIT_MAX_HITS][SPLIT_MAX_CLUSTERS];
-float __ic_tot_frac[SPLIT_MAX_HITS];
+// the hits in a group are stored as structure of arrays, and the fractions are
+// stored as a flattened matrix with one row of all hits for each maximum, so the
+// loops over hits run on contiguous memory and can be vectorized by compiler
+// the buffer is sized to the group, so there is no limit on hits or maximums
+struct __ic_split_buffer
+{
+    size_t nhits, nmax;
+    // hits
+    std::vector<float> x, y, size_x, size_y, energy;
+    // maximums
+    std::vector<float> cx, cy, csize_x, csize_y;
+    // fractions, nmax rows of nhits elements
+    std::vector<float> frac;
+    std::vector<float> tot_frac;
+    // temp containers for position reconstruction
+    std::vector<float> share, weight;
+
+    __ic_split_buffer() : nhits(0), nmax(0) {};
+
+    void fill(const std::vector<ModuleHit*> &maximums,
+              const std::vector<ModuleHit*> &hits)
+    {
+        nhits = hits.size();
+        nmax = maximums.size();
+
+        // vector only reallocates when it needs a larger capacity
+        x.resize(nhits);
+        y.resize(nhits);
+        size_x.resize(nhits);
+        size_y.resize(nhits);
+        energy.resize(nhits);
+        tot_frac.resize(nhits);
+        share.resize(nhits);
+        weight.resize(nhits);
+        cx.resize(nmax);
+        cy.resize(nmax);
+        csize_x.resize(nmax);
+        csize_y.resize(nmax);
+        frac.resize(nmax*nhits);
+
+        for(size_t j = 0; j < nhits; ++j)
+        {
+            const auto &geo = *hits[j]->geo;
+            x[j] = geo.x;
+            y[j] = geo.y;
+            size_x[j] = geo.size_x;
+            size_y[j] = geo.size_y;
+            energy[j] = hits[j]->energy;
+        }
+
+        for(size_t i = 0; i < nmax; ++i)
+        {
+            const auto &geo = *maximums[i]->geo;
+            cx[i] = geo.x;
+            cy[i] = geo.y;
+            csize_x[i] = geo.size_x;
+            csize_y[i] = geo.size_y;
+        }
+    }
 
-inline void __ic_sum_frac(size_t hits, size_t maximums)
+    float *frac_row(size_t i) {return &frac[i*nhits];};
+};
+
+// one buffer for each thread, so different cluster instances can run in parallel
+static thread_local __ic_split_buffer __ic_sb;
+
+// sum up the fractions from all maximums for each hit
+inline void __ic_sum_frac(__ic_split_buffer &sb)
 {
-    for(size_t i = 0; i < hits; ++i)
+    float *tot = sb.tot_frac.data();
+    const size_t nh = sb.nhits;
+
+    for(size_t j = 0; j < nh; ++j)
+        tot[j] = 0.;
+
+    for(size_t i = 0; i < sb.nmax; ++i)
     {
-        __ic_tot_frac[i] = 0;
-        for(size_t j = 0; j < maximums; ++j)
-            __ic_tot_frac[i] += __ic_frac[i][j];
+        const float *f = sb.frac_row(i);
+        for(size_t j = 0; j < nh; ++j)
+            tot[j] += f[j];
     }
 }
 
 // split one group into several clusters
 void PRadIslandCluster::splitCluster(const std::vector<ModuleHit*> &group,
-                                     std::vector<ModuleCluster> &clusters)
+                                     ModuleClusters &clusters)
 const
 {
     // find local maximum
@@ -200,15 +270,13 @@ const
     if(maximums.empty())
         return;
 
-    if((maximums.size() == 1) ||                    // only 1 cluster
-       (group.size() >= SPLIT_MAX_HITS) ||          // too many hits
-       (maximums.size() >= SPLIT_MAX_CLUSTERS)) {   // too many local maximums
+    // only 1 cluster
+    if(maximums.size() == 1) {
         // create cluster based on the center
-        clusters.emplace_back(*maximums.front());
-        auto &cluster = clusters.back();
+        auto &cluster = clusters.AddCluster(*maximums.front());
 
         for(auto &hit : group)
-            cluster.AddHit(*hit);
+            clusters.AddHit(cluster, *hit);
     // split hits between several maximums
     } else {
         splitHits(maximums, group, clusters);
@@ -252,43 +320,47 @@ const
 // split hits between several local maximums inside a cluster group
 void PRadIslandCluster::splitHits(const std::vector<ModuleHit*> &maximums,
                                   const std::vector<ModuleHit*> &hits,
-                                  std::vector<ModuleCluster> &clusters)
+                                  ModuleClusters &clusters)
 const
 {
+    auto &sb = __ic_sb;
+    sb.fill(maximums, hits);
+
     // initialize fractions
-    for(size_t i = 0; i < maximums.size(); ++i)
+    for(size_t i = 0; i < sb.nmax; ++i)
     {
-        auto &center = *maximums.at(i);
-        for(size_t j = 0; j < hits.size(); ++j)
+        auto &center = *maximums[i];
+        float *f = sb.frac_row(i);
+        for(size_t j = 0; j < sb.nhits; ++j)
         {
-            auto &hit = *hits.at(j);
-            __ic_frac[j][i] = __ic_prof.GetProfile(center, hit).frac*center.energy;
+            f[j] = __ic_prof.GetProfile(center, *hits[j]).frac*center.energy;
         }
     }
 
     // do iteration to evaluate the share of hits between several maximums
-    evalFraction(hits, maximums, split_iter);
+    evalFraction(maximums, hits, split_iter);
 
     // done iteration, add cluster according to the final share of energy
-    for(size_t i = 0; i < maximums.size(); ++i)
+    float *tot = sb.tot_frac.data();
+    for(size_t i = 0; i < sb.nmax; ++i)
     {
-        clusters.emplace_back(*maximums.at(i));
-        auto &cluster = clusters.back();
+        auto &cluster = clusters.AddCluster(*maximums[i]);
 
-        for(size_t j = 0; j < hits.size(); ++j)
+        const float *f = sb.frac_row(i);
+        for(size_t j = 0; j < sb.nhits; ++j)
         {
-            if(__ic_frac[j][i] == 0.)
+            if(f[j] == 0.)
                 continue;
 
             // too small share, treat as zero
-            if(__ic_frac[j][i]/__ic_tot_frac[j] < least_share) {
-                __ic_tot_frac[j] -= __ic_frac[j][i];
+            if(f[j]/tot[j] < least_share) {
+                tot[j] -= f[j];
                 continue;
             }
 
-            ModuleHit new_hit(*hits.at(j));
-            new_hit.energy *= __ic_frac[j][i]/__ic_tot_frac[j];
-            cluster.AddHit(new_hit);
+            ModuleHit new_hit(*hits[j]);
+            new_hit.energy *= f[j]/tot[j];
+            clusters.AddHit(cluster, new_hit);
 
             // update the center energy
             if(new_hit == cluster.center)
@@ -297,52 +369,75 @@ const
     }
 }
 
-inline void PRadIslandCluster::evalFraction(const std::vector<ModuleHit*> &hits,
-                                            const std::vector<ModuleHit*> &maximums,
+// iterations to refine the energy shares, it works on the split buffer which
+// should be filled and initialized by splitHits
+inline void PRadIslandCluster::evalFraction(const std::vector<ModuleHit*> &,
+                                            const std::vector<ModuleHit*> &hits,
                                             size_t iters)
 const
 {
-    // temp containers for reconstruction
-    BaseHit temp[POS_RECON_HITS];
+    auto &sb = __ic_sb;
+    const size_t nh = sb.nhits;
+    const float *x = sb.x.data(), *y = sb.y.data();
+    const float *sx = sb.size_x.data(), *sy = sb.size_y.data();
+    const float *energy = sb.energy.data();
+    const float *tot = sb.tot_frac.data();
+    float *share = sb.share.data(), *weight = sb.weight.data();
+    // hit_distance() < CORNER_ADJACENT, without the square root
+    const float adj2 = CORNER_ADJACENT*CORNER_ADJACENT/4.;
 
-    // iterations to refine the split energies
     while(iters-- > 0)
     {
-        __ic_sum_frac(hits.size(), maximums.size());
-        for(size_t i = 0; i < maximums.size(); ++i)
+        __ic_sum_frac(sb);
+        for(size_t i = 0; i < sb.nmax; ++i)
         {
-            // cluster center reconstruction
-            auto &center = *maximums.at(i);
+            float *f = sb.frac_row(i);
+            const float cx = sb.cx[i], cy = sb.cy[i];
+            const float csx = sb.csize_x[i], csy = sb.csize_y[i];
+
+            // energy share of the 3x3 hits around the center, branch free
+            for(size_t j = 0; j < nh; ++j)
+            {
+                float dx = (x[j] - cx)/(sx[j] + csx);
+                float dy = (y[j] - cy)/(sy[j] + csy);
+                float e = (tot[j] > 0.) ? energy[j]*f[j]/tot[j] : 0.;
+                share[j] = (dx*dx + dy*dy < adj2) ? e : 0.;
+            }
+
             float tot_E = 0.;
-            int count = 0;
-            for(size_t j = 0; j < hits.size(); ++j)
+            for(size_t j = 0; j < nh; ++j)
+                tot_E += share[j];
+
+            // log weights, same as GetWeight()
+            for(size_t j = 0; j < nh; ++j)
             {
-                auto &hit = *hits.at(j);
-                if(__ic_frac[j][i] == 0.)
-                    continue;
-
-                // using 3x3 to reconstruct hit position
-                if(PRadHyCalDetector::hit_distance(center, hit) < CORNER_ADJACENT) {
-                    temp[count].x = hit.geo.x;
-                    temp[count].y = hit.geo.y;
-                    temp[count].E = hit.energy*__ic_frac[j][i]/__ic_tot_frac[j];
-                    tot_E += temp[count].E;
-                    count++;
-                }
+                float w = (share[j] > 0.) ? log_weight_thres + log(share[j]/tot_E) : 0.;
+                weight[j] = (w > 0.) ? w : 0.;
             }
 
-            BaseHit recon;
-            PRadHyCalCluster::reconstructPos(temp, count, &recon);
+            // reconstruct the center position with weights
+            float wx = 0., wy = 0., wtot = 0.;
+            for(size_t j = 0; j < nh; ++j)
+            {
+                wx += x[j]*weight[j];
+                wy += y[j]*weight[j];
+                wtot += weight[j];
+            }
+
+            // no valid hits around this maximum, keep its fractions
+            if(wtot == 0.)
+                continue;
+
+            float recon_x = wx/wtot, recon_y = wy/wtot;
 
             // update profile with the reconstructed center
-            for(size_t j = 0; j < hits.size(); ++j)
+            for(size_t j = 0; j < nh; ++j)
             {
-                auto &hit = *hits.at(j);
-                __ic_frac[j][i] = __ic_prof.GetProfile(recon.x, recon.y, hit).frac*tot_E;
+                f[j] = __ic_prof.GetProfile(recon_x, recon_y, *hits[j]).frac*tot_E;
             }
         }
     }
-    __ic_sum_frac(hits.size(), maximums.size());
+    __ic_sum_frac(sb);
 }
 
 
@@ -353,7 +448,7 @@ const
 #else
 
 void PRadIslandCluster::FormCluster(std::vector<ModuleHit> &hits,
-                                    std::vector<ModuleCluster> &clusters)
+                                    ModuleClusters &clusters)
 const
 {
     // clear container first
@@ -363,10 +458,19 @@ const
     groupHits(hits, clusters);
 }
 
+// hits are assigned to the clusters first, and packed into the cluster spans
+// after all the hits are grouped
+static thread_local std::vector<unsigned int> __ic_owner;
+static thread_local std::vector<ModuleHit> __ic_assigned;
+static thread_local std::vector<char> __ic_adjacent;
+
 void PRadIslandCluster::groupHits(std::vector<ModuleHit> &hits,
-                                  std::vector<ModuleCluster> &clusters)
+                                  ModuleClusters &clusters)
 const
 {
+    __ic_owner.clear();
+    __ic_assigned.clear();
+
     // sort hits by energy
     std::sort(hits.begin(), hits.end(),
               [] (const ModuleHit &m1, const ModuleHit &m2)
@@ -378,33 +482,40 @@ const
     for(auto &hit : hits)
     {
         // less than min module energy, ignore this hit
-        if(hit.energy < min_module_energy.at(hit.geo.type))
+        if(hit.energy < min_module_energy.at(hit.geo->type))
             continue;
 
         // not belongs to any cluster, and the energy is larger than center threshold
         if(!fillClusters(hit, clusters) && (hit.energy > min_center_energy))
         {
-            clusters.emplace_back(hit);
-            clusters.back().AddHit(hit);
+            clusters.AddCluster(hit);
+            __ic_owner.push_back(clusters.size() - 1);
+            __ic_assigned.push_back(hit);
         }
     }
+
+    clusters.Pack(__ic_owner, __ic_assigned);
 }
 
-bool PRadIslandCluster::fillClusters(ModuleHit &hit, std::vector<ModuleCluster> &c)
+bool PRadIslandCluster::fillClusters(ModuleHit &hit, ModuleClusters &c)
 const
 {
     std::vector<unsigned int> indices;
     indices.reserve(5);
 
+    // check the hits assigned to the clusters so far
+    __ic_adjacent.assign(c.size(), 0);
+    for(size_t k = 0; k < __ic_owner.size(); ++k)
+    {
+        if(!__ic_adjacent[__ic_owner[k]] &&
+           PRadHyCalDetector::hit_distance(hit, __ic_assigned[k]) < CORNER_ADJACENT)
+            __ic_adjacent[__ic_owner[k]] = 1;
+    }
+
     for(unsigned int i = 0; i < c.size(); ++i)
     {
-        for(auto &prev_hit : c.at(i).hits)
-        {
-            if(PRadHyCalDetector::hit_distance(hit, prev_hit) < CORNER_ADJACENT) {
-                indices.push_back(i);
-                break;
-            }
-        }
+        if(__ic_adjacent[i])
+            indices.push_back(i);
     }
 
     // it belongs to no cluster
@@ -413,7 +524,8 @@ const
 
     // it belongs to single cluster
     if(indices.size() == 1) {
-        c.at(indices.front()).AddHit(hit);
+        __ic_owner.push_back(indices.front());
+        __ic_assigned.push_back(hit);
         return true;
     }
 
@@ -423,7 +535,7 @@ const
 
 // split hit that belongs to several clusters
 bool PRadIslandCluster::splitHit(ModuleHit &hit,
-                                 std::vector<ModuleCluster> &clusters,
+                                 ModuleClusters &clusters,
                                  std::vector<unsigned int> &indices)
 const
 {
@@ -454,10 +566,10 @@ const
         if(frac[i] == 0.)
             continue;
 
-        auto &cluster = clusters.at(indices.at(i));
         ModuleHit shared_hit(hit);
         shared_hit.energy *= frac[i]/total_frac;
-        cluster.AddHit(shared_hit);
+        __ic_owner.push_back(indices.at(i));
+        __ic_assigned.push_back(shared_hit);
     }
 
     return true;
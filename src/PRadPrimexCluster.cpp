@@ -6,7 +6,19 @@
 //============================================================================//
 
 #include "PRadPrimexCluster.h"
-
+#include <iostream>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#ifdef MULTI_THREAD
+#include <mutex>
+#include <condition_variable>
+#endif
 
 
 
@@ -15,15 +27,97 @@
 // which is needed in fetching result from island.F
 static int __prcl_ich[MROW][MCOL];
 
+#ifdef MULTI_THREAD
+// island.F and the table above are not reentrant, the clustering inside this
+// process can only be done by one thread at a time
+static std::mutex __prcl_locker;
+#endif
+
+// buffer shared between the main process and a worker process
+// input hits are written by the main process, and the output clusters are
+// written by the worker, the cluster hits are stored contiguously
+// the geometry of the input hits is shipped with them, the worker may have
+// an outdated copy of the modules, so the hits in the worker refer to the
+// geometry in the buffer, and they are bound back to the modules by the main
+// process
+struct __prcl_cluster_info
+{
+    ModuleHit center;
+    float energy;
+    float leakage;
+    int nhits;
+};
+
+// settings sent to the running workers, so they are not forked again
+#define PRCL_MAX_PATH 1024
+struct __prcl_settings
+{
+    float min_energy;
+    float max_energy;
+    int min_hits;
+    float min_center;
+    float adj_dist;
+    int module_status[MSECT][MCOL][MROW];
+    char profile[PRCL_MAX_PATH];
+};
+
+struct __prcl_shared_buffer
+{
+    __prcl_settings settings;
+    int nhits;
+    ModuleHit hits[PRCL_MAX_HITS];
+    PRadHyCalModule::Geometry geo[PRCL_MAX_HITS];
+    int nclusters;  // negative means the output does not fit into the buffer
+    __prcl_cluster_info clusters[PRCL_MAX_CLUSTERS];
+    ModuleHit cluster_hits[PRCL_MAX_CLUSTER_HITS];
+};
+
+// hits passed the energy threshold in current event
+static thread_local std::vector<ModuleHit> __prcl_hits;
+
+// commands sent to the worker process through the socket
+#define PRCL_CMD_STOP 0
+#define PRCL_CMD_CLUSTER 1
+#define PRCL_CMD_SETTINGS 2
+#define PRCL_CMD_PWO_PROFILE 3
+#define PRCL_CMD_LG_PROFILE 4
+
+struct PRadPrimexCluster::WorkerPool
+{
+    struct Worker
+    {
+        pid_t pid;
+        int fd;         // socket to send commands and receive replies
+        __prcl_shared_buffer *buffer;
+    };
+
+    std::vector<Worker> workers;
+    std::vector<Worker*> idle;
+#ifdef MULTI_THREAD
+    std::mutex locker;
+    std::condition_variable cond;
+#endif
+};
+
 PRadPrimexCluster::PRadPrimexCluster(const std::string &path)
+: nworkers(0), pool(new WorkerPool())
 {
     // configuration
     Configure(path);
 }
 
+PRadPrimexCluster::PRadPrimexCluster(const PRadPrimexCluster &that)
+: PRadHyCalCluster(that), adj_dist(that.adj_dist),
+  min_module_energy(that.min_module_energy), nworkers(that.nworkers),
+  pool(new WorkerPool())
+{
+    memcpy(module_status, that.module_status, sizeof(module_status));
+}
+
 PRadPrimexCluster::~PRadPrimexCluster()
 {
-    // place holder
+    StopWorkers();
+    delete pool;
 }
 
 PRadHyCalCluster *PRadPrimexCluster::Clone()
@@ -66,6 +160,11 @@ void PRadPrimexCluster::Configure(const std::string &path)
     SET_EMAX  = 9.9;                        // banks->CONFIG->config->CLUSTER_ENERGY_MAX;
     SET_HMIN  = min_cluster_size;           // banks->CONFIG->config->CLUSTER_MIN_HITS_NUMBER;
     SET_MINM  = min_center_energy*0.001;    // banks->CONFIG->config->CLUSTER_MAX_CELL_MIN_ENERGY;
+
+    // isolated worker processes for clustering in parallel, they are only
+    // forked by StartWorkers, the running ones receive the new settings
+    nworkers = getDefConfig<unsigned int>("Primex Workers", 0, false);
+    updateWorkers(PRCL_CMD_SETTINGS);
 }
 
 void PRadPrimexCluster::LoadCrystalProfile(const std::string &path)
@@ -76,6 +175,8 @@ void PRadPrimexCluster::LoadCrystalProfile(const std::string &path)
     char c_path[path.size()];
     strcpy(c_path, path.c_str());
     load_pwo_prof_(c_path, strlen(c_path));
+
+    updateWorkers(PRCL_CMD_PWO_PROFILE, path);
 }
 
 void PRadPrimexCluster::LoadLeadGlassProfile(const std::string &path)
@@ -86,6 +187,8 @@ void PRadPrimexCluster::LoadLeadGlassProfile(const std::string &path)
     char c_path[path.size()];
     strcpy(c_path, path.c_str());
     load_lg_prof_(c_path, strlen(c_path));
+
+    updateWorkers(PRCL_CMD_LG_PROFILE, path);
 }
 
 void PRadPrimexCluster::UpdateModuleStatus(const std::vector<PRadHyCalModule*> &mlist)
@@ -108,17 +211,378 @@ void PRadPrimexCluster::UpdateModuleStatus(const std::vector<PRadHyCalModule*> &
             module_status[sect][col][row] = 0;
 
     }
+
+    updateWorkers(PRCL_CMD_SETTINGS);
 }
 
 void PRadPrimexCluster::FormCluster(std::vector<ModuleHit> &hits,
-                                    std::vector<ModuleCluster> &clusters)
+                                    ModuleClusters &clusters)
 const
 {
     // clear container first
     clusters.clear();
 
+    // apply the energy threshold here, the hits only refer to the geometry of
+    // this process, so the worker processes should not access it
+    __prcl_hits.clear();
+    for(auto &hit : hits)
+    {
+        if(hit.energy >= min_module_energy.at(hit.geo->type))
+            __prcl_hits.push_back(hit);
+    }
+
+    // send the hits to an idle worker if there is any, otherwise do it here
+    if(!remoteCluster(__prcl_hits, clusters))
+        localCluster(__prcl_hits, clusters);
+}
+
+// fork the configured number of worker processes
+bool PRadPrimexCluster::StartWorkers()
+{
+    return StartWorkers(nworkers);
+}
+
+// fork the worker processes, every worker gets a copy of the current settings,
+// profiles and module status, the later changes are sent to them
+// it should be called only once before spawning any threads, a lock held by
+// the other threads at fork will never be released in the workers
+bool PRadPrimexCluster::StartWorkers(unsigned int num)
+{
+    if(pool->workers.size()) {
+        std::cerr << "PRad Primex Cluster Error: Worker processes are already "
+                  << "running, they need to be stopped before forking new ones."
+                  << std::endl;
+        return false;
+    }
+
+    if(!num)
+        return true;
+
+    // flush the output buffers, otherwise they will be duplicated in workers
+    std::cout.flush();
+    std::cerr.flush();
+    fflush(nullptr);
+
+    pool->workers.reserve(num);
+    for(unsigned int i = 0; i < num; ++i)
+    {
+        void *mem = mmap(nullptr, sizeof(__prcl_shared_buffer),
+                         PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                         -1, 0);
+        if(mem == MAP_FAILED) {
+            std::cerr << "PRad Primex Cluster Error: Failed to allocate shared "
+                      << "memory for worker process."
+                      << std::endl;
+            break;
+        }
+        auto buffer = new(mem) __prcl_shared_buffer;
+
+        int fds[2];
+        if(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            std::cerr << "PRad Primex Cluster Error: Failed to create socket "
+                      << "for worker process."
+                      << std::endl;
+            munmap(mem, sizeof(__prcl_shared_buffer));
+            break;
+        }
+
+        pid_t pid = fork();
+
+        // worker process
+        if(pid == 0) {
+            close(fds[0]);
+            // close the sockets to other workers
+            for(auto &worker : pool->workers)
+                close(worker.fd);
+
+            std::vector<ModuleHit> hits;
+            ModuleClusters clusters;
+            char cmd;
+            while(recv(fds[1], &cmd, 1, 0) == 1 && cmd != PRCL_CMD_STOP)
+            {
+                const auto &settings = buffer->settings;
+                switch(cmd)
+                {
+                case PRCL_CMD_SETTINGS:
+                    SET_EMIN = settings.min_energy;
+                    SET_EMAX = settings.max_energy;
+                    SET_HMIN = settings.min_hits;
+                    SET_MINM = settings.min_center;
+                    adj_dist = settings.adj_dist;
+                    memcpy(module_status, settings.module_status, sizeof(module_status));
+                    break;
+                case PRCL_CMD_PWO_PROFILE:
+                case PRCL_CMD_LG_PROFILE:
+                {
+                    char c_path[PRCL_MAX_PATH];
+                    strcpy(c_path, settings.profile);
+                    if(cmd == PRCL_CMD_PWO_PROFILE)
+                        load_pwo_prof_(c_path, strlen(c_path));
+                    else
+                        load_lg_prof_(c_path, strlen(c_path));
+                    break;
+                }
+                default:
+                    break;
+                }
+
+                if(cmd != PRCL_CMD_CLUSTER) {
+                    if(send(fds[1], &cmd, 1, MSG_NOSIGNAL) != 1)
+                        break;
+                    continue;
+                }
+
+                hits.assign(buffer->hits, buffer->hits + buffer->nhits);
+                for(int i = 0; i < buffer->nhits; ++i)
+                    hits[i].geo = &buffer->geo[i];
+                // the locker may be copied in a locked state, it is not
+                // needed in this single-threaded process
+                islandCluster(hits, clusters);
+
+                // write back clusters
+                int nclusters = 0, nhits = 0;
+                for(auto &cluster : clusters)
+                {
+                    if(nclusters >= PRCL_MAX_CLUSTERS ||
+                       nhits + (int)cluster.size() > PRCL_MAX_CLUSTER_HITS) {
+                        nclusters = -1;
+                        break;
+                    }
+
+                    auto &info = buffer->clusters[nclusters++];
+                    info.center = cluster.center;
+                    info.energy = cluster.energy;
+                    info.leakage = cluster.leakage;
+                    info.nhits = cluster.size();
+                    for(unsigned int i = cluster.begin; i < cluster.end; ++i)
+                        buffer->cluster_hits[nhits++] = clusters.GetHit(i);
+                }
+                buffer->nclusters = nclusters;
+
+                if(send(fds[1], &cmd, 1, MSG_NOSIGNAL) != 1)
+                    break;
+            }
+            _exit(0);
+        }
+
+        // main process
+        close(fds[1]);
+
+        if(pid < 0) {
+            std::cerr << "PRad Primex Cluster Error: Failed to fork worker process."
+                      << std::endl;
+            close(fds[0]);
+            munmap(mem, sizeof(__prcl_shared_buffer));
+            break;
+        }
+
+        WorkerPool::Worker worker;
+        worker.pid = pid;
+        worker.fd = fds[0];
+        worker.buffer = buffer;
+        pool->workers.push_back(worker);
+    }
+
+    {
+#ifdef MULTI_THREAD
+        std::lock_guard<std::mutex> lock(pool->locker);
+#endif
+        for(auto &worker : pool->workers)
+            pool->idle.push_back(&worker);
+    }
+
+    return pool->workers.size() == num;
+}
+
+// stop all the worker processes, it waits for the workers in use, and the
+// threads calling FormCluster afterwards cluster the events locally
+void PRadPrimexCluster::StopWorkers()
+{
+#ifdef MULTI_THREAD
+    // wait for the workers in use, no one can take them while holding the lock
+    std::unique_lock<std::mutex> lock(pool->locker);
+    pool->cond.wait(lock, [this] {return pool->idle.size() == pool->workers.size();});
+#endif
+
+    for(auto &worker : pool->workers)
+    {
+        char cmd = PRCL_CMD_STOP;
+        if(send(worker.fd, &cmd, 1, MSG_NOSIGNAL) != 1)
+            kill(worker.pid, SIGTERM);
+        close(worker.fd);
+        waitpid(worker.pid, nullptr, 0);
+        munmap(worker.buffer, sizeof(__prcl_shared_buffer));
+    }
+
+    pool->workers.clear();
+    pool->idle.clear();
+
+#ifdef MULTI_THREAD
+    // the waiting threads cluster their events locally
+    lock.unlock();
+    pool->cond.notify_all();
+#endif
+}
+
+unsigned int PRadPrimexCluster::GetNbofWorkers()
+const
+{
+    return pool->workers.size();
+}
+
+// send the current settings or a profile to the running workers, a worker
+// that fails to take it is stopped, so no event is clustered with old settings
+void PRadPrimexCluster::updateWorkers(char cmd, const std::string &path)
+{
+#ifdef MULTI_THREAD
+    // wait for the workers in use, no one can take them while holding the lock
+    std::unique_lock<std::mutex> lock(pool->locker);
+    pool->cond.wait(lock, [this] {return pool->idle.size() == pool->workers.size();});
+#endif
+
+    if(pool->workers.empty())
+        return;
+
+    if(path.size() >= PRCL_MAX_PATH) {
+        std::cerr << "PRad Primex Cluster Error: Profile path "
+                  << "\"" << path << "\" is too long for the worker processes."
+                  << std::endl;
+    }
+
+    std::vector<WorkerPool::Worker> running;
+    for(auto &worker : pool->workers)
+    {
+        auto &settings = worker.buffer->settings;
+        settings.min_energy = SET_EMIN;
+        settings.max_energy = SET_EMAX;
+        settings.min_hits = SET_HMIN;
+        settings.min_center = SET_MINM;
+        settings.adj_dist = adj_dist;
+        memcpy(settings.module_status, module_status, sizeof(module_status));
+        strncpy(settings.profile, path.c_str(), PRCL_MAX_PATH - 1);
+        settings.profile[PRCL_MAX_PATH - 1] = '\0';
+
+        char reply;
+        if(path.size() < PRCL_MAX_PATH &&
+           send(worker.fd, &cmd, 1, MSG_NOSIGNAL) == 1 &&
+           recv(worker.fd, &reply, 1, 0) == 1) {
+            running.push_back(worker);
+            continue;
+        }
+
+        std::cerr << "PRad Primex Cluster Error: Failed to update worker process "
+                  << worker.pid << ", it is stopped."
+                  << std::endl;
+        kill(worker.pid, SIGTERM);
+        close(worker.fd);
+        waitpid(worker.pid, nullptr, 0);
+        munmap(worker.buffer, sizeof(__prcl_shared_buffer));
+    }
+
+    if(running.size() == pool->workers.size())
+        return;
+
+    // all the workers are idle here
+    pool->workers.swap(running);
+    pool->idle.clear();
+    for(auto &worker : pool->workers)
+        pool->idle.push_back(&worker);
+}
+
+// cluster the hits in a worker process
+bool PRadPrimexCluster::remoteCluster(const std::vector<ModuleHit> &hits,
+                                      ModuleClusters &clusters)
+const
+{
+    if(hits.size() > PRCL_MAX_HITS)
+        return false;
+
+    // take an idle worker
+    WorkerPool::Worker *worker;
+    {
+#ifdef MULTI_THREAD
+        std::unique_lock<std::mutex> lock(pool->locker);
+        pool->cond.wait(lock, [this] {return !pool->idle.empty() || pool->workers.empty();});
+#endif
+        if(pool->idle.empty())
+            return false;
+        worker = pool->idle.back();
+        pool->idle.pop_back();
+    }
+
+    auto buffer = worker->buffer;
+    buffer->nhits = hits.size();
+    std::copy(hits.begin(), hits.end(), buffer->hits);
+    for(size_t i = 0; i < hits.size(); ++i)
+        buffer->geo[i] = *hits[i].geo;
+
+    // the output hits refer to the geometry in the buffer, bind them back to
+    // the geometry of the input hits
+    auto rebind = [&hits, buffer] (ModuleHit &hit) {
+        if(hit.geo >= buffer->geo && hit.geo < buffer->geo + buffer->nhits)
+            hit.geo = hits[hit.geo - buffer->geo].geo;
+    };
+
+    char cmd = PRCL_CMD_CLUSTER;
+    // a dead worker or an overflowed buffer falls back to local clustering
+    bool success = (send(worker->fd, &cmd, 1, MSG_NOSIGNAL) == 1) &&
+                   (recv(worker->fd, &cmd, 1, 0) == 1) &&
+                   (buffer->nclusters >= 0);
+
+    if(success) {
+        const ModuleHit *chit = buffer->cluster_hits;
+        for(int i = 0; i < buffer->nclusters; ++i)
+        {
+            const auto &info = buffer->clusters[i];
+            auto &cluster = clusters.AddCluster(info.center);
+            rebind(cluster.center);
+            for(int j = 0; j < info.nhits; ++j)
+            {
+                ModuleHit hit(*chit++);
+                rebind(hit);
+                clusters.AddHit(cluster, hit);
+            }
+            cluster.energy = info.energy;
+            cluster.leakage = info.leakage;
+        }
+    }
+
+    // return the worker
+    {
+#ifdef MULTI_THREAD
+        std::lock_guard<std::mutex> lock(pool->locker);
+#endif
+        pool->idle.push_back(worker);
+    }
+#ifdef MULTI_THREAD
+    // StopWorkers and updateWorkers may be waiting for all the workers
+    pool->cond.notify_all();
+#endif
+
+    return success;
+}
+
+// cluster the hits in this process
+void PRadPrimexCluster::localCluster(const std::vector<ModuleHit> &hits,
+                                     ModuleClusters &clusters)
+const
+{
+#ifdef MULTI_THREAD
+    std::lock_guard<std::mutex> lock(__prcl_locker);
+#endif
+    islandCluster(hits, clusters);
+}
+
+// call island.F for all the sectors and glue the clusters, the caller makes
+// sure only one thread is using the common blocks
+void PRadPrimexCluster::islandCluster(const std::vector<ModuleHit> &hits,
+                                      ModuleClusters &clusters)
+const
+{
+    clusters.clear();
+
     // build a hit map
-    std::map<int, ModuleHit*> hit_map;
+    std::map<int, const ModuleHit*> hit_map;
     for(auto &hit : hits)
     {
         hit_map[hit.id] = &hit;
@@ -126,31 +590,37 @@ const
 
     // call island reconstruction of each sectors
     // HyCal has 5 sectors, 4 for lead glass one for crystal
-    std::vector<std::vector<ModuleCluster>> sect_clusters;
-    sect_clusters.resize(MSECT);
+    // the clusters of all sectors are in the same container, sect_begin is the
+    // index of the first cluster of each sector
+    size_t sect_begin[MSECT + 1];
     for(int isect = 0; isect < MSECT; ++isect)
     {
+        sect_begin[isect] = clusters.size();
         callIsland(hits, isect);
-        sect_clusters[isect] = getIslandResult(hit_map);
+        getIslandResult(hit_map, clusters);
     }
+    sect_begin[MSECT] = clusters.size();
 
     // glue clusters separated by the sector
+    std::vector<char> merged(clusters.size(), 0);
     for(size_t i = 0; i < MSECT; ++i)
     {
         for(int j = i + 1; j < MSECT; ++j)
         {
-            glueClusters(sect_clusters.at(i), sect_clusters.at(j));
+            glueClusters(clusters, merged,
+                         sect_begin[i], sect_begin[i + 1],
+                         sect_begin[j], sect_begin[j + 1]);
         }
     }
 
-    // add clusters to the container
-    for(auto &sect : sect_clusters)
+    // remove the clusters merged into the others, their hits are left unused
+    size_t nclusters = 0;
+    for(size_t i = 0; i < clusters.size(); ++i)
     {
-        for(auto &cluster : sect)
-        {
-            clusters.emplace_back(std::move(cluster));
-        }
+        if(!merged[i])
+            clusters[nclusters++] = clusters[i];
     }
+    clusters.clusters.resize(nclusters);
 }
 
 void PRadPrimexCluster::callIsland(const std::vector<ModuleHit> &hits, int isect)
@@ -204,9 +674,8 @@ const
     // load hits in this sector
     for(auto &hit : hits)
     {
-        // not belong to this sector or energy is too low
-        if((hit.sector != isect) ||
-           (hit.energy < min_module_energy.at(hit.geo.type)))
+        // not belong to this sector, the energy threshold is already applied
+        if(hit.sector != isect)
             continue;
 
         const int &id  = hit.id;
@@ -229,19 +698,17 @@ const
 }
 
 // get result from fortran island code
-std::vector<ModuleCluster> PRadPrimexCluster::getIslandResult(const std::map<int, ModuleHit*> &hmap)
+void PRadPrimexCluster::getIslandResult(const std::map<int, const ModuleHit*> &hmap,
+                                        ModuleClusters &clusters)
 const
 {
-    std::vector<ModuleCluster> res;
-    res.reserve(10);
-
     for(int k = 0; k < adcgam_cbk_.nadcgam; ++k)
     {
         int ncl = std::min(adcgam_cbk_.u.iadcgam[k][8], MAX_CC);
-        ModuleCluster cluster;
+        auto &cluster = clusters.AddCluster(ModuleHit());
         // GeV to MeV
-        cluster.energy = adcgam_cbk_.u.fadcgam[k][0]*1000.;
-        cluster.leakage = cluster.energy;
+        float energy = adcgam_cbk_.u.fadcgam[k][0]*1000.;
+        float leakage = energy;
 
         for(int j = 0; j < ncl; ++j)
         {
@@ -250,34 +717,41 @@ const
             int id = ICH(kx, ky);
             // convert back from 0.1 MeV
             float ecell = 0.1*(float)ICL_IENER(k,j);
-            cluster.leakage -= ecell;
+            leakage -= ecell;
             auto it = hmap.find(id);
             if(it != hmap.end())
             {
                 ModuleHit hit(*it->second);
                 hit.energy = ecell;
-                cluster.hits.push_back(hit);
+                clusters.AddHit(cluster, hit);
             }
         }
-        cluster.FindCenter();
-        res.push_back(cluster);
+        cluster.energy = energy;
+        cluster.leakage = leakage;
+        clusters.hits.FindCenter(cluster);
     }
-
-    return res;
 }
 
-void PRadPrimexCluster::glueClusters(std::vector<ModuleCluster> &base,
-                                     std::vector<ModuleCluster> &sector)
+// merge the clusters of a sector into the adjacent ones of the base sector
+void PRadPrimexCluster::glueClusters(ModuleClusters &clusters,
+                                     std::vector<char> &merged,
+                                     size_t base_begin, size_t base_end,
+                                     size_t sect_begin, size_t sect_end)
 const
 {
-    // merge clusters between sectors
-    for(auto it = sector.begin(); it != sector.end(); ++it)
+    for(size_t i = sect_begin; i < sect_end; ++i)
     {
-        for(auto it2 = base.begin(); it2 != base.end(); ++it2)
+        if(merged[i])
+            continue;
+
+        for(size_t j = base_begin; j < base_end; ++j)
         {
-            if(checkTransAdj(*it, *it2)) {
-                it2->Merge(*it);
-                sector.erase(it--);
+            if(merged[j])
+                continue;
+
+            if(checkTransAdj(clusters[i], clusters[j], clusters.hits)) {
+                clusters.hits.Merge(clusters[j], clusters[i]);
+                merged[i] = 1;
                 break;
             }
         }
@@ -285,18 +759,26 @@ const
 }
 
 inline bool PRadPrimexCluster::checkTransAdj(const ModuleCluster &c1,
-                                             const ModuleCluster &c2)
+                                             const ModuleCluster &c2,
+                                             const ModuleHitArray &hits)
 const
 {
     // don't merge the clusters in the same sector
     if(c1.center.sector == c2.center.sector)
         return false;
 
-    for(auto &m1 : c1.hits)
+    const float *x = hits.x.data(), *y = hits.y.data();
+    const float *sx = hits.size_x.data(), *sy = hits.size_y.data();
+    // hit_distance() < adj_dist, without the square root
+    const float adj2 = adj_dist*adj_dist/4.;
+
+    for(unsigned int i = c1.begin; i < c1.end; ++i)
     {
-        for(auto &m2 : c2.hits)
+        for(unsigned int j = c2.begin; j < c2.end; ++j)
         {
-            if(PRadHyCalDetector::hit_distance(m1, m2) < adj_dist) {
+            float dx = (x[i] - x[j])/(sx[i] + sx[j]);
+            float dy = (y[i] - y[j])/(sy[i] + sy[j]);
+            if(dx*dx + dy*dy < adj2) {
                 return true;
             }
         }
@@ -305,7 +787,7 @@ const
     return false;
 }
 
-void PRadPrimexCluster::LeakCorr(ModuleCluster &, const std::vector<ModuleHit> &)
+void PRadPrimexCluster::LeakCorr(ModuleCluster &, ModuleHitArray &, const std::vector<ModuleHit> &)
 const
 {
     // place holder
@@ -39,6 +39,8 @@ void PRadSquareCluster::Configure(const std::string &path)
     bool verbose = (!path.empty());
 
     square_size = getDefConfig<unsigned int>("Square Size", 5, verbose);
+
+    selectPipeline<PRadSquareCluster>();
 }
 
 inline bool PRadSquareCluster::checkBelongs(const ModuleHit &center,
@@ -46,18 +48,80 @@ inline bool PRadSquareCluster::checkBelongs(const ModuleHit &center,
                                             float factor)
 const
 {
-    float dist_x = factor*center.geo.size_x;
-    float dist_y = factor*center.geo.size_y;
+    float dist_x = factor*center.geo->size_x;
+    float dist_y = factor*center.geo->size_y;
 
-    if((fabs(center.geo.x - hit.geo.x) > dist_x) ||
-       (fabs(center.geo.y - hit.geo.y) > dist_y))
+    if((fabs(center.geo->x - hit.geo->x) > dist_x) ||
+       (fabs(center.geo->y - hit.geo->y) > dist_y))
         return false;
 
     return true;
 }
 
+// scratch buffers reused between events
+// centers are registered in a uniform grid with linked lists, the cell size is
+// not smaller than the largest half window, so a hit only needs to check the
+// centers in the 3x3 cells around it
+// hits are assigned to the clusters first, and packed into the cluster spans
+// after all the hits are grouped
+struct __sc_arena
+{
+    float x_min, y_min, step;
+    int nx, ny;
+    std::vector<int> cell_head;     // last center in the cell, -1 for empty
+    std::vector<int> next_center;   // previous center in the same cell
+    std::vector<unsigned int> indices;
+    std::vector<unsigned int> owner;
+    std::vector<ModuleHit> assigned;
+
+    int cell(const ModuleHit &hit) const
+    {
+        int ix = (hit.geo->x - x_min)/step, iy = (hit.geo->y - y_min)/step;
+        return iy*nx + ix;
+    }
+
+    void init(const std::vector<ModuleHit> &hits, float factor)
+    {
+        float x_max = x_min = hits.front().geo->x;
+        float y_max = y_min = hits.front().geo->y;
+        float size = 0.;
+        for(auto &hit : hits)
+        {
+            x_min = std::min(x_min, float(hit.geo->x));
+            x_max = std::max(x_max, float(hit.geo->x));
+            y_min = std::min(y_min, float(hit.geo->y));
+            y_max = std::max(y_max, float(hit.geo->y));
+            size = std::max(size, float(std::max(hit.geo->size_x, hit.geo->size_y)));
+        }
+
+        // a small margin for the rounding
+        step = std::max(factor*size*1.01f, 1.f);
+        nx = int((x_max - x_min)/step) + 1;
+        ny = int((y_max - y_min)/step) + 1;
+        cell_head.assign(nx*ny, -1);
+        next_center.clear();
+        owner.clear();
+        assigned.clear();
+    }
+
+    void add_center(const ModuleHit &hit)
+    {
+        int c = cell(hit);
+        next_center.push_back(cell_head[c]);
+        cell_head[c] = next_center.size() - 1;
+    }
+
+    void assign(unsigned int cluster, const ModuleHit &hit)
+    {
+        owner.push_back(cluster);
+        assigned.push_back(hit);
+    }
+};
+
+static thread_local __sc_arena __sc_buf;
+
 void PRadSquareCluster::FormCluster(std::vector<ModuleHit> &hits,
-                                    std::vector<ModuleCluster> &clusters)
+                                    ModuleClusters &clusters)
 const
 {
     // clear container first
@@ -68,9 +132,12 @@ const
 }
 
 void PRadSquareCluster::groupHits(std::vector<ModuleHit> &hits,
-                                  std::vector<ModuleCluster> &clusters)
+                                  ModuleClusters &clusters)
 const
 {
+    if(hits.empty())
+        return;
+
     // sort hits by energy
     std::sort(hits.begin(), hits.end(),
               [] (const ModuleHit &m1, const ModuleHit &m2)
@@ -78,31 +145,47 @@ const
                   return m1.energy > m2.energy;
               });
 
+    float factor = float(square_size)/2.;
+    __sc_buf.init(hits, factor);
+
     // loop over all hits
     for(auto &hit : hits)
     {
         // not belongs to any cluster, and the energy is larger than center threshold
         if(!fillClusters(hit, clusters) && (hit.energy > min_center_energy))
         {
-            clusters.emplace_back(hit);
-            clusters.back().AddHit(hit);
+            clusters.AddCluster(hit);
+            __sc_buf.assign(clusters.size() - 1, hit);
+            __sc_buf.add_center(hit);
         }
     }
+
+    clusters.Pack(__sc_buf.owner, __sc_buf.assigned);
 }
 
-bool PRadSquareCluster::fillClusters(ModuleHit &hit, std::vector<ModuleCluster> &c)
+bool PRadSquareCluster::fillClusters(ModuleHit &hit, ModuleClusters &c)
 const
 {
-    std::vector<unsigned int> indices;
-    indices.reserve(50);
-
-    // check how many clusters the hit belongs to
-    for(unsigned int i = 0; i < c.size(); ++i)
-    {
-        const auto &center = c.at(i).center;
-        // within the square range
-        if(checkBelongs(center, hit, float(square_size)/2.)) {
-            indices.push_back(i);
+    auto &indices = __sc_buf.indices;
+    indices.clear();
+
+    if(c.size()) {
+        // check how many clusters the hit belongs to, only the nearby cells
+        int ix = (hit.geo->x - __sc_buf.x_min)/__sc_buf.step;
+        int iy = (hit.geo->y - __sc_buf.y_min)/__sc_buf.step;
+        for(int j = std::max(iy - 1, 0); j <= std::min(iy + 1, __sc_buf.ny - 1); ++j)
+        {
+            for(int i = std::max(ix - 1, 0); i <= std::min(ix + 1, __sc_buf.nx - 1); ++i)
+            {
+                for(int k = __sc_buf.cell_head[j*__sc_buf.nx + i];
+                    k >= 0;
+                    k = __sc_buf.next_center[k])
+                {
+                    // within the square range
+                    if(checkBelongs(c[k].center, hit, float(square_size)/2.))
+                        indices.push_back(k);
+                }
+            }
         }
     }
 
@@ -112,17 +195,20 @@ const
 
     // it belongs to single cluster
     if(indices.size() == 1) {
-        c.at(indices.front()).AddHit(hit);
+        __sc_buf.assign(indices.front(), hit);
         return true;
     }
 
+    // keep the order of clusters for energy sharing
+    std::sort(indices.begin(), indices.end());
+
     // it belongs to several clusters
     return splitHit(hit, c, indices);
 }
 
 // split hit that belongs to several clusters
 bool PRadSquareCluster::splitHit(ModuleHit &hit,
-                                 std::vector<ModuleCluster> &clusters,
+                                 ModuleClusters &clusters,
                                  std::vector<unsigned int> &indices)
 const
 {
@@ -153,10 +239,9 @@ const
         if(frac[i] == 0.)
             continue;
 
-        auto &cluster = clusters.at(indices.at(i));
         ModuleHit shared_hit(hit);
         shared_hit.energy *= frac[i]/total_frac;
-        cluster.AddHit(shared_hit);
+        __sc_buf.assign(indices.at(i), shared_hit);
     }
 
     return true;
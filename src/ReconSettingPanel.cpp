@@ -351,8 +351,11 @@ void ReconSettingPanel::loadHyCalConfig()
     std::string config_path = hyCalConfigPath->text().toStdString();
 
     PRadHyCalCluster *method = hycal->GetClusterMethod(method_name);
-    if(method)
+    if(method) {
         method->Configure(config_path);
+        method->UpdateVModuleNeighbors(hycal->GetModuleList());
+        hycal->UpdateReconVersion();
+    }
 }
 
 void ReconSettingPanel::changeCoordType(int t)
@@ -126,3 +126,79 @@ double cana::simpson(double begin, double end,
     return result*s/3.;
 }
 
+// gaussian fit to binned data (x, y), it is analytic so it is thread safe
+// ln(y) = a + b*x + c*x^2 is fitted by the weighted least squares with weight
+// y^2 (H. Guo, IEEE Signal Processing Magazine 28 (2011) 134)
+bool cana::gaus_fit(const double *x, const double *y, const size_t &n,
+                    double &amp, double &mean, double &sigma)
+{
+    if(n < 3)
+        return false;
+
+    // shift x for better precision
+    double x0 = 0.;
+    for(size_t i = 0; i < n; ++i)
+        x0 += x[i];
+    x0 /= n;
+
+    // normal equations
+    double s[5] = {0., 0., 0., 0., 0.}, t[3] = {0., 0., 0.};
+    for(size_t i = 0; i < n; ++i)
+    {
+        if(y[i] <= 0.)
+            continue;
+
+        double dx = x[i] - x0, w = y[i]*y[i], ly = std::log(y[i]);
+        double xp = w;
+        for(int k = 0; k < 5; ++k, xp *= dx)
+        {
+            s[k] += xp;
+            if(k < 3)
+                t[k] += xp*ly;
+        }
+    }
+
+    double m[3][4] = {{s[0], s[1], s[2], t[0]},
+                      {s[1], s[2], s[3], t[1]},
+                      {s[2], s[3], s[4], t[2]}};
+
+    // gaussian elimination with partial pivoting
+    for(int i = 0; i < 3; ++i)
+    {
+        int piv = i;
+        for(int j = i + 1; j < 3; ++j)
+        {
+            if(std::abs(m[j][i]) > std::abs(m[piv][i]))
+                piv = j;
+        }
+        if(m[piv][i] == 0.)
+            return false;
+        for(int k = 0; k < 4; ++k)
+            std::swap(m[i][k], m[piv][k]);
+
+        for(int j = i + 1; j < 3; ++j)
+        {
+            double f = m[j][i]/m[i][i];
+            for(int k = i; k < 4; ++k)
+                m[j][k] -= f*m[i][k];
+        }
+    }
+
+    double p[3];
+    for(int i = 2; i >= 0; --i)
+    {
+        p[i] = m[i][3];
+        for(int k = i + 1; k < 3; ++k)
+            p[i] -= m[i][k]*p[k];
+        p[i] /= m[i][i];
+    }
+
+    // not a peak
+    if(p[2] >= 0.)
+        return false;
+
+    sigma = std::sqrt(-0.5/p[2]);
+    mean = x0 - 0.5*p[1]/p[2];
+    amp = std::exp(p[0] - 0.25*p[1]*p[1]/p[2]);
+    return true;
+}